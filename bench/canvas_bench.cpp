@@ -0,0 +1,601 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+namespace {
+
+struct Options {
+  int repeats = 5;
+  float scale = 1.0f;
+  std::string filter;
+  std::string json_path;
+  std::string output_dir = ".";
+  bool gl = false;
+};
+
+struct Result {
+  std::string name;
+  double seconds = 0.0;
+  uint64_t primitives = 0, pixels = 0, bytes = 0;
+};
+
+// Small deterministic generator so every build renders the same scenes.
+class Rng {
+  uint64_t state;
+
+ public:
+  explicit Rng(uint64_t seed) : state(seed) {}
+  float next() {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return float(state >> 40) / float(1ull << 24);
+  }
+  float range(float lo, float hi) { return lo + (hi - lo) * next(); }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// Runs `setup` untimed and `run` timed `repeats` times, returns the median.
+double time_median(int repeats, const std::function<void()>& setup,
+                   const std::function<void()>& run) {
+  std::vector<double> samples;
+  for (int i = 0; i < repeats; i++) {
+    setup();
+    auto start = Clock::now();
+    run();
+    samples.push_back(
+        std::chrono::duration<double>(Clock::now() - start).count());
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+constexpr Viewport UNIT = {.top = 1.0, .bottom = -1.0, .left = -1.0,
+                           .right = 1.0};
+constexpr uint32_t SIZE = 1024;
+
+// Exposes the protected blend operator.
+class BlendCanvas : public BmpCanvas {
+ public:
+  using BmpCanvas::BmpCanvas;
+  Rgba blend_colors(const Rgba& top, const Rgba& bottom) const {
+    return blend(top, bottom);
+  }
+};
+
+Result bench_circles(const Options& opt) {
+  const uint32_t count = 2000 * opt.scale;
+  const float radius = 0.02f;
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "circles"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        Rng rng(1);
+        for (uint32_t i = 0; i < count; i++) {
+          img->add_circle(rng.range(-1, 1), rng.range(-1, 1), radius,
+                          Rgba{rng.next(), rng.next(), rng.next(), 1.0});
+        }
+      },
+      [&] { img->update(); });
+
+  float pixel_radius = radius * SIZE / 2.0f;
+  r.primitives = count;
+  r.pixels = count * uint64_t(M_PI * pixel_radius * pixel_radius);
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_thick_polylines(const Options& opt) {
+  const uint32_t lines = 8, points = 500 * opt.scale;
+  const float thickness = 0.005f;
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "thick_polylines"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        Rng rng(2);
+        for (uint32_t l = 0; l < lines; l++) {
+          std::vector<std::pair<float, float>> pts;
+          float y = rng.range(-0.8, 0.8);
+          for (uint32_t i = 0; i < points; i++) {
+            y = std::clamp(y + rng.range(-0.02, 0.02), -1.0f, 1.0f);
+            pts.emplace_back(-1.0f + 2.0f * i / points, y);
+          }
+          img->add_connected_points(pts, Rgba{0.0, 0.0, 0.5, 0.7}, thickness);
+        }
+      },
+      [&] { img->update(); });
+
+  float pixel_thickness = thickness * SIZE / 2.0f;
+  r.primitives = uint64_t(lines) * (points - 1);
+  r.pixels = uint64_t(lines) * SIZE * 2.0f * pixel_thickness;
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_decimated_series(const Options& opt) {
+  const uint32_t samples = 2000000 * opt.scale;
+  std::unique_ptr<BmpCanvas> img;
+  std::vector<std::pair<float, float>> pts;
+
+  Result r{.name = "decimated_series"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        img->set_decimation(true);
+        Rng rng(10);
+        pts.clear();
+        float y = 0.0f;
+        for (uint32_t i = 0; i < samples; i++) {
+          y = std::clamp(y + rng.range(-0.01, 0.01), -1.0f, 1.0f);
+          pts.emplace_back(-1.0f + 2.0f * i / samples, y);
+        }
+      },
+      [&] {
+        img->add_connected_points(pts, BLACK, 0.0f);
+        img->update();
+      });
+
+  r.primitives = samples - 1;
+  r.pixels = uint64_t(SIZE) * 4;
+  r.bytes = uint64_t(samples) * sizeof(pts[0]);
+  return r;
+}
+
+Result bench_bezier_curves(const Options& opt) {
+  const uint32_t count = 500 * opt.scale;
+  const float thickness = 0.003f;
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "bezier_curves"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        Rng rng(6);
+        auto pt = [&] { return Vec2(rng.range(-1, 1), rng.range(-1, 1)); };
+        for (uint32_t i = 0; i < count; i++) {
+          std::array<Vec2, 4> p = {pt(), pt(), pt(), pt()};
+          img->add_cubic_bezier(p[0], p[1], p[2], p[3],
+                                Rgba{0.5, 0.0, 0.5, 0.5}, thickness);
+        }
+      },
+      [&] { img->update(); });
+
+  // Roughly one unit of curve length per curve.
+  r.primitives = count;
+  r.pixels = uint64_t(count) * SIZE / 2 * thickness * SIZE;
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_text_labels(const Options& opt) {
+  const uint32_t count = 2000 * opt.scale;
+  const float size = 0.02f;
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "text_labels"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        Rng rng(7);
+        for (uint32_t i = 0; i < count; i++) {
+          img->add_text(rng.range(-1, 1), rng.range(-1, 1),
+                        "label " + std::to_string(i), size, BLACK);
+        }
+      },
+      [&] { img->update(); });
+
+  // About ten cells per label.
+  float cell = size * SIZE / 2;
+  r.primitives = count;
+  r.pixels = uint64_t(count * 10 * cell * cell * 0.75f);
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_scatter_points(const Options& opt) {
+  const uint32_t count = 1000000 * opt.scale;
+  const float radius = 0.0005f;
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "scatter_points"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        img->set_lod_threshold(1.0f);
+        Rng rng(8);
+        for (uint32_t i = 0; i < count; i++) {
+          img->add_circle(rng.range(-1, 1), rng.range(-1, 1), radius,
+                          Rgba{0.0, 0.2, 0.6, 0.5});
+        }
+      },
+      [&] { img->update(); });
+
+  // Each point is splatted over four pixels.
+  r.primitives = count;
+  r.pixels = uint64_t(count) * 4;
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_density_points(const Options& opt) {
+  const uint32_t count = 10000000 * opt.scale;
+  std::unique_ptr<DensityCanvas> img;
+  std::vector<Vec2> points;
+
+  Result r{.name = "density_points"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<DensityCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        Rng rng(9);
+        points.clear();
+        for (uint32_t i = 0; i < count; i++) {
+          // Clustered around the origin, so the log scale has range.
+          float r = rng.next() * rng.next(), t = rng.range(0, 2 * M_PI);
+          points.emplace_back(r * std::cos(t), r * std::sin(t));
+        }
+      },
+      [&] {
+        img->add_points(points);
+        img->update();
+      });
+
+  r.primitives = count;
+  r.pixels = uint64_t(SIZE) * SIZE;
+  r.bytes = count * sizeof(Vec2) + r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result translucent_triangles(const Options& opt, bool linear) {
+  const uint32_t count = 50 * opt.scale;
+  std::unique_ptr<BmpCanvas> img;
+  double area = 0.0;
+
+  Result r{.name = linear ? "translucent_triangles_linear"
+                          : "translucent_triangles"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        img->set_linear_blending(linear);
+        Rng rng(3);
+        area = 0.0;
+        for (uint32_t i = 0; i < count; i++) {
+          Vec2 a(rng.range(-1, 1), rng.range(-1, 1));
+          Vec2 b(rng.range(-1, 1), rng.range(-1, 1));
+          Vec2 c(rng.range(-1, 1), rng.range(-1, 1));
+          area += std::abs((b.x - a.x) * (c.y - a.y) -
+                           (c.x - a.x) * (b.y - a.y)) /
+                  2.0;
+          img->add_triangle(a, b, c,
+                            Rgba{rng.next(), rng.next(), rng.next(), 0.3});
+        }
+      },
+      [&] { img->update(); });
+
+  r.primitives = count;
+  r.pixels = area * (SIZE / 2.0) * (SIZE / 2.0);
+  r.bytes = r.pixels * sizeof(Rgba) * 2;
+  return r;
+}
+
+Result bench_translucent_triangles(const Options& opt) {
+  return translucent_triangles(opt, false);
+}
+
+Result bench_translucent_triangles_linear(const Options& opt) {
+  return translucent_triangles(opt, true);
+}
+
+// Overlapping opaque bars, as in a bar chart. Opaque OVER fills only store,
+// the other modes read every pixel they write.
+Result bars(const Options& opt, BlendMode mode, const char* name) {
+  const uint32_t count = 400 * opt.scale;
+  std::unique_ptr<BmpCanvas> img;
+  double area = 0.0;
+
+  Result r{.name = name};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(SIZE, SIZE, "", UNIT, WHITE);
+        img->set_blend_mode(mode);
+        Rng rng(5);
+        area = 0.0;
+        for (uint32_t i = 0; i < count; i++) {
+          float x = rng.range(-1, 1), w = rng.range(0.01, 0.05);
+          float top = rng.range(-1, 1);
+          area += w * (top + 1.0);
+          img->add_polygon({{x, -1}, {x + w, -1}, {x + w, top}, {x, top}},
+                           Rgba{rng.next(), rng.next(), rng.next(), 1.0});
+        }
+      },
+      [&] { img->update(); });
+
+  r.primitives = count;
+  r.pixels = area * (SIZE / 2.0) * (SIZE / 2.0);
+  r.bytes = r.pixels * sizeof(Rgba) * (mode == BlendMode::OVER ? 1 : 2);
+  return r;
+}
+
+Result bench_solid_bars(const Options& opt) {
+  return bars(opt, BlendMode::OVER, "solid_bars");
+}
+
+Result bench_additive_bars(const Options& opt) {
+  return bars(opt, BlendMode::ADD, "additive_bars");
+}
+
+Result bench_floodfill(const Options& opt) {
+  const uint32_t size = SIZE * std::sqrt(opt.scale);
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "floodfill"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] {
+        img = std::make_unique<BmpCanvas>(size, size, "", UNIT, WHITE);
+        img->add_line(-1.0, -1.0, 1.0, 1.0, BLACK, 0.0);
+        img->update();
+      },
+      [&] { img->floodfill(uint32_t(0), size - 1, RED); });
+
+  r.primitives = 1;
+  r.pixels = uint64_t(size) * size / 2;
+  r.bytes = r.pixels * sizeof(Rgba);
+  return r;
+}
+
+Result bench_blit_scaling(const Options& opt) {
+  const uint32_t size = SIZE * std::sqrt(opt.scale);
+  BmpCanvas source(size / 3, size / 3, "", UNIT, NONE);
+  source.add_circle(0.0, 0.0, 0.8, Rgba{0.0, 0.5, 0.0, 0.5});
+  source.update();
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "blit_canvas_scaling"};
+  r.seconds = time_median(
+      opt.repeats,
+      [&] { img = std::make_unique<BmpCanvas>(size, size, "", UNIT, WHITE); },
+      [&] {
+        img->blit_canvas(source, Viewport{.top = 0.9,
+                                          .bottom = -0.9,
+                                          .left = -0.9,
+                                          .right = 0.9});
+      });
+
+  r.primitives = 1;
+  r.pixels = uint64_t(size * 0.9) * uint64_t(size * 0.9);
+  r.bytes = r.pixels * sizeof(Rgba) * 3;
+  return r;
+}
+
+Result bench_blend(const Options& opt) {
+  const uint32_t count = 4000000 * opt.scale;
+  BlendCanvas img(1, 1, "", UNIT, WHITE);
+  std::vector<Rgba> tops;
+  Rng rng(4);
+  for (uint32_t i = 0; i < 1024; i++) {
+    tops.push_back(Rgba{rng.next(), rng.next(), rng.next(), rng.next()});
+  }
+  Rgba acc = WHITE;
+
+  Result r{.name = "canvas_blend"};
+  r.seconds = time_median(
+      opt.repeats, [&] { acc = WHITE; },
+      [&] {
+        for (uint32_t i = 0; i < count; i++) {
+          acc = img.blend_colors(tops[i & 1023], acc);
+        }
+      });
+  volatile float sink = acc.a;
+  (void)sink;
+
+  r.primitives = 0;
+  r.pixels = count;
+  r.bytes = r.pixels * sizeof(Rgba) * 2;
+  return r;
+}
+
+Result bench_bmp_display(const Options& opt) {
+  const uint32_t size = 2 * SIZE * std::sqrt(opt.scale);
+  BmpCanvas img(size, size, opt.output_dir + "/canvas_bench_display.bmp",
+                UNIT, WHITE);
+  img.add_triangle(Vec2(-1.0, -1.0), Vec2(1.0, -1.0), Vec2(0.0, 1.0), BLUE);
+  img.update();
+
+  Result r{.name = "bmp_display"};
+  r.seconds = time_median(
+      opt.repeats, [] {}, [&] { img.display(); });
+
+  r.primitives = 0;
+  r.pixels = uint64_t(size) * size;
+  r.bytes = 54 + r.pixels * 3;
+  return r;
+}
+
+Result bench_bmp_load(const Options& opt) {
+  const uint32_t size = 2 * SIZE * std::sqrt(opt.scale);
+  std::string path = opt.output_dir + "/canvas_bench_load.bmp";
+  {
+    BmpCanvas source(size, size, path, UNIT, WHITE);
+    source.add_circle(0.0, 0.0, 0.8, BLUE);
+    source.update();
+    source.display();
+  }
+  std::unique_ptr<BmpCanvas> img;
+
+  Result r{.name = "bmp_load"};
+  r.seconds = time_median(
+      opt.repeats, [&] { img.reset(); },
+      [&] { img = BmpCanvas::load(path, "", UNIT); });
+
+  r.primitives = 0;
+  r.pixels = uint64_t(size) * size;
+  r.bytes = r.pixels * (3 + sizeof(Rgba));
+  return r;
+}
+
+class BenchHandler : public WindowHandler {
+ public:
+  uint32_t frames = 0, target_frames = 0;
+  void on_update(WindowCanvas& canvas) override {
+    if (++frames >= target_frames) canvas.stop();
+  }
+};
+
+// Opt-in: needs a display. Run with LIBGL_ALWAYS_SOFTWARE=1 to measure
+// Mesa's llvmpipe rather than the hardware driver.
+Result bench_gl(const Options& opt) {
+  const uint32_t count = 5000 * opt.scale;
+  auto handler = std::make_shared<BenchHandler>();
+  handler->target_frames = 60;
+  auto handler_copy = handler;
+  GLFWCanvas img(SIZE, SIZE, "canvas_bench", std::move(handler_copy), UNIT);
+
+  Rng rng(5);
+  for (uint32_t i = 0; i < count; i++) {
+    float x = rng.range(-1, 1), y = rng.range(-1, 1);
+    Rgba color = {rng.next(), rng.next(), rng.next(), 0.5};
+    switch (i % 3) {
+      case 0:
+        img.add_circle(x, y, 0.02, color);
+        break;
+      case 1:
+        img.add_line(x, y, x + 0.1, y + 0.05, color, 0.005);
+        break;
+      default:
+        img.add_triangle(Vec2(x, y), Vec2(x + 0.05, y), Vec2(x, y + 0.05),
+                         color);
+    }
+  }
+
+  auto start = Clock::now();
+  img.display();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  Result r{.name = "gl_mixed_scene"};
+  r.seconds = seconds / handler->frames;
+  r.primitives = count;
+  r.pixels = uint64_t(SIZE) * SIZE;
+  r.bytes = r.pixels * 4;
+  return r;
+}
+
+void print_usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--repeats N] [--scale F] [--filter SUBSTR] [--json PATH|-]"
+               " [--output-dir DIR] [--gl]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--repeats" && has_value) {
+      opt.repeats = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--scale" && has_value) {
+      opt.scale = std::atof(argv[++i]);
+    } else if (arg == "--filter" && has_value) {
+      opt.filter = argv[++i];
+    } else if (arg == "--json" && has_value) {
+      opt.json_path = argv[++i];
+    } else if (arg == "--output-dir" && has_value) {
+      opt.output_dir = argv[++i];
+    } else if (arg == "--gl") {
+      opt.gl = true;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<std::pair<std::string, std::function<Result(const Options&)>>>
+      benches = {
+          {"circles", bench_circles},
+          {"thick_polylines", bench_thick_polylines},
+          {"decimated_series", bench_decimated_series},
+          {"bezier_curves", bench_bezier_curves},
+          {"text_labels", bench_text_labels},
+          {"scatter_points", bench_scatter_points},
+          {"density_points", bench_density_points},
+          {"translucent_triangles", bench_translucent_triangles},
+          {"translucent_triangles_linear", bench_translucent_triangles_linear},
+          {"solid_bars", bench_solid_bars},
+          {"additive_bars", bench_additive_bars},
+          {"floodfill", bench_floodfill},
+          {"blit_canvas_scaling", bench_blit_scaling},
+          {"canvas_blend", bench_blend},
+          {"bmp_display", bench_bmp_display},
+          {"bmp_load", bench_bmp_load},
+      };
+  if (opt.gl) benches.push_back({"gl_mixed_scene", bench_gl});
+
+  // With --json - the table goes to stderr so stdout holds only the JSON.
+  FILE* table = opt.json_path == "-" ? stderr : stdout;
+  std::vector<Result> results;
+  for (const auto& [name, bench] : benches) {
+    if (!opt.filter.empty() && name.find(opt.filter) == std::string::npos)
+      continue;
+
+    Result r = bench(opt);
+    results.push_back(r);
+
+    double s = r.seconds > 0.0 ? r.seconds : 1e-12;
+    std::fprintf(table,
+                 "%-24s %10.3f ms %14.0f prim/s %14.0f px/s %10.1f MB/s\n",
+                 r.name.c_str(), r.seconds * 1e3, r.primitives / s,
+                 r.pixels / s, r.bytes / s / 1e6);
+  }
+
+  if (opt.json_path.empty()) return 0;
+
+  std::ofstream file;
+  if (opt.json_path != "-") {
+    file.open(opt.json_path);
+    if (!file.is_open()) {
+      std::cerr << "Could not open file " << opt.json_path << "\n";
+      return 1;
+    }
+  }
+  std::ostream& out = opt.json_path == "-" ? std::cout : file;
+
+  out << "{\n  \"repeats\": " << opt.repeats << ",\n  \"scale\": " << opt.scale
+      << ",\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    double s = r.seconds > 0.0 ? r.seconds : 1e-12;
+    out << "    {\"name\": \"" << r.name << "\", \"seconds\": " << r.seconds
+        << ", \"primitives\": " << r.primitives << ", \"pixels\": " << r.pixels
+        << ", \"bytes\": " << r.bytes
+        << ", \"primitives_per_sec\": " << r.primitives / s
+        << ", \"pixels_per_sec\": " << r.pixels / s
+        << ", \"mb_per_sec\": " << r.bytes / s / 1e6 << "}"
+        << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+  return 0;
+}
@@ -2,11 +2,18 @@
 #define __CANVAS_CANVAS_H
 
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -64,21 +71,123 @@
 #define INDEX_GET(reciever, vec, index) reciever = vec[index];
 #define INDEX_SET(vec, index, value) vec[index] = value;
 #define UNWRAP(var, into) into = var.value();
+#define ASSERT(expr, pass_condition) (void)(expr);
+#endif
+
+// Define CANVAS_STATS (cmake -DCANVAS_STATS=ON) to have FrameBufferCanvas
+// collect RasterStats during update(). Without it the counters compile out.
+#ifdef CANVAS_STATS
+#define STATS(expr) expr;
+#else
+#define STATS(expr)
 #endif
 
 namespace Canvas {
 
+// Command buffer for submitting primitives from one thread. Each context
+// only synchronizes with the canvas merging it, so contexts on different
+// threads never contend. Pending primitives are merged into the canvas at
+// its next update(), after the ones added to the canvas directly, ordered by
+// context id and then by submission order.
+class SubmissionContext {
+  friend class Canvas;
+
+ protected:
+  uint32_t id;
+  std::mutex mutex;
+  std::list<Primitive> pending;
+  // Only touched by the submitting thread.
+  BlendMode blend_mode = BlendMode::OVER;
+
+ public:
+  SubmissionContext(uint32_t id);
+
+  uint32_t get_id() const;
+
+  // The blend mode of the primitives added through the add_* functions.
+  void set_blend_mode(BlendMode mode);
+  BlendMode get_blend_mode() const;
+
+  void add(Primitive p);
+  void add_line(float x1, float y1, float x2, float y2, Rgba color,
+                float thickness);
+  void add_circle(float x, float y, float radius, Rgba color);
+  void add_triangle(Vec2 p1, Vec2 p2, Vec2 p3, Rgba color);
+  void add_polygon(const std::vector<Vec2>& points, Rgba color,
+                   FillRule rule = FillRule::NON_ZERO);
+  void add_polygon(const std::vector<std::vector<Vec2>>& contours, Rgba color,
+                   FillRule rule = FillRule::NON_ZERO);
+  void add_polyline(const std::vector<Vec2>& points, Rgba color,
+                    float thickness, LineJoin join = LineJoin::ROUND);
+  void add_quadratic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Rgba color,
+                            float thickness);
+  void add_cubic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Vec2 p3, Rgba color,
+                        float thickness);
+  void add_text(float x, float y, const std::string& text, float size,
+                Rgba color);
+  void add_image(std::shared_ptr<FrameBufferCanvas> source,
+                 Viewport location);
+};
+
 class Canvas {
  protected:
-  std::list<std::variant<Line, Circle, Triangle>> primitives;
+  std::list<Primitive> primitives;
   Viewport viewport;
+  BlendMode blend_mode = BlendMode::OVER;
+  // Bumped on every change to the primitive list or the viewport.
+  uint64_t scene_version = 0;
+  // The first `static_count` primitives, up to and including `static_last`,
+  // are the static layer. `static_version` is bumped whenever it changes,
+  // which includes changes of the viewport.
+  size_t static_count = 0;
+  std::list<Primitive>::iterator static_last;
+  uint64_t static_version = 0;
+  std::list<Primitive>::const_iterator dynamic_begin() const;
+  // Sorted by id.
+  std::vector<std::shared_ptr<SubmissionContext>> submission_contexts;
+  std::mutex submission_mutex;
 
+  // Appends the primitives pending in the submission contexts.
+  void merge_submissions();
+
+  virtual void draw_primitives(const std::list<Primitive>& list);
+  void dispatch_primitive(const Primitive& p);
   virtual void draw_primitive(const Line& l) = 0;
   virtual void draw_primitive(const Circle& c) = 0;
   virtual void draw_primitive(const Triangle& p) = 0;
+  virtual void draw_primitive(const Polygon& p) = 0;
+  virtual void draw_primitive(const Polyline& p) = 0;
+  virtual void draw_primitive(const Bezier& b) = 0;
+  virtual void draw_primitive(const Text& t) = 0;
+  virtual void draw_primitive(const Image& i) = 0;
+  // Layers are only composited by FrameBufferCanvas.
+  virtual void draw_primitive(const PushLayer& l) {}
+  virtual void draw_primitive(const PopLayer& l) {}
 
   virtual Rgba blend(const Rgba& top, const Rgba& bottom) const;
 
+  // The full resolution points of the polylines add_connected_points()
+  // stored decimated, to decimate them again for a new viewport.
+  struct DecimatedPolyline {
+    std::vector<Vec2> points;
+    float thickness;
+    bool x_monotonic;
+    std::list<Primitive>::iterator primitive;
+  };
+  std::list<DecimatedPolyline> decimated;
+  // How many of them belong to the static layer.
+  size_t static_decimated = 0;
+  bool decimation = false;
+  // The pixel transform the stored polylines are decimated for.
+  Transform2D decimated_for;
+  static constexpr float DECIMATION_TOLERANCE_PX = 0.25f;
+
+  std::vector<Vec2> decimate(const DecimatedPolyline& d,
+                             const Transform2D& to_pixels) const;
+  // Decimates the stored polylines again if pixel_transform() changed since,
+  // as when the viewport or the output size changes.
+  void redecimate();
+
  public:
   Canvas() = delete;
   Canvas(Viewport viewport);
@@ -91,89 +200,751 @@ class Canvas {
                         float thickness);
   virtual void add_circle(float x, float y, float radius, Rgba color);
   virtual void add_triangle(Vec2 p1, Vec2 p2, Vec2 p3, Rgba color);
+  virtual void add_polygon(const std::vector<Vec2>& points, Rgba color,
+                           FillRule rule = FillRule::NON_ZERO);
+  virtual void add_polygon(const std::vector<std::vector<Vec2>>& contours,
+                           Rgba color, FillRule rule = FillRule::NON_ZERO);
+  virtual void add_polyline(const std::vector<Vec2>& points, Rgba color,
+                            float thickness, LineJoin join = LineJoin::ROUND);
+  virtual void add_quadratic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Rgba color,
+                                    float thickness);
+  virtual void add_cubic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Vec2 p3,
+                                Rgba color, float thickness);
+  virtual void add_text(float x, float y, const std::string& text, float size,
+                        Rgba color);
+  virtual void add_image(std::shared_ptr<FrameBufferCanvas> source,
+                         Viewport location);
+  // Keeps the blend mode set on `p`.
+  virtual void add_primitive(Primitive p);
   virtual void clear_primitives();
+  // The blend mode the add_* functions give their primitives, OVER until
+  // changed. Opaque OVER and REPLACE fills are plain stores on framebuffer
+  // canvases, the other modes read the pixels they combine with.
+  void set_blend_mode(BlendMode mode);
+  BlendMode get_blend_mode() const;
+  // Everything added so far becomes the static layer, typically axes, grids
+  // and historical data. Canvases redrawing every frame may cache it between
+  // frames, GLFWCanvas renders it to an offscreen texture once per change.
+  // It is still drawn first, whatever is added afterwards is dynamic.
+  virtual void mark_static();
+  // Removes the dynamic primitives and keeps the static layer.
+  virtual void clear_dynamic();
+  size_t get_static_count() const;
+  // The scene as of the last merge of the submission contexts.
+  const std::list<Primitive>& get_primitives() const;
 
   virtual void add_connected_points(
       const std::vector<std::pair<float, float>>& pts, Rgba color,
       float thickness);
+  // Off by default. When on, add_connected_points() keeps its points aside
+  // and stores a polyline of only what the canvas resolution can show, M4
+  // decimated when x is monotonic, as for time series, and simplified to a
+  // quarter pixel otherwise. set_viewport() and resizing a window decimate
+  // them again when the pixel transform changes. Turning it off restores the
+  // full polylines.
+  void set_decimation(bool enabled);
+  // World to pixel coordinates, if the canvas has a resolution to decimate
+  // for.
+  virtual std::optional<Transform2D> pixel_transform() const;
+
+  // The context with this id, created on first use. Any thread may call
+  // this and then submit through the context. Windows redrawing on demand
+  // only pick submissions up with the next frame, see request_redraw().
+  std::shared_ptr<SubmissionContext> submission_context(uint32_t id);
 
   virtual void update();
   virtual void display() = 0;
 };
 
+// A scene serialized as a binary display list, which replays into any
+// canvas. The format is little endian with 4 byte aligned records:
+//
+//   header  "CVDL", u32 version, f32 viewport top, bottom, left, right,
+//           u64 number of primitives
+//   record  u32 type, u32 payload size, payload padded to 4 bytes
+//
+// Record types are the Primitive indices, plus IMAGE_DATA records holding
+// the pixels of an image source before the first Image using it. Records of
+// drawable primitives end with their u32 blend mode, which older lists leave
+// out and older readers skip. Loading and replaying throw std::runtime_error
+// on files that do not parse.
+class DisplayList {
+ protected:
+  // Either `bytes` or a read only mapping of a file backs `data`.
+  std::vector<uint8_t> bytes;
+  void* mapping = nullptr;
+  size_t mapping_size = 0;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+
+  DisplayList() = default;
+  void check_header() const;
+
+ public:
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint32_t IMAGE_DATA = 0x100;
+
+  static std::vector<uint8_t> encode(const Canvas& canvas);
+  static void save(const std::string& path, const Canvas& canvas);
+  // Maps the file instead of reading it, replaying decodes in place.
+  static DisplayList map(const std::string& path);
+  static DisplayList map(int fd);
+
+  DisplayList(std::vector<uint8_t> bytes);
+  DisplayList(const DisplayList&) = delete;
+  DisplayList(DisplayList&& other);
+  ~DisplayList();
+
+  Viewport get_viewport() const;
+  uint64_t get_primitive_count() const;
+  // Appends the primitives to the canvas, images are recreated as BmpCanvas
+  // sources shared by every Image using them.
+  void replay(Canvas& canvas) const;
+};
+
+// A8 stamps of the embedded font, box filtered to a pixel height and cached
+// per height and character. Glyphs taller than MAX_HEIGHT are sampled with
+// coverage() as they are drawn instead, so large text costs no memory.
+class GlyphCache {
+ public:
+  struct Stamp {
+    uint32_t width = 0, height = 0;
+    // Rows from the top.
+    std::vector<uint8_t> coverage;
+  };
+
+  static constexpr uint32_t MAX_HEIGHT = 256;
+
+  // Width of the stamp for a pixel height.
+  static uint32_t width(uint32_t pixel_height);
+  // Coverage of stamp pixel (x, y), counting rows from the top.
+  static uint8_t coverage(char c, uint32_t pixel_height, uint32_t x,
+                          uint32_t y);
+
+  // The reference is valid until the next call, which may evict the cache.
+  const Stamp& get(char c, uint32_t pixel_height);
+  void clear();
+
+ private:
+  static constexpr size_t MAX_BYTES = 16 << 20;
+  std::unordered_map<uint64_t, Stamp> stamps;
+  size_t bytes = 0;
+};
+
+struct RasterStats {
+  // Top level primitives drawn and the time spent on them, indexed by
+  // Primitive::index().
+  std::array<uint64_t, std::variant_size_v<Primitive>> primitives = {};
+  std::array<uint64_t, std::variant_size_v<Primitive>> time_ns = {};
+  // Primitives, including the triangles lines and circles are split into,
+  // rejected before rasterization.
+  uint64_t culled = 0;
+  uint64_t pixels_written = 0;
+  uint64_t pixels_blended = 0;
+  uint64_t temp_allocations = 0;
+  // Primitives below the LOD threshold drawn as splats.
+  uint64_t splats = 0;
+};
+
 class FrameBufferCanvas : public Canvas {
  protected:
   uint32_t width, height;
+  RasterStats stats;
+  // World to pixel coordinates, recomputed whenever the viewport changes.
+  Transform2D to_pixels;
+  // Rasterizers never write pixels outside of `clip`. It covers the whole
+  // canvas unless a subclass renders the scene in parts.
+  PixelRect clip;
+
+  struct Layer {
+    PixelRect rect;
+    float opacity = 1.0f;
+    // Set when every primitive in the layer has this color, then only the
+    // A8 `coverage` is stored. Otherwise `pixels` holds premultiplied RGBA8.
+    std::optional<Rgba> color;
+    std::vector<uint8_t> coverage;
+    std::vector<std::array<uint8_t, 4>> pixels;
+
+    void blend(uint32_t x, uint32_t y, const Rgba& c);
+  };
+  // Only the first `layer_depth` entries are active, the rest keep their
+  // buffers around for the next update().
+  std::vector<Layer> layers;
+  size_t layer_depth = 0;
+
+  void begin_layer(const PushLayer& layer,
+                   std::list<Primitive>::const_iterator begin,
+                   std::list<Primitive>::const_iterator end);
+  void end_layer();
+  PixelRect pixel_bounds(const Primitive& p) const;
+  // For every tile of the canvas, in rows from the bottom, the primitives
+  // that touch it in list order. Layers go to every tile of their contents.
+  std::vector<std::vector<std::list<Primitive>::const_iterator>>
+  bin_primitives(uint32_t tile_width, uint32_t tile_height) const;
+
+  virtual void draw_primitives(const std::list<Primitive>& list) override;
+  // Draws a single entry of a primitive list, layers look ahead up to `end`
+  // for their bounds. Open layers are left to the caller to end.
+  void draw_list_entry(std::list<Primitive>::const_iterator it,
+                       std::list<Primitive>::const_iterator end);
 
   virtual void draw_primitive(const Line& l) override;
   virtual void draw_primitive(const Circle& c) override;
   virtual void draw_primitive(const Triangle& p) override;
+  virtual void draw_primitive(const Polygon& p) override;
+  virtual void draw_primitive(const Polyline& p) override;
+  virtual void draw_primitive(const Bezier& b) override;
+  virtual void draw_primitive(const Text& t) override;
+  virtual void draw_primitive(const Image& i) override;
+
+  // Primitives spanning fewer pixels than this are splatted, see
+  // set_lod_threshold().
+  float lod_threshold = 0.0f;
+  // Splats `p` if it is a line, circle or triangle below the LOD threshold.
+  bool draw_lod_splat(const Primitive& p);
+  // Blends `color` with its alpha scaled by `area` over the 2x2 pixels
+  // around `center`, weighted bilinearly.
+  void draw_splat(Vec2 center, float area, Rgba color);
+  // Fetches the pixels a splat of `p` would blend into the cache.
+  void prefetch_splat(const Primitive& p);
+  static constexpr size_t SPLAT_PREFETCH = 16;
+
+  GlyphCache glyphs;
+
+  // Unique per canvas, so texture caches can tell sources apart even when
+  // one is allocated where another was freed.
+  uint64_t image_id;
+  uint64_t revision = 0;
+  // The changed rect of each of the latest revisions, oldest first.
+  std::vector<std::pair<uint64_t, PixelRect>> damage;
+  static constexpr size_t MAX_DAMAGE_HISTORY = 16;
+
+  // Pixels hold linear light and colors are converted on the way in, see
+  // set_linear_blending().
+  bool linear_blending = false;
+  // Blend mode of the primitive being drawn. Layer contents always blend
+  // over each other, and layers over the canvas.
+  BlendMode draw_blend = BlendMode::OVER;
+  // A color as the pixels store it.
+  Rgba to_storage(const Rgba& color) const;
 
   Viewport pixel_viewport() const;
-  void draw_pixel_line(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2,
+  // Scanline fill of contours given in pixel coordinates, sampled at pixel
+  // centers so every covered pixel is blended exactly once.
+  void fill_polygon(const std::vector<std::vector<Vec2>>& contours,
+                    FillRule rule, Rgba color);
+  // Blends `color` into the pixels [x0, x1) of row y under `draw_blend`,
+  // with the kernel picked once for the whole span.
+  virtual void blend_span(uint32_t y, uint32_t x0, uint32_t x1, Rgba color);
+  // The line rasterizer takes signed coordinates and skips the pixels
+  // outside of `clip`, so lines can start off canvas.
+  void draw_pixel_line(int64_t x1, int64_t y1, int64_t x2, int64_t y2,
                        Rgba color);
 
-  bool draw_pixel_line_step(uint32_t& x1, uint32_t& y1, uint32_t x2,
-                            uint32_t y2, int64_t dx, int64_t dy, int64_t sx,
-                            int64_t sy, int64_t& error, Rgba color);
-
-  void draw_pixel_triangle(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2,
-                           uint32_t x3, uint32_t y3, Rgba color);
-  void draw_flat_top_pixel_triangle(uint32_t left_x, uint32_t right_x,
-                                    uint32_t top_y, uint32_t bottom_x,
-                                    uint32_t bottom_y, Rgba color);
-  void draw_flat_bottom_pixel_triangle(uint32_t left_x, uint32_t right_x,
-                                       uint32_t bottom_y, uint32_t top_x,
-                                       uint32_t top_y, Rgba color);
+  bool draw_pixel_line_step(int64_t& x1, int64_t& y1, int64_t x2, int64_t y2,
+                            int64_t dx, int64_t dy, int64_t sx, int64_t sy,
+                            int64_t& error, Rgba color);
 
  public:
   FrameBufferCanvas() = delete;
   FrameBufferCanvas(uint32_t width, uint32_t height, Viewport viewport);
   virtual ~FrameBufferCanvas(){};
 
+  virtual void set_viewport(Viewport new_viewport) override;
+  virtual std::optional<Transform2D> pixel_transform() const override;
+
+  uint32_t get_width() const;
+  uint32_t get_height() const;
+
+  // Direct access to a row of `width` pixels, if the canvas stores them as
+  // contiguous Rgba.
+  virtual Rgba* pixel_row(uint32_t y);
+
+  // The color at a point in the encoding colors are given in, while
+  // get_pixel() and set_pixel() use the stored values.
   virtual std::optional<Rgba> sample(float x, float y) const;
   virtual void blend_pixel(uint32_t x, uint32_t y, Rgba color);
   virtual Rgba get_pixel(uint32_t x, uint32_t y) const = 0;
   virtual void set_pixel(uint32_t x, uint32_t y, Rgba color) = 0;
 
+  // Colors are given in sRGB. With linear blending they are converted to
+  // linear light through tables before blending, so translucent overlaps
+  // mix the way light does, and encoded back to sRGB on output. Layer
+  // contents still blend among themselves in sRGB before compositing.
+  virtual void set_linear_blending(bool enabled);
+  bool is_linear_blending() const;
+
+  // Lines, circles and triangles whose extent on the canvas is below
+  // `pixels` skip rasterization and are blended as coverage weighted point
+  // splats instead, with alpha scaled by their area. Dense scatter plots
+  // look the same at a fraction of the cost. 0 disables it.
+  void set_lod_threshold(float pixels);
+  float get_lod_threshold() const;
+
   virtual void floodfill(uint32_t x, uint32_t y, Rgba color);
   virtual void floodfill(float x, float y, Rgba color);
 
   virtual void blit_canvas(const FrameBufferCanvas& other, Viewport location);
+
+  // Primitives added between push_layer and pop_layer are drawn into an
+  // offscreen layer covering only their bounds, which is then composited
+  // with `opacity`.
+  virtual void push_layer(float opacity, std::optional<Viewport> clip = {});
+  virtual void pop_layer();
+
+  virtual void update() override;
+  // Counters of the last update(), all zero unless built with CANVAS_STATS.
+  const RasterStats& get_stats() const;
+
+  // Identifies the canvas as an image source for the lifetime of the process.
+  uint64_t get_image_id() const;
+  // Bumped by every change to the pixels. damage_since() is the rect that
+  // changed after `since`, the whole canvas once `since` is too old to tell.
+  uint64_t get_revision() const;
+  PixelRect damage_since(uint64_t since) const;
+  // Records a change the canvas cannot see itself, such as writes through
+  // set_pixel() or pixel_row(). Without a rect the whole canvas changed.
+  void mark_damaged(PixelRect rect);
+  void mark_damaged();
 };
 
+// 24 bit BMP encoding shared by the BMP canvases. Rows are written bottom
+// up, starting with y = 0.
+void write_bmp_header(std::ostream& out, uint32_t width, uint32_t height);
+// Rows of linear light are encoded to sRGB.
+void write_bmp_row(std::ostream& out, const Rgba* row, uint32_t width,
+                   std::vector<uint8_t>& scratch, bool linear);
+// `rect` of `source` as RGBA8 rows from the bottom, `stride` bytes apart,
+// linear light encoded to sRGB like the BMP output.
+void encode_rgba8(const FrameBufferCanvas& source, PixelRect rect,
+                  uint8_t* out, size_t stride);
+
+// Where the pixels of an uncompressed 24 or 32 bit BMP file are.
+struct BmpLayout {
+  uint32_t width = 0, height = 0;
+  uint32_t bytes_per_pixel = 3;
+  size_t data_offset = 0, row_stride = 0;
+  // Rows are stored from the top, otherwise starting with y = 0.
+  bool top_down = false;
+  // 32 bit pixels with an alpha mask, all others are opaque.
+  bool has_alpha = false;
+};
+// Throws std::runtime_error unless `data` starts with such a file.
+BmpLayout read_bmp_layout(const uint8_t* data, size_t size);
+// Converts `width` stored BGR or BGRA pixels to Rgba.
+void convert_bmp_row(const uint8_t* src, Rgba* dst, uint32_t width,
+                     const BmpLayout& layout);
+
 class BmpCanvas : public FrameBufferCanvas {
  protected:
   std::string file_path;
+  Rgba background_color;
   std::vector<Rgba> pixels;
+  // Second buffer, owned by the write started by display_async() until
+  // `pending_write` completes.
+  std::vector<Rgba> spare_pixels;
+  std::shared_future<void> pending_write;
+
+  // Throws std::runtime_error when the file cannot be written. Takes the
+  // size and encoding by value so display_async() can run it on a worker
+  // thread without touching the canvas.
+  static void write_file(const std::string& path,
+                         const std::vector<Rgba>& image, uint32_t width,
+                         uint32_t height, bool linear_blending);
 
  public:
   BmpCanvas() = delete;
   BmpCanvas(uint32_t width, uint32_t height, const std::string& file_path,
             Viewport viewport, Rgba background_color);
-  virtual ~BmpCanvas() {}
+  virtual ~BmpCanvas();
+
+  virtual void set_pixel(uint32_t x, uint32_t y, Rgba color) override;
+  virtual Rgba get_pixel(uint32_t x, uint32_t y) const override;
+  virtual Rgba* pixel_row(uint32_t y) override;
+  // Converts the current pixels as well.
+  virtual void set_linear_blending(bool enabled) override;
+
+  // A canvas with the size and pixels of the BMP file at `path`, writing to
+  // `file_path`. Throws std::runtime_error if it cannot be read.
+  static std::unique_ptr<BmpCanvas> load(const std::string& path,
+                                         const std::string& file_path,
+                                         Viewport viewport,
+                                         Rgba background_color = WHITE);
+
+  virtual void set_file_path(const std::string& new_path);
+  virtual void display() override;
+  // Swaps the pixels into a second buffer that a writer thread encodes, and
+  // continues with a canvas filled with the background color. Waits for the
+  // previous asynchronous write first, errors are thrown from the returned
+  // future instead of exiting.
+  virtual std::shared_future<void> display_async();
+};
+
+// Read only view of a BMP file mapped into memory, as a source for
+// blit_canvas(), sample() and images. Pixels are decoded from the mapping
+// as they are read, so opening even a huge file only costs the page faults
+// of the parts used. Drawing and set_pixel() leave it unchanged.
+class MappedBmpCanvas : public FrameBufferCanvas {
+ protected:
+  void* mapping = nullptr;
+  size_t mapping_size = 0;
+  BmpLayout layout;
+
+  struct Mapping {
+    void* data;
+    size_t size;
+    BmpLayout layout;
+  };
+  // Throws std::runtime_error, like the public constructor.
+  static Mapping map_file(const std::string& path);
+  MappedBmpCanvas(Mapping m, Viewport viewport);
+
+ public:
+  MappedBmpCanvas() = delete;
+  // Throws std::runtime_error if the file is not a 24 or 32 bit
+  // uncompressed BMP.
+  MappedBmpCanvas(const std::string& path, Viewport viewport);
+  MappedBmpCanvas(const MappedBmpCanvas&) = delete;
+  MappedBmpCanvas& operator=(const MappedBmpCanvas&) = delete;
+  virtual ~MappedBmpCanvas();
+
+  virtual void set_pixel(uint32_t x, uint32_t y, Rgba color) override;
+  virtual Rgba get_pixel(uint32_t x, uint32_t y) const override;
+  virtual void display() override;
+
+  const BmpLayout& get_layout() const;
+  // The stored pixels of row y, in the file's format.
+  const uint8_t* stored_row(uint32_t y) const;
+};
+
+// Renders the scene in horizontal bands of `band_height` rows and streams
+// every finished band to the BMP file, so only width * band_height pixels
+// are held in memory. Primitives are binned per band, and drawing happens in
+// display(). Immediate operations such as floodfill, blit_canvas and sample
+// need the whole image, they report an error and do nothing.
+class BandedBmpCanvas : public FrameBufferCanvas {
+ protected:
+  std::string file_path;
+  Rgba background_color;
+  uint32_t band_height;
+  // Rows [band_y0, band_y0 + band_height) of the image.
+  uint32_t band_y0 = 0;
+  std::vector<Rgba> band;
+  bool in_band(uint32_t y) const;
+
+ public:
+  BandedBmpCanvas() = delete;
+  BandedBmpCanvas(uint32_t width, uint32_t height, uint32_t band_height,
+                  const std::string& file_path, Viewport viewport,
+                  Rgba background_color);
+  virtual ~BandedBmpCanvas() {}
+
+  // Pixels only exist within the band being rendered. Elsewhere writes are
+  // dropped, reads give the background and there is no row.
+  virtual void set_pixel(uint32_t x, uint32_t y, Rgba color) override;
+  virtual Rgba get_pixel(uint32_t x, uint32_t y) const override;
+  virtual Rgba* pixel_row(uint32_t y) override;
+
+  virtual std::optional<Rgba> sample(float x, float y) const override;
+  virtual void floodfill(uint32_t x, uint32_t y, Rgba color) override;
+  virtual void floodfill(float x, float y, Rgba color) override;
+  virtual void blit_canvas(const FrameBufferCanvas& other,
+                           Viewport location) override;
+
+  virtual void set_file_path(const std::string& new_path);
+  virtual void set_band_height(uint32_t rows);
+
+  // Drawing happens band by band in display().
+  virtual void update() override;
+  virtual void display() override;
+};
+
+enum class SequenceFormat {
+  // YUV4MPEG2 stream with 4:4:4 BT.601 studio range frames.
+  Y4M,
+  // Headerless top-down RGB24 frames, e.g. for ffmpeg -f rawvideo.
+  RAW_RGB,
+  // One BMP file per frame, `path` is a printf pattern such as
+  // "frame_%05d.bmp".
+  BMP_FILES,
+};
+
+// Renders the scene in forked worker processes, which split the image into
+// tiles of `tile_size` pixels and take them one at a time. The pixels live in
+// a memfd mapping shared with the workers, and the scene reaches them as a
+// display list in a second memfd. The parent writes the BMP file once every
+// worker is done, identical to the one BmpCanvas writes for the same scene.
+// Like BandedBmpCanvas, drawing happens in display(). Because of fork(), no
+// other thread may hold a lock the workers need while display() runs.
+class MultiProcessBmpCanvas : public FrameBufferCanvas {
+ protected:
+  std::string file_path;
+  Rgba background_color;
+  uint32_t tile_size;
+  uint32_t workers;
+  int pixels_fd = -1;
+  Rgba* pixels = nullptr;
+  // Only workers draw, everything else would be painted over by the tiles.
+  bool in_worker = false;
+
+  // Body of a worker process, never returns.
+  [[noreturn]] void render_tiles(int scene_fd,
+                                 std::atomic<uint32_t>& next_tile);
 
+ public:
+  MultiProcessBmpCanvas() = delete;
+  MultiProcessBmpCanvas(const MultiProcessBmpCanvas&) = delete;
+  MultiProcessBmpCanvas(uint32_t width, uint32_t height, uint32_t tile_size,
+                        uint32_t workers, const std::string& file_path,
+                        Viewport viewport, Rgba background_color);
+  virtual ~MultiProcessBmpCanvas();
+
+  // Pixels hold the last display(). Writes outside of the workers are
+  // dropped, and floodfill and blit_canvas report an error and do nothing,
+  // as every tile starts from the background.
   virtual void set_pixel(uint32_t x, uint32_t y, Rgba color) override;
   virtual Rgba get_pixel(uint32_t x, uint32_t y) const override;
+  virtual Rgba* pixel_row(uint32_t y) override;
+
+  virtual void floodfill(uint32_t x, uint32_t y, Rgba color) override;
+  virtual void floodfill(float x, float y, Rgba color) override;
+  virtual void blit_canvas(const FrameBufferCanvas& other,
+                           Viewport location) override;
 
   virtual void set_file_path(const std::string& new_path);
+
+  virtual void update() override;
+  virtual void display() override;
+};
+
+// Writes every display()ed frame to an image sequence. Streams go to a file,
+// a named pipe or stdout when `path` is "-". A background thread encodes the
+// frames, so drawing the next frame overlaps writing the previous one.
+// Frames travel through a bounded pool of recycled buffers, display() only
+// waits when all of them are queued for encoding.
+class FrameSequenceCanvas : public BmpCanvas {
+ protected:
+  SequenceFormat format;
+  uint32_t frame_rate;
+  std::ofstream file;
+  std::ostream* out = nullptr;
+
+  std::thread encoder;
+  std::mutex queue_mutex;
+  std::condition_variable queue_changed;
+  // Frame buffers move between these lists by splicing, so a running
+  // sequence does not allocate.
+  std::list<std::vector<Rgba>> pending, recycled;
+  size_t buffers_allocated = 0, max_buffers;
+  bool finishing = false;
+
+  void encode_loop();
+  void encode(const std::vector<Rgba>& frame, uint64_t index,
+              std::vector<uint8_t>& scratch);
+
+ public:
+  FrameSequenceCanvas() = delete;
+  FrameSequenceCanvas(uint32_t width, uint32_t height, const std::string& path,
+                      SequenceFormat format, Viewport viewport,
+                      Rgba background_color, uint32_t frame_rate = 30,
+                      size_t max_queued_frames = 2);
+  virtual ~FrameSequenceCanvas();
+
+  // Queues the current frame and starts the next one from the background
+  // color.
   virtual void display() override;
+  // Waits until every queued frame is written and closes the output.
+  virtual void finish();
+};
+
+enum class DensityScale {
+  LINEAR,
+  // log(1 + bin) relative to the largest bin, so sparse regions stay visible
+  // next to dense ones.
+  LOG,
+  // Histogram equalized, by the fraction of non-empty bins at or below a
+  // bin, so every color covers about as many pixels.
+  EQUALIZED,
+};
+
+// Counts points per pixel instead of drawing them, for point clouds too
+// dense to overplot. Batches of points are split over `threads` threads,
+// each counting into its own partial bins that are summed up after the
+// batch, so the hot loop never synchronizes. Batches can be streamed in
+// without bound, only the bins are kept.
+//
+// update() maps the bins through the colormap into the pixels, with empty
+// bins left at the background color, and then draws the primitives on top,
+// e.g. axes and labels. Bins stay at their pixels when the viewport changes.
+class DensityCanvas : public BmpCanvas {
+ protected:
+  // Sums of all batches so far, bottom row first. Unweighted batches count
+  // into integer partial bins and weighted ones into double partial bins.
+  std::vector<double> bins;
+  std::vector<std::vector<uint32_t>> partial_counts;
+  std::vector<std::vector<double>> partial_sums;
+  uint32_t threads;
+  std::vector<Rgba> colormap;
+  DensityScale scale = DensityScale::LOG;
+
+  // The colormap color for a bin, given the scale factors of the bins.
+  Rgba map_bin(double bin, double max,
+               const std::vector<double>& sorted) const;
+  void add_batch(const Vec2* points, const float* weights, size_t count);
+
+ public:
+  // Five stops of viridis, from sparse to dense.
+  static const std::vector<Rgba> DEFAULT_COLORMAP;
+
+  DensityCanvas() = delete;
+  DensityCanvas(uint32_t width, uint32_t height, const std::string& file_path,
+                Viewport viewport, Rgba background_color,
+                uint32_t threads = std::thread::hardware_concurrency());
+
+  // Adds 1, or the matching weight, to the bin of the pixel every point
+  // falls on, the one sample() reads there. Points off the canvas are
+  // skipped.
+  void add_points(const std::vector<Vec2>& points);
+  void add_points(const std::vector<Vec2>& points,
+                  const std::vector<float>& weights);
+  void add_points(const Vec2* points, const float* weights, size_t count);
+  void clear_bins();
+  double get_bin(uint32_t x, uint32_t y) const;
+
+  // Evenly spaced stops, interpolated in between. The densest bin gets the
+  // last color.
+  void set_colormap(const std::vector<Rgba>& stops);
+  void set_scale(DensityScale new_scale);
+  void set_threads(uint32_t count);
+
+  virtual void update() override;
 };
 
 class WindowHandler;
 
+enum class RedrawMode { CONTINUOUS, ON_DEMAND };
+
 class WindowCanvas : public Canvas {
+ protected:
+  // Pixels of an image source at one revision, as RGBA8 rows from the
+  // bottom. Taken on the handler thread when a scene is published and never
+  // changed afterwards, so the render thread does not read a source the
+  // handler may be drawing into.
+  struct ImageSnapshot {
+    uint32_t width = 0, height = 0;
+    uint64_t revision = 0;
+    std::vector<uint8_t> pixels;
+    // The rects read again for each of the latest snapshots of the source,
+    // oldest first, covering every change after `damage_base`.
+    std::vector<std::pair<uint64_t, PixelRect>> damage;
+    uint64_t damage_base = 0;
+    static constexpr size_t MAX_DAMAGE_HISTORY = 16;
+
+    // The rect that changed after revision `since`, the whole image once
+    // `since` is too old to tell.
+    PixelRect damage_since(uint64_t since) const;
+  };
+
  private:
-  bool quit = false;
+  struct SceneSnapshot {
+    // Only copied again when `static_version` changed.
+    std::list<Primitive> static_primitives, primitives;
+    uint64_t static_version = 0;
+    Viewport viewport;
+    // By image id, for every image in the scene.
+    std::unordered_map<uint64_t, std::shared_ptr<const ImageSnapshot>> images;
+  };
+
+  std::atomic<bool> quit{false};
+
+  std::atomic<RedrawMode> redraw_mode{RedrawMode::CONTINUOUS};
+  std::atomic<bool> redraw_requested{true};
+  std::atomic<float> max_frame_rate{0.0f};
+  std::atomic<double> idle_timeout{0.0};
+  uint64_t drawn_version = 0;
+
+  // Threaded mode: the handler thread owns `primitives` and `viewport` and
+  // publishes copies of them through a triple buffer. The render thread only
+  // ever draws `front`.
+  std::thread handler_thread;
+  std::atomic<bool> handler_running{false};
+  std::mutex scene_mutex;
+  std::condition_variable handler_wakeup;
+  SceneSnapshot back, ready, front;
+  bool ready_fresh = false;
+  uint64_t published_version = 0;
+  std::list<Event> handler_events;
+  uint64_t frame_counter = 0;
+  // Image sources of the last published scene and their revisions then.
+  std::vector<std::pair<const FrameBufferCanvas*, uint64_t>> published_images;
+  // The latest snapshot of every image source in the scene, by image id.
+  std::unordered_map<uint64_t, std::shared_ptr<const ImageSnapshot>>
+      image_snapshots;
+
+  void handler_loop();
+  void publish_scene();
+  // Brings the image snapshots of `back` up to date with their sources.
+  void snapshot_images();
+  void acquire_scene();
 
  protected:
   std::shared_ptr<WindowHandler> handler;
   virtual std::optional<Event> next_event() = 0;
 
+  // Window size as of the last WindowResizeEvent passed to handle_event(),
+  // owned by the same thread as `primitives`.
+  uint32_t event_width = 0, event_height = 0;
+
+  // Called on the render thread before the scene is drawn, with the viewport
+  // the scene was produced for.
+  virtual void begin_frame(const Viewport& frame_viewport) {}
+  // Called from the handler thread when a new scene has been published.
+  virtual void wake() {}
+  // The pixels to draw an image source from in the scene being rendered,
+  // nullptr unless threaded.
+  const ImageSnapshot* image_snapshot(uint64_t image_id) const;
+  // Draws the static layer [static_begin, static_end), which is unchanged
+  // for as long as `static_version` is, and then the dynamic primitives.
+  virtual void draw_scene(std::list<Primitive>::const_iterator static_begin,
+                          std::list<Primitive>::const_iterator static_end,
+                          std::list<Primitive>::const_iterator dynamic_begin,
+                          std::list<Primitive>::const_iterator dynamic_end,
+                          uint64_t static_version);
+
+  void render();
+  void process_events();
+  // Passes `e` on to the handler, after taking the new size of a resized
+  // window and decimating again. Runs on the thread owning `primitives`.
+  void handle_event(const Event& e);
+  // True when the scene, the viewport or the window changed since the last
+  // render(), or a redraw was requested.
+  bool needs_redraw();
+
  public:
   WindowCanvas() = delete;
   WindowCanvas(std::shared_ptr<WindowHandler>&& handler, Viewport viewport);
-  virtual ~WindowCanvas() {}
+  virtual ~WindowCanvas();
+
+  // Runs the handler on its own thread. While enabled, add_*, clear and
+  // set_viewport must only be called from the handler, and image sources
+  // only drawn into from it. Images show their sources as of the end of the
+  // handler's last on_update.
+  virtual void set_threaded(bool enabled);
+  bool is_threaded() const;
+
+  // In ON_DEMAND mode display() sleeps until something needs redrawing
+  // instead of redrawing on every vsync.
+  virtual void set_redraw_mode(RedrawMode mode);
+  RedrawMode get_redraw_mode() const;
+  // Safe to call from any thread.
+  virtual void request_redraw();
+  // Upper bound on redraws per second in ON_DEMAND mode, 0 for no cap.
+  virtual void set_max_frame_rate(float fps);
+  float get_max_frame_rate() const;
+  // How long an idle ON_DEMAND loop sleeps before calling on_update again,
+  // 0 to sleep until the next event.
+  virtual void set_idle_timeout(double seconds);
+  double get_idle_timeout() const;
 
   virtual void stop();
   bool has_quit() const;
@@ -191,26 +962,115 @@ class GLFWCanvas : public WindowCanvas {
   GLFWwindow* window;
   virtual std::optional<Event> next_event() override;
 
+  // Consecutive circles, thick lines or text are collected and drawn as one
+  // instanced draw call.
+  virtual void draw_primitives(const std::list<Primitive>& list) override;
+  void draw_range(std::list<Primitive>::const_iterator begin,
+                  std::list<Primitive>::const_iterator end);
+  void flush_instances();
+  // The blend mode the GL blend state is set up for, OVER outside of
+  // draw_range(). Fixed function blending takes the alpha of MULTIPLY, MAX
+  // and MIN colors as fully covered.
+  BlendMode gl_blend = BlendMode::OVER;
+  void set_gl_blend(BlendMode mode);
+  virtual void draw_scene(std::list<Primitive>::const_iterator static_begin,
+                          std::list<Primitive>::const_iterator static_end,
+                          std::list<Primitive>::const_iterator dynamic_begin,
+                          std::list<Primitive>::const_iterator dynamic_end,
+                          uint64_t static_version) override;
+
   virtual void draw_primitive(const Line& l) override;
   virtual void draw_primitive(const Circle& c) override;
   virtual void draw_primitive(const Triangle& p) override;
+  virtual void draw_primitive(const Polygon& p) override;
+  virtual void draw_primitive(const Polyline& p) override;
+  virtual void draw_primitive(const Bezier& b) override;
+  virtual void draw_primitive(const Text& t) override;
+  virtual void draw_primitive(const Image& i) override;
+
+  // Stencil-then-cover fill of arbitrary contours in world coordinates.
+  void fill_stencil(const std::vector<std::vector<Vec2>>& contours,
+                    FillRule rule, Rgba color);
+  float pixels_per_unit() const;
+
+  virtual void begin_frame(const Viewport& frame_viewport) override;
+  virtual void wake() override;
 
   virtual void set_event_callbacks();
-  virtual uint32_t load_shader(const char* vert_source,
-                               const char* geometry_source,
-                               const char* frag_source);
+
+  // A program being linked from source or loaded from the program cache.
+  // Nothing waits for the driver until finish_program(), so with parallel
+  // shader compilation all programs started before it build at once.
+  struct PendingProgram {
+    uint32_t id = 0;
+    const char *vert_source = nullptr, *geometry_source = nullptr,
+               *frag_source = nullptr;
+    // Empty when the binary is not cached.
+    std::string cache_path;
+    bool from_cache = false;
+  };
+  virtual PendingProgram start_program(const char* vert_source,
+                                       const char* geometry_source,
+                                       const char* frag_source);
+  // Reports link errors, stores a freshly linked binary in the cache and
+  // makes the program current.
+  virtual uint32_t finish_program(PendingProgram& program);
+  // Vendor, renderer and version, part of every program cache key.
+  std::string driver_id;
+  // Binary formats the driver loads, none when it cannot cache programs.
+  std::vector<int> program_binary_formats;
 
   std::list<Event> event_queue;
 
   std::array<float, 16> mvp = {0};
   uint32_t width, height;
+  // The viewport of the frame being drawn.
+  Viewport frame_viewport;
+
+  // The static layer is drawn into a multisampled framebuffer and resolved
+  // into `static_texture` when its version or the window size changes, and
+  // every frame starts from one quad of that texture.
+  uint32_t static_msaa_fbo = 0, static_color_rb = 0, static_stencil_rb = 0;
+  uint32_t static_fbo = 0, static_texture = 0;
+  uint32_t static_width = 0, static_height = 0;
+  std::optional<uint64_t> static_drawn_version;
+  static constexpr int STATIC_LAYER_SAMPLES = 4;
+
+  // (Re)allocates the static layer at the window size.
+  void resize_static_layer();
 
   static constexpr size_t TRIANGLE = 0, THICK_LINE = 1, THIN_LINE = 2,
-                          CIRCLE = 3;
+                          CIRCLE = 3, TEXT = 4, IMAGE = 5;
+
+  std::array<uint32_t, 6> shaders = {0}, vaos = {0}, vbos = {0};
 
-  std::array<uint32_t, 4> shaders = {0}, vaos = {0}, vbos = {0};
+  std::array<int, 6> umvps = {0}, ucolors = {0}, uviewport_sizes = {0};
 
-  std::array<int, 4> umvps = {0}, ucolors = {0};
+  // Unit quad expanded per instance by the circle and thick line programs.
+  uint32_t quad_vbo = 0;
+  // Pending instances: center, radius and color for circles, endpoints,
+  // thickness and color for thick lines, origin, size, position and color of
+  // every glyph for text.
+  std::vector<float> circle_instances, line_instances, text_instances;
+  // Single channel coverage of the embedded font, one cell per character.
+  uint32_t glyph_atlas = 0;
+
+  // Textures of image sources by image id. A texture is only re-uploaded
+  // where its source changed since `revision`, and deleted after the frame
+  // in which the source is found gone.
+  struct ImageTexture {
+    std::weak_ptr<FrameBufferCanvas> source;
+    uint32_t texture = 0, width = 0, height = 0;
+    uint64_t revision = 0;
+  };
+  std::unordered_map<uint64_t, ImageTexture> image_textures;
+  std::vector<uint8_t> upload_buffer;
+
+  // Uploads `rect` of the source as RGBA8 into the bound texture.
+  void upload_image(const FrameBufferCanvas& source, PixelRect rect);
+  // The same from RGBA8 pixels `width` to a row, such as a snapshot.
+  void upload_pixels(const uint8_t* pixels, uint32_t width, PixelRect rect);
+  void evict_image_textures();
 
  public:
   GLFWCanvas() = delete;
@@ -218,7 +1078,16 @@ class GLFWCanvas : public WindowCanvas {
              std::shared_ptr<WindowHandler>&& handler, Viewport viewport);
   virtual ~GLFWCanvas();
 
-  virtual void set_viewport(Viewport new_viewport) override;
+  // Window pixels, as of the last resize the handler was told about.
+  virtual std::optional<Transform2D> pixel_transform() const override;
+
+  // Linked programs are cached in `dir` as driver binaries, keyed by the GL
+  // vendor, renderer, version and the shader sources, so later processes
+  // skip compiling them. Defaults to $XDG_CACHE_HOME/canvas or
+  // ~/.cache/canvas, an empty path disables the cache. Canvases created
+  // afterwards use the new directory.
+  static void set_program_cache_dir(const std::string& dir);
+  static std::string get_program_cache_dir();
 
   virtual void display() override;
 };
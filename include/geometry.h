@@ -1,9 +1,14 @@
 #ifndef __CANVAS_GEOMETRY_H
 #define __CANVAS_GEOMETRY_H
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <string>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -12,20 +17,28 @@ namespace Canvas {
 class Vec2 {
  public:
   float x = 0.0f, y = 0.0f;
-  Vec2(float x, float y);
-  explicit Vec2(float t);
-  virtual ~Vec2(){};
+  constexpr Vec2(float x, float y) : x(x), y(y) {}
+  constexpr explicit Vec2(float t) : x(t), y(t) {}
 
-  Vec2 operator+(const Vec2& other) const;
-  Vec2 operator-(const Vec2& other) const;
-  Vec2 operator*(float t) const;
-  Vec2 operator/(float t) const;
+  constexpr Vec2 operator+(const Vec2& other) const {
+    return Vec2(x + other.x, y + other.y);
+  }
+  constexpr Vec2 operator-(const Vec2& other) const {
+    return Vec2(x - other.x, y - other.y);
+  }
+  constexpr Vec2 operator*(float t) const { return Vec2(x * t, y * t); }
+  constexpr Vec2 operator/(float t) const { return Vec2(x / t, y / t); }
 
-  static float dot(const Vec2& a, const Vec2& b);
-  float len_squared() const;
+  static constexpr float dot(const Vec2& a, const Vec2& b) {
+    return a.x * b.x + a.y * b.y;
+  }
+  constexpr float len_squared() const { return Vec2::dot(*this, *this); }
   float len() const;
   Vec2 normalize() const;
 };
+static_assert(std::is_trivially_copyable_v<Vec2>);
+static_assert(sizeof(Vec2) == 2 * sizeof(float));
+
 std::ostream& operator<<(std::ostream& out, const Vec2& v);
 
 struct Rgba {
@@ -45,6 +58,37 @@ static constexpr Rgba PURPLE = {1.0, 0.0, 1.0, 1.0};
 static constexpr Rgba CYAN = {0.0, 1.0, 1.0, 1.0};
 static constexpr Rgba GRAY = {0.5, 0.5, 0.5, 1.0};
 
+// sRGB transfer function as tables: 8 bit sRGB to 12 bit linear light, and
+// 12 bit linear light back to 8 bit sRGB.
+extern const std::array<uint16_t, 256> SRGB8_TO_LINEAR12;
+extern const std::array<uint8_t, 4096> LINEAR12_TO_SRGB8;
+
+inline float srgb_to_linear(float v) {
+  return SRGB8_TO_LINEAR12[uint32_t(std::clamp(v, 0.0f, 1.0f) * 255.0f +
+                                    0.5f)] *
+         (1.0f / 4095.0f);
+}
+inline uint8_t linear_to_srgb8(float v) {
+  return LINEAR12_TO_SRGB8[uint32_t(std::clamp(v, 0.0f, 1.0f) * 4095.0f +
+                                    0.5f)];
+}
+inline float linear_to_srgb(float v) {
+  return linear_to_srgb8(v) * (1.0f / 255.0f);
+}
+// Alpha is coverage and stays as it is.
+inline Rgba srgb_to_linear(const Rgba& c) {
+  return Rgba{.r = srgb_to_linear(c.r),
+              .g = srgb_to_linear(c.g),
+              .b = srgb_to_linear(c.b),
+              .a = c.a};
+}
+inline Rgba linear_to_srgb(const Rgba& c) {
+  return Rgba{.r = linear_to_srgb(c.r),
+              .g = linear_to_srgb(c.g),
+              .b = linear_to_srgb(c.b),
+              .a = c.a};
+}
+
 struct Viewport {
   float top = 0.0f, bottom = 0.0f, left = 0.0f, right = 0.0f;
   bool contains(const Vec2& pt);
@@ -53,23 +97,220 @@ struct Viewport {
   static float convert(const Viewport& from, const Viewport& to, float len);
 };
 
+// Half open rectangle of pixels [x0, x1) x [y0, y1).
+struct PixelRect {
+  int64_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+  constexpr bool empty() const { return x0 >= x1 || y0 >= y1; }
+  constexpr bool contains(int64_t x, int64_t y) const {
+    return x >= x0 && x < x1 && y >= y0 && y < y1;
+  }
+  constexpr uint64_t area() const {
+    return empty() ? 0 : uint64_t(x1 - x0) * uint64_t(y1 - y0);
+  }
+  constexpr PixelRect intersect(const PixelRect& o) const {
+    return PixelRect{.x0 = std::max(x0, o.x0),
+                     .y0 = std::max(y0, o.y0),
+                     .x1 = std::min(x1, o.x1),
+                     .y1 = std::min(y1, o.y1)};
+  }
+  constexpr PixelRect unite(const PixelRect& o) const {
+    if (empty()) return o;
+    if (o.empty()) return *this;
+    return PixelRect{.x0 = std::min(x0, o.x0),
+                     .y0 = std::min(y0, o.y0),
+                     .x1 = std::max(x1, o.x1),
+                     .y1 = std::max(y1, o.y1)};
+  }
+};
+
+// Axis aligned affine map pt * scale + offset, e.g. world to pixel space for
+// a fixed pair of viewports. Cheaper than Viewport::convert, which divides
+// for every point.
+struct Transform2D {
+  Vec2 scale = Vec2(1.0f), offset = Vec2(0.0f);
+
+  static Transform2D between(const Viewport& from, const Viewport& to);
+
+  constexpr Vec2 apply(Vec2 pt) const {
+    return Vec2(pt.x * scale.x + offset.x, pt.y * scale.y + offset.y);
+  }
+  constexpr float apply_length(float len) const {
+    return len * (scale.x + scale.y) * 0.5f;
+  }
+  // Maps `count` points at once, `in` and `out` may alias.
+  void apply(const Vec2* in, Vec2* out, size_t count) const;
+};
+
+// How a primitive combines with what is already drawn. OVER is the usual
+// alpha blending, REPLACE stores the color as it is, ADD sums light, MULTIPLY,
+// MAX and MIN are the separable blend modes of compositing specs, and ERASE
+// removes coverage by the alpha of the color.
+enum class BlendMode : uint8_t {
+  OVER,
+  REPLACE,
+  ADD,
+  MULTIPLY,
+  MAX,
+  MIN,
+  ERASE
+};
+
 struct Line {
   Vec2 start, end;
   Rgba color;
   float thickness;
+  BlendMode blend = BlendMode::OVER;
 };
 
 struct Circle {
   Vec2 origin;
   float radius;
   Rgba color;
+  BlendMode blend = BlendMode::OVER;
 };
 
 struct Triangle {
   std::array<Vec2, 3> points;
   Rgba color;
+  BlendMode blend = BlendMode::OVER;
+};
+
+// Starts a group that is composited with `opacity` when the matching PopLayer
+// is reached, optionally clipped to `clip`.
+struct PushLayer {
+  float opacity;
+  std::optional<Viewport> clip;
+};
+
+struct PopLayer {};
+
+enum class FillRule : uint8_t { NON_ZERO, EVEN_ODD };
+enum class LineJoin : uint8_t { ROUND, MITER, BEVEL };
+
+// A filled shape made of one or more closed contours, holes are contours
+// that cancel out under `rule`.
+struct Polygon {
+  std::vector<std::vector<Vec2>> contours;
+  Rgba color;
+  FillRule rule;
+  BlendMode blend = BlendMode::OVER;
+};
+
+// Connected line segments with round caps, stroked as a single shape so
+// overlapping segments and joins are only blended once.
+struct Polyline {
+  std::vector<Vec2> points;
+  Rgba color;
+  float thickness;
+  LineJoin join;
+  BlendMode blend = BlendMode::OVER;
+};
+
+// Quadratic (degree 2) or cubic (degree 3) Bezier curve, only the first
+// degree + 1 control points are used. Stroked like a Polyline.
+struct Bezier {
+  std::array<Vec2, 4> points;
+  uint32_t degree;
+  Rgba color;
+  float thickness;
+  BlendMode blend = BlendMode::OVER;
+};
+
+// Text in the embedded 5x7 font, '\n' starts a new line below. `origin` is
+// the bottom left corner of the first character cell and `size` the cell
+// height in world units. Text reads left to right and upright in the output
+// whatever the orientation of the viewport.
+struct Text {
+  std::string text;
+  Vec2 origin;
+  float size;
+  Rgba color;
+  BlendMode blend = BlendMode::OVER;
+};
+
+// Font cells are 6x8 font pixels, a 5x7 glyph and one pixel of spacing.
+static constexpr uint32_t TEXT_CELL_WIDTH = 6, TEXT_CELL_HEIGHT = 8;
+
+class FrameBufferCanvas;
+
+// The pixels of a canvas stretched over `location` in world units, mirrored
+// when the location is. The scene shares the source, which must not be drawn
+// into while a frame using it is drawn.
+struct Image {
+  std::shared_ptr<FrameBufferCanvas> source;
+  Viewport location;
+  BlendMode blend = BlendMode::OVER;
 };
 
+using Primitive = std::variant<Line, Circle, Triangle, PushLayer, PopLayer,
+                               Polygon, Polyline, Bezier, Text, Image>;
+
+// The blend mode of a drawable primitive, OVER for layer markers.
+BlendMode primitive_blend_mode(const Primitive& p);
+
+// `top` combined with `bottom` under mode M, both straight alpha.
+template <BlendMode M>
+inline Rgba blend_colors(const Rgba& top, const Rgba& bottom) {
+  float a = top.a, ba = bottom.a;
+  if constexpr (M == BlendMode::REPLACE) {
+    return top;
+  } else if constexpr (M == BlendMode::ERASE) {
+    return Rgba{bottom.r, bottom.g, bottom.b, ba * (1.0f - a)};
+  } else if constexpr (M == BlendMode::ADD) {
+    float out_a = std::min(a + ba, 1.0f);
+    if (out_a == 0.0f) return Rgba{0.0f, 0.0f, 0.0f, 0.0f};
+    auto sum = [&](float t, float b) {
+      return std::min((t * a + b * ba) / out_a, 1.0f);
+    };
+    return Rgba{sum(top.r, bottom.r), sum(top.g, bottom.g),
+                sum(top.b, bottom.b), out_a};
+  } else {
+    float out_a = a + ba * (1.0f - a);
+    if (out_a == 0.0f) return Rgba{0.0f, 0.0f, 0.0f, 0.0f};
+    // W3C separable blending: the mixed color where both are covered, each
+    // color alone where only it is.
+    auto mix = [&](float t, float b) {
+      float m = t;
+      if constexpr (M == BlendMode::MULTIPLY) m = t * b;
+      if constexpr (M == BlendMode::MAX) m = std::max(t, b);
+      if constexpr (M == BlendMode::MIN) m = std::min(t, b);
+      return (a * (1.0f - ba) * t + a * ba * m + (1.0f - a) * ba * b) / out_a;
+    };
+    return Rgba{mix(top.r, bottom.r), mix(top.g, bottom.g),
+                mix(top.b, bottom.b), out_a};
+  }
+}
+Rgba blend_colors(BlendMode mode, const Rgba& top, const Rgba& bottom);
+
+// Number of segments needed to approximate a circle of `radius_px` pixels to
+// within a quarter pixel.
+uint32_t circle_segments(float radius_px);
+// Outline of a thick polyline as counter clockwise contours, whose non-zero
+// union is the stroke. `thickness` is the distance from the center line, as
+// for Line.
+std::vector<std::vector<Vec2>> stroke_outline(const std::vector<Vec2>& points,
+                                              float thickness, LineJoin join,
+                                              uint32_t round_segments);
+// Number of segments keeping the flattened curve within `tolerance_px` of the
+// curve once it is scaled by `scale` pixels per unit (Wang's formula).
+uint32_t bezier_segments(const Bezier& b, Vec2 scale, float tolerance_px);
+// The `segments` + 1 points at evenly spaced t along the curve.
+std::vector<Vec2> flatten_bezier(const Bezier& b, uint32_t segments);
+
+// Whether x never decreases or never increases along the points.
+bool is_x_monotonic(const std::vector<Vec2>& points);
+// M4 decimation: the first, last, lowest and highest point of every pixel
+// column under `to_pixels`, in their original order. For x monotonic points
+// the polyline through them covers the same pixels as the full one.
+std::vector<Vec2> decimate_m4(const std::vector<Vec2>& points,
+                              const Transform2D& to_pixels);
+// Ramer-Douglas-Peucker simplification in pixel space, every dropped point
+// stays within `tolerance_px` of the simplified polyline.
+std::vector<Vec2> simplify_polyline(const std::vector<Vec2>& points,
+                                    const Transform2D& to_pixels,
+                                    float tolerance_px);
+
 }  // namespace Canvas
 
 #endif
@@ -0,0 +1,104 @@
+#include <fstream>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+BandedBmpCanvas::BandedBmpCanvas(uint32_t width, uint32_t height,
+                                 uint32_t band_height,
+                                 const std::string& file_path,
+                                 Viewport viewport, Rgba background_color)
+    : FrameBufferCanvas(width, height, viewport),
+      file_path(file_path),
+      background_color(background_color),
+      band_height(std::max(band_height, 1u)) {}
+
+bool BandedBmpCanvas::in_band(uint32_t y) const {
+  return y >= band_y0 && (size_t(y - band_y0) + 1) * width <= band.size();
+}
+
+void BandedBmpCanvas::set_pixel(uint32_t x, uint32_t y, Rgba color) {
+  if (!in_band(y)) return;
+  INDEX_SET(band, size_t(y - band_y0) * width + x, color);
+}
+Rgba BandedBmpCanvas::get_pixel(uint32_t x, uint32_t y) const {
+  if (!in_band(y)) return to_storage(background_color);
+  Rgba color;
+  INDEX_GET(color, band, size_t(y - band_y0) * width + x);
+  return color;
+}
+
+Rgba* BandedBmpCanvas::pixel_row(uint32_t y) {
+  if (!in_band(y)) return nullptr;
+  return band.data() + size_t(y - band_y0) * width;
+}
+
+std::optional<Rgba> BandedBmpCanvas::sample(float x, float y) const {
+  std::cerr << WHERE << " Not supported by BandedBmpCanvas\n";
+  return {};
+}
+void BandedBmpCanvas::floodfill(uint32_t x, uint32_t y, Rgba color) {
+  std::cerr << WHERE << " Not supported by BandedBmpCanvas\n";
+}
+void BandedBmpCanvas::floodfill(float x, float y, Rgba color) {
+  std::cerr << WHERE << " Not supported by BandedBmpCanvas\n";
+}
+void BandedBmpCanvas::blit_canvas(const FrameBufferCanvas& other,
+                                  Viewport location) {
+  std::cerr << WHERE << " Not supported by BandedBmpCanvas\n";
+}
+
+void BandedBmpCanvas::set_file_path(const std::string& new_path) {
+  file_path = new_path;
+}
+
+void BandedBmpCanvas::set_band_height(uint32_t rows) {
+  band_height = std::max(rows, 1u);
+}
+
+void BandedBmpCanvas::update() {}
+
+void BandedBmpCanvas::display() {
+  auto f = std::ofstream(file_path, std::ios::binary);
+  if (!f.is_open()) {
+    std::cerr << "Could not open file " << file_path << "\n";
+    exit(1);
+  }
+
+  STATS(stats = RasterStats{});
+  merge_submissions();
+  auto bins = bin_primitives(width, band_height);
+  std::vector<uint8_t> row;
+  write_bmp_header(f, width, height);
+
+  // y = 0 is the bottom row, so drawing the bands upwards produces them in
+  // the order the BMP stores them.
+  for (size_t b = 0; b < bins.size(); b++) {
+    band_y0 = b * band_height;
+    uint32_t rows = std::min(band_height, height - band_y0);
+    clip = PixelRect{.x0 = 0, .y0 = band_y0, .x1 = width, .y1 = band_y0 + rows};
+    band.assign(size_t(width) * rows, to_storage(background_color));
+
+    for (auto it : bins[b]) draw_list_entry(it, primitives.end());
+    while (layer_depth > 0) end_layer();
+
+    for (uint32_t y = 0; y < rows; y++) {
+      write_bmp_row(f, band.data() + size_t(y) * width, width, row,
+                    linear_blending);
+    }
+  }
+
+  band_y0 = 0;
+  clip = PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height};
+  band.clear();
+  band.shrink_to_fit();
+
+  if (!f) {
+    std::cerr << "Error writing to file " << file_path << "\n";
+    exit(1);
+  }
+
+  f.close();
+}
+
+}  // namespace Canvas
@@ -1,7 +1,13 @@
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
 
 #include "canvas.h"
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
 namespace Canvas {
 
 BmpCanvas::BmpCanvas(uint32_t width, uint32_t height,
@@ -9,79 +15,273 @@ BmpCanvas::BmpCanvas(uint32_t width, uint32_t height,
                      Rgba background_color)
     : FrameBufferCanvas(width, height, viewport),
       file_path(file_path),
-      pixels(width * height, background_color) {}
+      background_color(background_color),
+      pixels(size_t(width) * height, background_color) {}
+
+BmpCanvas::~BmpCanvas() {
+  if (pending_write.valid()) pending_write.wait();
+}
 
 void BmpCanvas::set_pixel(uint32_t x, uint32_t y, Rgba color) {
-  INDEX_SET(pixels, y * width + x, color);
+  INDEX_SET(pixels, size_t(y) * width + x, color);
 }
 Rgba BmpCanvas::get_pixel(uint32_t x, uint32_t y) const {
   Rgba color;
-  INDEX_GET(color, pixels, y * width + x);
+  INDEX_GET(color, pixels, size_t(y) * width + x);
   return color;
 }
 
+Rgba* BmpCanvas::pixel_row(uint32_t y) {
+  return pixels.data() + size_t(y) * width;
+}
+
+void BmpCanvas::set_linear_blending(bool enabled) {
+  if (enabled == linear_blending) return;
+  FrameBufferCanvas::set_linear_blending(enabled);
+  for (auto& px : pixels) {
+    px = enabled ? srgb_to_linear(px) : linear_to_srgb(px);
+  }
+  mark_damaged();
+}
+
 void BmpCanvas::set_file_path(const std::string& new_path) {
   file_path = new_path;
 }
 
-void BmpCanvas::display() {
-  uint32_t padding = (4 - ((width * 3) % 4)) % 4;
+void write_bmp_header(std::ostream& out, uint32_t width, uint32_t height) {
+  uint64_t row_size = (uint64_t(width) * 3 + 3) / 4 * 4;
+  uint64_t data_size = row_size * height;
   uint32_t header_size = 14;
   uint32_t info_header_size = 40;
-  uint32_t file_size =
-      header_size + info_header_size + height * padding + height * width * 3;
-  uint32_t zero = 0;
   uint32_t data_offset = header_size + info_header_size;
+  // The size field is only 32 bit, readers accept zero for larger files.
+  uint32_t file_size = data_offset + data_size <= UINT32_MAX
+                           ? uint32_t(data_offset + data_size)
+                           : 0;
+  uint32_t zero = 0;
   uint16_t planes = 1;
   uint16_t bits_per_pixel = 24;
   uint32_t used_colors = 16777216;
 
-  auto f = std::ofstream(file_path, std::ios::binary);
-  if (!f.is_open()) {
-    std::cerr << "Could not open file " << file_path << "\n";
-    exit(1);
+  out.write("BM", 2);
+  out.write((char*)&file_size, 4);
+  out.write((char*)&zero, 4);
+  out.write((char*)&data_offset, 4);
+
+  out.write((char*)&info_header_size, 4);
+  out.write((char*)&width, 4);
+  out.write((char*)&height, 4);
+  out.write((char*)&planes, 2);
+  out.write((char*)&bits_per_pixel, 2);
+  out.write((char*)&zero, 4);
+  out.write((char*)&zero, 4);
+  out.write((char*)&width, 4);
+  out.write((char*)&height, 4);
+  out.write((char*)&used_colors, 4);
+  out.write((char*)&zero, 4);
+}
+
+void write_bmp_row(std::ostream& out, const Rgba* row, uint32_t width,
+                   std::vector<uint8_t>& scratch, bool linear) {
+  scratch.assign((size_t(width) * 3 + 3) / 4 * 4, 0);
+  for (uint32_t x = 0; linear && x < width; x++) {
+    scratch[3 * size_t(x) + 0] = linear_to_srgb8(row[x].b);
+    scratch[3 * size_t(x) + 1] = linear_to_srgb8(row[x].g);
+    scratch[3 * size_t(x) + 2] = linear_to_srgb8(row[x].r);
   }
+  for (uint32_t x = 0; !linear && x < width; x++) {
+    scratch[3 * size_t(x) + 0] = row[x].b * 255.0;
+    scratch[3 * size_t(x) + 1] = row[x].g * 255.0;
+    scratch[3 * size_t(x) + 2] = row[x].r * 255.0;
+  }
+  out.write((char*)scratch.data(), scratch.size());
+}
 
-  f.write("BM", 2);
-  f.write((char*)&file_size, 4);
-  f.write((char*)&zero, 4);
-  f.write((char*)&data_offset, 4);
-
-  f.write((char*)&info_header_size, 4);
-  f.write((char*)&width, 4);
-  f.write((char*)&height, 4);
-  f.write((char*)&planes, 2);
-  f.write((char*)&bits_per_pixel, 2);
-  f.write((char*)&zero, 4);
-  f.write((char*)&zero, 4);
-  f.write((char*)&width, 4);
-  f.write((char*)&height, 4);
-  f.write((char*)&used_colors, 4);
-  f.write((char*)&zero, 4);
+void encode_rgba8(const FrameBufferCanvas& source, PixelRect rect,
+                  uint8_t* out, size_t stride) {
+  bool linear = source.is_linear_blending();
+  for (int64_t y = rect.y0; y < rect.y1; y++, out += stride) {
+    uint8_t* px = out;
+    for (int64_t x = rect.x0; x < rect.x1; x++) {
+      Rgba c = source.get_pixel(x, y);
+      for (float v : {c.r, c.g, c.b}) {
+        *px++ = linear ? linear_to_srgb8(v)
+                       : uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+      }
+      *px++ = uint8_t(std::clamp(c.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+  }
+}
 
-  for (uint32_t y = 0; y < height; y++) {
-    // uint32_t y = height - i - 1;
-    for (uint32_t x = 0; x < width; x++) {
-      size_t index = (y * width + x);
-      uint8_t r = pixels[index].b * 255.0;
-      uint8_t g = pixels[index].g * 255.0;
-      uint8_t b = pixels[index].r * 255.0;
-      f.write((char*)&r, 1);
-      f.write((char*)&g, 1);
-      f.write((char*)&b, 1);
+static uint32_t read_u32(const uint8_t* p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+BmpLayout read_bmp_layout(const uint8_t* data, size_t size) {
+  if (size < 54 || data[0] != 'B' || data[1] != 'M') {
+    throw std::runtime_error("Not a BMP file");
+  }
+  uint32_t info_header_size = read_u32(data + 14);
+  int32_t width = read_u32(data + 18), height = read_u32(data + 22);
+  uint32_t bits_per_pixel = data[28] | data[29] << 8;
+  uint32_t compression = read_u32(data + 30);
+  if (info_header_size < 40 || width <= 0 || height == 0 ||
+      height == INT32_MIN) {
+    throw std::runtime_error("Unsupported BMP header");
+  }
+
+  BmpLayout layout;
+  layout.width = width;
+  layout.height = height < 0 ? -height : height;
+  layout.top_down = height < 0;
+  layout.data_offset = read_u32(data + 10);
+
+  // Uncompressed, or 32 bit BGRA spelled out as bit fields. The masks follow
+  // the 40 byte header, inside the larger ones.
+  const uint32_t BI_RGB = 0, BI_BITFIELDS = 3, BI_ALPHABITFIELDS = 6;
+  if (bits_per_pixel == 24 && compression == BI_RGB) {
+    layout.bytes_per_pixel = 3;
+  } else if (bits_per_pixel == 32 && compression == BI_RGB) {
+    layout.bytes_per_pixel = 4;
+  } else if (bits_per_pixel == 32 && (compression == BI_BITFIELDS ||
+                                      compression == BI_ALPHABITFIELDS)) {
+    bool alpha_mask = compression == BI_ALPHABITFIELDS ||
+                      info_header_size >= 56;
+    if (size < 70 || read_u32(data + 54) != 0x00ff0000 ||
+        read_u32(data + 58) != 0x0000ff00 ||
+        read_u32(data + 62) != 0x000000ff) {
+      throw std::runtime_error("Unsupported BMP channel masks");
+    }
+    uint32_t a_mask = alpha_mask ? read_u32(data + 66) : 0;
+    if (a_mask != 0 && a_mask != 0xff000000) {
+      throw std::runtime_error("Unsupported BMP channel masks");
     }
+    layout.bytes_per_pixel = 4;
+    layout.has_alpha = a_mask != 0;
+  } else {
+    throw std::runtime_error("Unsupported BMP format, only 24 and 32 bit "
+                             "uncompressed files are read");
+  }
 
-    for (uint32_t i = 0; i < padding; i++) {
-      f.write((char*)&zero, 1);
+  layout.row_stride = (size_t(layout.width) * layout.bytes_per_pixel + 3) /
+                      4 * 4;
+  if (layout.data_offset > size ||
+      (size - layout.data_offset) / layout.row_stride < layout.height) {
+    throw std::runtime_error("Truncated BMP file");
+  }
+  return layout;
+}
+
+void convert_bmp_row(const uint8_t* src, Rgba* dst, uint32_t width,
+                     const BmpLayout& layout) {
+  uint32_t bpp = layout.bytes_per_pixel;
+  uint32_t x = 0;
+#ifdef __SSE2__
+  // Four pixels at a time, widened to 32 bit lanes and swizzled from BGRA.
+  // Opaque formats get their alpha byte set to 255 on the way.
+  const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i opaque = _mm_set1_epi32(layout.has_alpha ? 0 : 0xff000000);
+  for (; x + 4 <= width; x += 4) {
+    __m128i bgra;
+    if (bpp == 4) {
+      bgra = _mm_loadu_si128((const __m128i*)(src + 4 * size_t(x)));
+    } else {
+      uint32_t packed[4] = {0, 0, 0, 0};
+      for (uint32_t i = 0; i < 4; i++) {
+        std::memcpy(&packed[i], src + 3 * size_t(x + i), 3);
+      }
+      bgra = _mm_loadu_si128((const __m128i*)packed);
+    }
+    bgra = _mm_or_si128(bgra, opaque);
+    __m128i lo = _mm_unpacklo_epi8(bgra, zero);
+    __m128i hi = _mm_unpackhi_epi8(bgra, zero);
+    __m128i lanes[4] = {_mm_unpacklo_epi16(lo, zero),
+                        _mm_unpackhi_epi16(lo, zero),
+                        _mm_unpacklo_epi16(hi, zero),
+                        _mm_unpackhi_epi16(hi, zero)};
+    for (uint32_t i = 0; i < 4; i++) {
+      __m128 c = _mm_mul_ps(_mm_cvtepi32_ps(lanes[i]), scale);
+      _mm_storeu_ps(&dst[x + i].r,
+                    _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2)));
     }
   }
+#endif
+  for (; x < width; x++) {
+    const uint8_t* p = src + size_t(x) * bpp;
+    dst[x] = Rgba{
+        .r = p[2] * (1.0f / 255.0f),
+        .g = p[1] * (1.0f / 255.0f),
+        .b = p[0] * (1.0f / 255.0f),
+        .a = layout.has_alpha ? p[3] * (1.0f / 255.0f) : 1.0f,
+    };
+  }
+}
 
-  if (!f) {
-    std::cerr << "Error writing to file " << file_path << "\n";
-    exit(1);
+std::unique_ptr<BmpCanvas> BmpCanvas::load(const std::string& path,
+                                           const std::string& file_path,
+                                           Viewport viewport,
+                                           Rgba background_color) {
+  MappedBmpCanvas source(path, viewport);
+  const BmpLayout& layout = source.get_layout();
+  auto canvas = std::make_unique<BmpCanvas>(layout.width, layout.height,
+                                            file_path, viewport,
+                                            background_color);
+  for (uint32_t y = 0; y < layout.height; y++) {
+    convert_bmp_row(source.stored_row(y), canvas->pixel_row(y), layout.width,
+                    layout);
+  }
+  return canvas;
+}
+
+void BmpCanvas::write_file(const std::string& path,
+                           const std::vector<Rgba>& image, uint32_t width,
+                           uint32_t height, bool linear_blending) {
+  auto f = std::ofstream(path, std::ios::binary);
+  if (!f.is_open()) throw std::runtime_error("Could not open file " + path);
+
+  write_bmp_header(f, width, height);
+  std::vector<uint8_t> row;
+  for (uint32_t y = 0; y < height; y++) {
+    write_bmp_row(f, image.data() + size_t(y) * width, width, row,
+                  linear_blending);
   }
 
   f.close();
+  if (!f) throw std::runtime_error("Error writing to file " + path);
+}
+
+void BmpCanvas::display() {
+  if (pending_write.valid()) pending_write.wait();
+
+  try {
+    write_file(file_path, pixels, width, height, linear_blending);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    exit(1);
+  }
+}
+
+std::shared_future<void> BmpCanvas::display_async() {
+  if (pending_write.valid()) pending_write.wait();
+
+  spare_pixels.swap(pixels);
+  // Only the first call allocates, later ones reuse the buffer the previous
+  // write released.
+  pixels.assign(size_t(width) * height, to_storage(background_color));
+  mark_damaged();
+
+  // The writer only reads state captured here and `spare_pixels`, which no
+  // one touches until `pending_write` completes.
+  const std::vector<Rgba>& image = spare_pixels;
+  pending_write =
+      std::async(std::launch::async,
+                 [&image, path = file_path, w = width, h = height,
+                  linear = linear_blending] {
+                   write_file(path, image, w, h, linear);
+                 })
+          .share();
+  return pending_write;
 }
 
 }  // namespace Canvas
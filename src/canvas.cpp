@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "canvas.h"
 
 namespace Canvas {
@@ -5,47 +7,224 @@ namespace Canvas {
 Canvas::Canvas(Viewport viewport) : viewport(viewport) {}
 
 const Viewport& Canvas::get_viewport() const { return viewport; };
-void Canvas::set_viewport(Viewport new_viewport) { viewport = new_viewport; };
+void Canvas::set_viewport(Viewport new_viewport) {
+  viewport = new_viewport;
+  scene_version++;
+  static_version++;
+  redecimate();
+};
+
+void Canvas::redecimate() {
+  if (decimated.empty()) return;
+
+  auto to_pixels = pixel_transform();
+  if (!to_pixels.has_value() ||
+      (to_pixels->scale.x == decimated_for.scale.x &&
+       to_pixels->scale.y == decimated_for.scale.y &&
+       to_pixels->offset.x == decimated_for.offset.x &&
+       to_pixels->offset.y == decimated_for.offset.y))
+    return;
+  decimated_for = to_pixels.value();
+  for (const auto& d : decimated) {
+    std::get<Polyline>(*d.primitive).points = decimate(d, decimated_for);
+  }
+  scene_version++;
+  if (static_decimated > 0) static_version++;
+}
 
 void Canvas::add_line(float x1, float y1, float x2, float y2, Rgba color,
                       float thickness) {
+  scene_version++;
   primitives.push_back(Line{
       .start = Vec2(x1, y1),
       .end = Vec2(x2, y2),
       .color = color,
       .thickness = thickness,
+      .blend = blend_mode,
   });
 }
 void Canvas::add_circle(float x, float y, float radius, Rgba color) {
-  primitives.push_back(
-      Circle{.origin = Vec2(x, y), .radius = radius, .color = color});
+  scene_version++;
+  primitives.push_back(Circle{.origin = Vec2(x, y),
+                              .radius = radius,
+                              .color = color,
+                              .blend = blend_mode});
 }
 void Canvas::add_triangle(Vec2 p1, Vec2 p2, Vec2 p3, Rgba color) {
-  primitives.push_back(Triangle{.points = {p1, p2, p3}, .color = color});
+  scene_version++;
+  primitives.push_back(Triangle{
+      .points = {p1, p2, p3}, .color = color, .blend = blend_mode});
+}
+void Canvas::add_polygon(const std::vector<Vec2>& points, Rgba color,
+                         FillRule rule) {
+  add_polygon(std::vector<std::vector<Vec2>>{points}, color, rule);
+}
+void Canvas::add_polygon(const std::vector<std::vector<Vec2>>& contours,
+                         Rgba color, FillRule rule) {
+  scene_version++;
+  primitives.push_back(Polygon{.contours = contours,
+                               .color = color,
+                               .rule = rule,
+                               .blend = blend_mode});
+}
+void Canvas::add_polyline(const std::vector<Vec2>& points, Rgba color,
+                          float thickness, LineJoin join) {
+  scene_version++;
+  primitives.push_back(Polyline{.points = points,
+                                .color = color,
+                                .thickness = thickness,
+                                .join = join,
+                                .blend = blend_mode});
+}
+void Canvas::add_quadratic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Rgba color,
+                                  float thickness) {
+  scene_version++;
+  primitives.push_back(Bezier{.points = {p0, p1, p2, p2},
+                              .degree = 2,
+                              .color = color,
+                              .thickness = thickness,
+                              .blend = blend_mode});
+}
+void Canvas::add_cubic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Vec2 p3, Rgba color,
+                              float thickness) {
+  scene_version++;
+  primitives.push_back(Bezier{.points = {p0, p1, p2, p3},
+                              .degree = 3,
+                              .color = color,
+                              .thickness = thickness,
+                              .blend = blend_mode});
+}
+void Canvas::add_text(float x, float y, const std::string& text, float size,
+                      Rgba color) {
+  scene_version++;
+  primitives.push_back(Text{.text = text,
+                            .origin = Vec2(x, y),
+                            .size = size,
+                            .color = color,
+                            .blend = blend_mode});
+}
+void Canvas::add_image(std::shared_ptr<FrameBufferCanvas> source,
+                       Viewport location) {
+  scene_version++;
+  primitives.push_back(Image{.source = std::move(source),
+                             .location = location,
+                             .blend = blend_mode});
+}
+void Canvas::add_primitive(Primitive p) {
+  scene_version++;
+  primitives.push_back(std::move(p));
+}
+void Canvas::set_blend_mode(BlendMode mode) { blend_mode = mode; }
+BlendMode Canvas::get_blend_mode() const { return blend_mode; }
+
+void Canvas::clear_primitives() {
+  primitives.clear();
+  decimated.clear();
+  static_count = 0;
+  static_decimated = 0;
+  scene_version++;
+  static_version++;
+}
+
+void Canvas::mark_static() {
+  merge_submissions();
+  if (primitives.size() == static_count) return;
+  static_count = primitives.size();
+  static_last = std::prev(primitives.end());
+  static_decimated = decimated.size();
+  static_version++;
+}
+
+void Canvas::clear_dynamic() {
+  merge_submissions();
+  primitives.erase(dynamic_begin(), primitives.cend());
+  decimated.erase(std::next(decimated.begin(), static_decimated),
+                  decimated.end());
+  scene_version++;
+}
+
+size_t Canvas::get_static_count() const { return static_count; }
+
+std::list<Primitive>::const_iterator Canvas::dynamic_begin() const {
+  if (static_count == 0) return primitives.begin();
+  return std::next(std::list<Primitive>::const_iterator(static_last));
+}
+const std::list<Primitive>& Canvas::get_primitives() const {
+  return primitives;
+}
+
+std::shared_ptr<SubmissionContext> Canvas::submission_context(uint32_t id) {
+  std::lock_guard<std::mutex> lock(submission_mutex);
+  auto it = std::lower_bound(
+      submission_contexts.begin(), submission_contexts.end(), id,
+      [](const auto& context, uint32_t id) { return context->id < id; });
+  if (it == submission_contexts.end() || (*it)->id != id) {
+    it = submission_contexts.insert(it,
+                                    std::make_shared<SubmissionContext>(id));
+  }
+  return *it;
+}
+
+void Canvas::merge_submissions() {
+  std::lock_guard<std::mutex> lock(submission_mutex);
+  for (const auto& context : submission_contexts) {
+    std::lock_guard<std::mutex> context_lock(context->mutex);
+    if (context->pending.empty()) continue;
+    primitives.splice(primitives.end(), context->pending);
+    scene_version++;
+  }
 }
-void Canvas::clear_primitives() { primitives.clear(); }
 
 void Canvas::update() {
-  for (const auto& p : primitives) {
-    switch (p.index()) {
-      case 0:
-        draw_primitive(std::get<0>(p));
-        break;
-      case 1:
-        draw_primitive(std::get<1>(p));
-        break;
-      case 2:
-        draw_primitive(std::get<2>(p));
-        break;
-      default:
-        break;
-    }
+  merge_submissions();
+  draw_primitives(primitives);
+}
+
+void Canvas::draw_primitives(const std::list<Primitive>& list) {
+  for (const auto& p : list) dispatch_primitive(p);
+}
+
+void Canvas::dispatch_primitive(const Primitive& p) {
+  switch (p.index()) {
+    case 0:
+      draw_primitive(std::get<0>(p));
+      break;
+    case 1:
+      draw_primitive(std::get<1>(p));
+      break;
+    case 2:
+      draw_primitive(std::get<2>(p));
+      break;
+    case 3:
+      draw_primitive(std::get<3>(p));
+      break;
+    case 4:
+      draw_primitive(std::get<4>(p));
+      break;
+    case 5:
+      draw_primitive(std::get<5>(p));
+      break;
+    case 6:
+      draw_primitive(std::get<6>(p));
+      break;
+    case 7:
+      draw_primitive(std::get<7>(p));
+      break;
+    case 8:
+      draw_primitive(std::get<8>(p));
+      break;
+    case 9:
+      draw_primitive(std::get<9>(p));
+      break;
+    default:
+      break;
   }
 }
 
 Rgba Canvas::blend(const Rgba& top, const Rgba& bottom) const {
   Rgba out;
   out.a = top.a + bottom.a * (1.0 - top.a);
+  if (out.a == 0.0f) return NONE;
   out.r = (top.r * top.a + bottom.r * bottom.a * (1.0 - top.a)) / out.a;
   out.g = (top.g * top.a + bottom.g * bottom.a * (1.0 - top.a)) / out.a;
   out.b = (top.b * top.a + bottom.b * bottom.a * (1.0 - top.a)) / out.a;
@@ -58,13 +237,53 @@ void Canvas::add_connected_points(
     float thickness) {
   if (pts.size() < 2) return;
 
-  auto [prev_x, prev_y] = pts[0];
-  for (size_t i = 1; i < pts.size(); i++) {
-    auto [cur_x, cur_y] = pts[i];
-    add_line(prev_x, prev_y, cur_x, cur_y, color, thickness);
-    prev_x = cur_x;
-    prev_y = cur_y;
+  std::vector<Vec2> points;
+  points.reserve(pts.size());
+  for (auto [x, y] : pts) points.emplace_back(x, y);
+
+  auto to_pixels = decimation ? pixel_transform() : std::nullopt;
+  if (!to_pixels.has_value()) {
+    add_polyline(points, color, thickness);
+    return;
+  }
+
+  if (decimated.empty()) decimated_for = to_pixels.value();
+  DecimatedPolyline d = {.points = std::move(points), .thickness = thickness};
+  d.x_monotonic = is_x_monotonic(d.points);
+  add_polyline(decimate(d, decimated_for), color, thickness);
+  d.primitive = std::prev(primitives.end());
+  decimated.push_back(std::move(d));
+}
+
+std::vector<Vec2> Canvas::decimate(const DecimatedPolyline& d,
+                                   const Transform2D& to_pixels) const {
+  if (d.x_monotonic && d.thickness == 0.0f) {
+    return decimate_m4(d.points, to_pixels);
+  }
+  if (d.x_monotonic) {
+    // Thick strokes cover pixel centers anywhere in a column, so they get
+    // columns as narrow as the tolerance.
+    Transform2D columns = to_pixels;
+    columns.scale.x /= DECIMATION_TOLERANCE_PX;
+    columns.offset.x /= DECIMATION_TOLERANCE_PX;
+    return decimate_m4(d.points, columns);
   }
+  return simplify_polyline(d.points, to_pixels, DECIMATION_TOLERANCE_PX);
 }
 
+void Canvas::set_decimation(bool enabled) {
+  decimation = enabled;
+  if (enabled) return;
+
+  for (auto& d : decimated) {
+    std::get<Polyline>(*d.primitive).points = std::move(d.points);
+  }
+  if (!decimated.empty()) scene_version++;
+  if (static_decimated > 0) static_version++;
+  decimated.clear();
+  static_decimated = 0;
+}
+
+std::optional<Transform2D> Canvas::pixel_transform() const { return {}; }
+
 }  // namespace Canvas
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+const std::vector<Rgba> DensityCanvas::DEFAULT_COLORMAP = {
+    Rgba{0.267f, 0.005f, 0.329f, 1.0f}, Rgba{0.231f, 0.322f, 0.545f, 1.0f},
+    Rgba{0.129f, 0.569f, 0.549f, 1.0f}, Rgba{0.369f, 0.788f, 0.384f, 1.0f},
+    Rgba{0.993f, 0.906f, 0.144f, 1.0f},
+};
+
+// A thread only pays for zeroing and summing up its partial bins when it
+// counts at least about as many points as there are bins.
+static constexpr size_t MIN_POINTS_PER_THREAD = 1 << 16;
+
+DensityCanvas::DensityCanvas(uint32_t width, uint32_t height,
+                             const std::string& file_path, Viewport viewport,
+                             Rgba background_color, uint32_t threads)
+    : BmpCanvas(width, height, file_path, viewport, background_color),
+      bins(size_t(width) * height, 0.0),
+      threads(std::max(threads, 1u)),
+      colormap(DEFAULT_COLORMAP) {}
+
+template <typename T>
+static void accumulate(const Transform2D& to_pixels, uint32_t width,
+                       uint32_t height, const Vec2* points,
+                       const float* weights, size_t count, T* bins) {
+  for (size_t i = 0; i < count; i++) {
+    Vec2 p = to_pixels.apply(points[i]);
+    if (!(p.x >= 0.0f && p.x < width && p.y >= 0.0f && p.y < height)) {
+      continue;
+    }
+    size_t index = size_t(p.y) * width + size_t(p.x);
+    bins[index] += weights == nullptr ? T(1) : T(weights[i]);
+  }
+}
+
+// Splits the points over one thread per partial buffer and adds the
+// partial bins to `bins` afterwards, again one thread per range of bins.
+template <typename T>
+static void accumulate_threaded(std::vector<std::vector<T>>& partials,
+                                const Transform2D& to_pixels, uint32_t width,
+                                uint32_t height, const Vec2* points,
+                                const float* weights, size_t count,
+                                std::vector<double>& bins) {
+  size_t n = partials.size();
+  std::vector<std::thread> workers;
+  workers.reserve(n);
+
+  size_t chunk = (count + n - 1) / n;
+  for (size_t t = 0; t < n; t++) {
+    workers.emplace_back([&, t] {
+      size_t begin = std::min(count, t * chunk);
+      size_t end = std::min(count, begin + chunk);
+      partials[t].assign(bins.size(), T(0));
+      accumulate(to_pixels, width, height, points + begin,
+                 weights == nullptr ? nullptr : weights + begin, end - begin,
+                 partials[t].data());
+    });
+  }
+  for (auto& w : workers) w.join();
+  workers.clear();
+
+  size_t range = (bins.size() + n - 1) / n;
+  for (size_t t = 0; t < n; t++) {
+    workers.emplace_back([&, t] {
+      size_t begin = std::min(bins.size(), t * range);
+      size_t end = std::min(bins.size(), begin + range);
+      for (const auto& partial : partials) {
+        for (size_t i = begin; i < end; i++) bins[i] += partial[i];
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+}
+
+void DensityCanvas::add_batch(const Vec2* points, const float* weights,
+                              size_t count) {
+  size_t per_thread = std::max(bins.size(), MIN_POINTS_PER_THREAD);
+  size_t n = std::clamp<size_t>(count / per_thread, 1, threads);
+  if (n == 1) {
+    accumulate(to_pixels, width, height, points, weights, count, bins.data());
+    return;
+  }
+
+  if (weights == nullptr) {
+    partial_counts.resize(n);
+    accumulate_threaded(partial_counts, to_pixels, width, height, points,
+                        weights, count, bins);
+  } else {
+    partial_sums.resize(n);
+    accumulate_threaded(partial_sums, to_pixels, width, height, points,
+                        weights, count, bins);
+  }
+}
+
+void DensityCanvas::add_points(const Vec2* points, const float* weights,
+                               size_t count) {
+  // Integer partial bins hold the counts of at most UINT32_MAX points.
+  for (size_t done = 0; done < count;) {
+    size_t n = std::min<size_t>(count - done, UINT32_MAX);
+    add_batch(points + done, weights == nullptr ? nullptr : weights + done, n);
+    done += n;
+  }
+}
+
+void DensityCanvas::add_points(const std::vector<Vec2>& points) {
+  add_points(points.data(), nullptr, points.size());
+}
+
+void DensityCanvas::add_points(const std::vector<Vec2>& points,
+                               const std::vector<float>& weights) {
+  if (weights.size() != points.size()) {
+    std::cerr << WHERE << " Got " << weights.size() << " weights for "
+              << points.size() << " points\n";
+    return;
+  }
+  add_points(points.data(), weights.data(), points.size());
+}
+
+void DensityCanvas::clear_bins() { std::fill(bins.begin(), bins.end(), 0.0); }
+
+double DensityCanvas::get_bin(uint32_t x, uint32_t y) const {
+  double bin;
+  INDEX_GET(bin, bins, size_t(y) * width + x);
+  return bin;
+}
+
+void DensityCanvas::set_colormap(const std::vector<Rgba>& stops) {
+  if (stops.empty()) {
+    std::cerr << WHERE << " A colormap needs at least one color\n";
+    return;
+  }
+  colormap = stops;
+}
+
+void DensityCanvas::set_scale(DensityScale new_scale) { scale = new_scale; }
+
+void DensityCanvas::set_threads(uint32_t count) {
+  threads = std::max(count, 1u);
+  partial_counts.clear();
+  partial_sums.clear();
+}
+
+Rgba DensityCanvas::map_bin(double bin, double max,
+                            const std::vector<double>& sorted) const {
+  double t = 1.0;
+  switch (scale) {
+    case DensityScale::LINEAR:
+      t = bin / max;
+      break;
+    case DensityScale::LOG:
+      t = std::log1p(bin) / std::log1p(max);
+      break;
+    case DensityScale::EQUALIZED:
+      t = double(std::upper_bound(sorted.begin(), sorted.end(), bin) -
+                 sorted.begin()) /
+          sorted.size();
+      break;
+  }
+  if (colormap.size() == 1) return colormap[0];
+
+  float pos = std::clamp(t, 0.0, 1.0) * (colormap.size() - 1);
+  size_t i = std::min<size_t>(pos, colormap.size() - 2);
+  float f = pos - i;
+  const Rgba &a = colormap[i], &b = colormap[i + 1];
+  return Rgba{a.r + (b.r - a.r) * f, a.g + (b.g - a.g) * f,
+              a.b + (b.b - a.b) * f, a.a + (b.a - a.a) * f};
+}
+
+void DensityCanvas::update() {
+  double max = 0.0;
+  std::vector<double> sorted;
+  for (double bin : bins) {
+    max = std::max(max, bin);
+    if (scale == DensityScale::EQUALIZED && bin > 0.0) sorted.push_back(bin);
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  Rgba background = to_storage(background_color);
+  for (size_t i = 0; i < bins.size(); i++) {
+    pixels[i] = bins[i] > 0.0
+                    ? blend(to_storage(map_bin(bins[i], max, sorted)),
+                            background)
+                    : background;
+  }
+  mark_damaged();
+
+  BmpCanvas::update();
+}
+
+}  // namespace Canvas
@@ -0,0 +1,494 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+static constexpr size_t HEADER_SIZE = 32;
+
+// Appends little endian values, records are closed by end_record().
+struct DisplayListWriter {
+  std::vector<uint8_t>& out;
+  size_t record_start = 0;
+
+  // A scalar of `count` bytes, swapped to little endian.
+  void value(const void* src, size_t count) {
+    const uint8_t* p = (const uint8_t*)src;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    out.insert(out.end(), std::make_reverse_iterator(p + count),
+               std::make_reverse_iterator(p));
+#else
+    out.insert(out.end(), p, p + count);
+#endif
+  }
+  // Bytes stored as they are, in any byte order.
+  void raw(const void* src, size_t count) {
+    const uint8_t* p = (const uint8_t*)src;
+    out.insert(out.end(), p, p + count);
+  }
+  void u32(uint32_t v) { value(&v, 4); }
+  void u64(uint64_t v) { value(&v, 8); }
+  void f32(float v) { value(&v, 4); }
+  void vec2(Vec2 v) {
+    f32(v.x);
+    f32(v.y);
+  }
+  void rgba(const Rgba& c) {
+    for (float v : {c.r, c.g, c.b, c.a}) f32(v);
+  }
+  void viewport(const Viewport& v) {
+    for (float f : {v.top, v.bottom, v.left, v.right}) f32(f);
+  }
+
+  void begin_record(uint32_t type) {
+    u32(type);
+    record_start = out.size();
+    u32(0);
+  }
+  void end_record() {
+    uint32_t payload = out.size() - record_start - 4;
+    for (size_t i = 0; i < 4; i++) {
+      out[record_start + i] = uint8_t(payload >> (8 * i));
+    }
+    out.resize((out.size() + 3) / 4 * 4, 0);
+  }
+};
+
+// Reads little endian values from a record, throwing when it runs out.
+struct DisplayListReader {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  // A little endian scalar of `count` bytes, in host byte order.
+  void value(void* dst, size_t count) {
+    if (size_t(end - p) < count) {
+      throw std::runtime_error("Display list record is truncated");
+    }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    std::reverse_copy(p, p + count, (uint8_t*)dst);
+#else
+    std::memcpy(dst, p, count);
+#endif
+    p += count;
+  }
+  // Bytes stored as they are, in any byte order.
+  void raw(void* dst, size_t count) {
+    if (size_t(end - p) < count) {
+      throw std::runtime_error("Display list record is truncated");
+    }
+    std::memcpy(dst, p, count);
+    p += count;
+  }
+  uint32_t u32() {
+    uint32_t v;
+    value(&v, 4);
+    return v;
+  }
+  uint64_t u64() {
+    uint64_t v;
+    value(&v, 8);
+    return v;
+  }
+  float f32() {
+    float v;
+    value(&v, 4);
+    return v;
+  }
+  Vec2 vec2() {
+    float x = f32();
+    return Vec2(x, f32());
+  }
+  Rgba rgba() {
+    Rgba c;
+    c.r = f32();
+    c.g = f32();
+    c.b = f32();
+    c.a = f32();
+    return c;
+  }
+  Viewport viewport() {
+    Viewport v;
+    v.top = f32();
+    v.bottom = f32();
+    v.left = f32();
+    v.right = f32();
+    return v;
+  }
+  // The blend mode closing a drawable record, lists written before
+  // primitives had one end without it and blend over.
+  BlendMode blend_mode() {
+    if (p == end) return BlendMode::OVER;
+    uint32_t mode = u32();
+    if (mode > uint32_t(BlendMode::ERASE)) {
+      throw std::runtime_error("Unknown display list blend mode");
+    }
+    return BlendMode(mode);
+  }
+  FillRule fill_rule() {
+    uint32_t rule = u32();
+    if (rule > uint32_t(FillRule::EVEN_ODD)) {
+      throw std::runtime_error("Malformed display list fill rule");
+    }
+    return FillRule(rule);
+  }
+  LineJoin line_join() {
+    uint32_t join = u32();
+    if (join > uint32_t(LineJoin::BEVEL)) {
+      throw std::runtime_error("Malformed display list line join");
+    }
+    return LineJoin(join);
+  }
+  // A count of elements of at least `element_size` bytes each, checked
+  // against the rest of the record before anything is allocated for it.
+  uint32_t count(size_t element_size) {
+    uint32_t n = u32();
+    if (uint64_t(n) * element_size > uint64_t(end - p)) {
+      throw std::runtime_error("Display list record is truncated");
+    }
+    return n;
+  }
+};
+
+std::vector<uint8_t> DisplayList::encode(const Canvas& canvas) {
+  std::vector<uint8_t> out;
+  DisplayListWriter w{out};
+  const auto& primitives = canvas.get_primitives();
+
+  out.insert(out.end(), {'C', 'V', 'D', 'L'});
+  w.u32(VERSION);
+  w.viewport(canvas.get_viewport());
+  w.u64(primitives.size());
+
+  std::unordered_map<uint64_t, uint32_t> image_indices;
+  for (const auto& p : primitives) {
+    if (auto image = std::get_if<Image>(&p); image && image->source) {
+      const FrameBufferCanvas& src = *image->source;
+      auto [it, inserted] =
+          image_indices.try_emplace(src.get_image_id(), image_indices.size());
+      if (inserted) {
+        w.begin_record(IMAGE_DATA);
+        w.u32(it->second);
+        w.u32(src.get_width());
+        w.u32(src.get_height());
+        w.u32(src.is_linear_blending());
+        for (uint32_t y = 0; y < src.get_height(); y++) {
+          for (uint32_t x = 0; x < src.get_width(); x++) {
+            w.rgba(src.get_pixel(x, y));
+          }
+        }
+        w.end_record();
+      }
+    }
+
+    w.begin_record(p.index());
+    switch (p.index()) {
+      case 0: {
+        const Line& l = std::get<0>(p);
+        w.vec2(l.start);
+        w.vec2(l.end);
+        w.rgba(l.color);
+        w.f32(l.thickness);
+        break;
+      }
+      case 1: {
+        const Circle& c = std::get<1>(p);
+        w.vec2(c.origin);
+        w.f32(c.radius);
+        w.rgba(c.color);
+        break;
+      }
+      case 2: {
+        const Triangle& t = std::get<2>(p);
+        for (const auto& pt : t.points) w.vec2(pt);
+        w.rgba(t.color);
+        break;
+      }
+      case 3: {
+        const PushLayer& l = std::get<3>(p);
+        w.f32(l.opacity);
+        w.u32(l.clip.has_value());
+        w.viewport(l.clip.value_or(Viewport{}));
+        break;
+      }
+      case 4:
+        break;
+      case 5: {
+        const Polygon& poly = std::get<5>(p);
+        w.rgba(poly.color);
+        w.u32(uint32_t(poly.rule));
+        w.u32(poly.contours.size());
+        for (const auto& c : poly.contours) w.u32(c.size());
+        for (const auto& c : poly.contours) {
+          for (const auto& pt : c) w.vec2(pt);
+        }
+        break;
+      }
+      case 6: {
+        const Polyline& l = std::get<6>(p);
+        w.rgba(l.color);
+        w.f32(l.thickness);
+        w.u32(uint32_t(l.join));
+        w.u32(l.points.size());
+        for (const auto& pt : l.points) w.vec2(pt);
+        break;
+      }
+      case 7: {
+        const Bezier& b = std::get<7>(p);
+        for (const auto& pt : b.points) w.vec2(pt);
+        w.u32(b.degree);
+        w.rgba(b.color);
+        w.f32(b.thickness);
+        break;
+      }
+      case 8: {
+        const Text& t = std::get<8>(p);
+        w.vec2(t.origin);
+        w.f32(t.size);
+        w.rgba(t.color);
+        w.u32(t.text.size());
+        w.raw(t.text.data(), t.text.size());
+        break;
+      }
+      case 9: {
+        const Image& i = std::get<9>(p);
+        w.viewport(i.location);
+        w.u32(i.source ? image_indices.at(i.source->get_image_id())
+                       : UINT32_MAX);
+        break;
+      }
+    }
+    if (!std::holds_alternative<PushLayer>(p) &&
+        !std::holds_alternative<PopLayer>(p)) {
+      w.u32(uint32_t(primitive_blend_mode(p)));
+    }
+    w.end_record();
+  }
+  return out;
+}
+
+void DisplayList::save(const std::string& path, const Canvas& canvas) {
+  std::vector<uint8_t> encoded = encode(canvas);
+  auto f = std::ofstream(path, std::ios::binary);
+  if (!f.is_open()) throw std::runtime_error("Could not open file " + path);
+  f.write((const char*)encoded.data(), encoded.size());
+  f.close();
+  if (!f) throw std::runtime_error("Error writing to file " + path);
+}
+
+DisplayList DisplayList::map(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Could not open file " + path);
+
+  try {
+    DisplayList list = map(fd);
+    close(fd);
+    return list;
+  } catch (const std::runtime_error& e) {
+    close(fd);
+    throw std::runtime_error(std::string(e.what()) + ": " + path);
+  }
+}
+
+DisplayList DisplayList::map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE) {
+    throw std::runtime_error("Not a display list");
+  }
+  void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) throw std::runtime_error("Could not map file");
+
+  DisplayList list;
+  list.mapping = mapping;
+  list.mapping_size = st.st_size;
+  list.data = (const uint8_t*)mapping;
+  list.size = st.st_size;
+  list.check_header();
+  return list;
+}
+
+DisplayList::DisplayList(std::vector<uint8_t> bytes)
+    : bytes(std::move(bytes)) {
+  data = this->bytes.data();
+  size = this->bytes.size();
+  check_header();
+}
+
+DisplayList::DisplayList(DisplayList&& other)
+    : bytes(std::move(other.bytes)),
+      mapping(other.mapping),
+      mapping_size(other.mapping_size),
+      data(other.mapping ? other.data : bytes.data()),
+      size(other.size) {
+  other.mapping = nullptr;
+  other.data = nullptr;
+  other.size = 0;
+}
+
+DisplayList::~DisplayList() {
+  if (mapping != nullptr) munmap(mapping, mapping_size);
+}
+
+void DisplayList::check_header() const {
+  if (size < HEADER_SIZE || std::memcmp(data, "CVDL", 4) != 0) {
+    throw std::runtime_error("Not a display list");
+  }
+  DisplayListReader r{data + 4, data + HEADER_SIZE};
+  uint32_t version = r.u32();
+  if (version != VERSION) {
+    throw std::runtime_error("Unsupported display list version " +
+                             std::to_string(version));
+  }
+}
+
+Viewport DisplayList::get_viewport() const {
+  return DisplayListReader{data + 8, data + HEADER_SIZE}.viewport();
+}
+
+uint64_t DisplayList::get_primitive_count() const {
+  return DisplayListReader{data + 24, data + HEADER_SIZE}.u64();
+}
+
+void DisplayList::replay(Canvas& canvas) const {
+  std::vector<std::shared_ptr<FrameBufferCanvas>> images;
+  uint64_t count = 0;
+  const uint8_t* p = data + HEADER_SIZE;
+  const uint8_t* end = data + size;
+
+  while (p < end) {
+    DisplayListReader header{p, end};
+    uint32_t type = header.u32();
+    uint32_t payload = header.u32();
+    if (payload > size_t(end - header.p)) {
+      throw std::runtime_error("Display list record is truncated");
+    }
+    DisplayListReader r{header.p, header.p + payload};
+    p = header.p + std::min<size_t>((payload + 3) / 4 * 4, end - header.p);
+
+    if (type == IMAGE_DATA) {
+      uint32_t index = r.u32(), width = r.u32(), height = r.u32();
+      bool linear = r.u32();
+      if (index != images.size() ||
+          uint64_t(width) * height * sizeof(Rgba) != uint64_t(r.end - r.p)) {
+        throw std::runtime_error("Malformed display list image");
+      }
+      auto image = std::make_shared<BmpCanvas>(
+          width, height, "",
+          Viewport{.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0},
+          NONE);
+      image->set_linear_blending(linear);
+      for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) image->set_pixel(x, y, r.rgba());
+      }
+      image->mark_damaged();
+      images.push_back(std::move(image));
+      continue;
+    }
+
+    count++;
+    switch (type) {
+      case 0:
+        canvas.add_primitive(Line{.start = r.vec2(),
+                                  .end = r.vec2(),
+                                  .color = r.rgba(),
+                                  .thickness = r.f32(),
+                                  .blend = r.blend_mode()});
+        break;
+      case 1:
+        canvas.add_primitive(Circle{.origin = r.vec2(),
+                                    .radius = r.f32(),
+                                    .color = r.rgba(),
+                                    .blend = r.blend_mode()});
+        break;
+      case 2:
+        canvas.add_primitive(Triangle{.points = {r.vec2(), r.vec2(), r.vec2()},
+                                      .color = r.rgba(),
+                                      .blend = r.blend_mode()});
+        break;
+      case 3: {
+        PushLayer l;
+        l.opacity = r.f32();
+        bool has_clip = r.u32();
+        Viewport clip = r.viewport();
+        if (has_clip) l.clip = clip;
+        canvas.add_primitive(l);
+        break;
+      }
+      case 4:
+        canvas.add_primitive(PopLayer{});
+        break;
+      case 5: {
+        Polygon poly{.color = r.rgba(), .rule = r.fill_rule()};
+        std::vector<uint32_t> sizes(r.count(4));
+        for (auto& n : sizes) n = r.count(sizeof(Vec2));
+        for (uint32_t n : sizes) {
+          auto& contour = poly.contours.emplace_back();
+          contour.reserve(n);
+          for (uint32_t i = 0; i < n; i++) contour.push_back(r.vec2());
+        }
+        poly.blend = r.blend_mode();
+        canvas.add_primitive(std::move(poly));
+        break;
+      }
+      case 6: {
+        Polyline l{.color = r.rgba(),
+                   .thickness = r.f32(),
+                   .join = r.line_join()};
+        uint32_t n = r.count(sizeof(Vec2));
+        l.points.reserve(n);
+        for (uint32_t i = 0; i < n; i++) l.points.push_back(r.vec2());
+        l.blend = r.blend_mode();
+        canvas.add_primitive(std::move(l));
+        break;
+      }
+      case 7: {
+        Bezier b{.points = {r.vec2(), r.vec2(), r.vec2(), r.vec2()},
+                 .degree = r.u32(),
+                 .color = r.rgba(),
+                 .thickness = r.f32()};
+        if (b.degree != 2 && b.degree != 3) {
+          throw std::runtime_error("Malformed display list curve");
+        }
+        b.blend = r.blend_mode();
+        canvas.add_primitive(b);
+        break;
+      }
+      case 8: {
+        Text t{.origin = r.vec2(), .size = r.f32(), .color = r.rgba()};
+        t.text.resize(r.count(1));
+        r.raw(t.text.data(), t.text.size());
+        t.blend = r.blend_mode();
+        canvas.add_primitive(std::move(t));
+        break;
+      }
+      case 9: {
+        Image i{.location = r.viewport()};
+        uint32_t index = r.u32();
+        if (index != UINT32_MAX) {
+          if (index >= images.size()) {
+            throw std::runtime_error("Display list image is missing");
+          }
+          i.source = images[index];
+        }
+        i.blend = r.blend_mode();
+        canvas.add_primitive(std::move(i));
+        break;
+      }
+      default:
+        throw std::runtime_error("Unknown display list record " +
+                                 std::to_string(type));
+    }
+  }
+
+  if (count != get_primitive_count()) {
+    throw std::runtime_error("Display list is truncated");
+  }
+}
+
+}  // namespace Canvas
@@ -1,6 +1,9 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <ranges>
 #include <stack>
@@ -8,55 +11,35 @@
 
 #include "canvas.h"
 
-using namespace Canvas;
-static std::optional<float> intersect_lines(const Vec2& p1, const Vec2& d1,
-                                            const Vec2& p2, const Vec2& d2) {
-  // d1x * t1 - d2x * t2 = p2x - p1x
-  // d1y * t1 - d2y * t2 = p2y - p1y
-  //
-  // d2y * d1x * t1 - d2y * d2x * t2 = d2y * (p2x - p1x)
-  // d2x * d1y * t1 - d2y * d2x * t2 = d2x * (p2y - p1y)
-  //
-  // t1 * (d2y * d1x - d2x * d1y) = d2y * (p2x - p1x) - d2x * (p2y - p1y)
-
-  float div = d2.y * d1.x - d2.x * d1.y;
-  if (div == 0.0f) return {};
-  div = 1.0f / div;
-
-  return div * d2.y * (p2.x - p1.x) - div * d2.x * (p2.y - p1.y);
-}
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
+using namespace Canvas;
+// Liang-Barsky clipping of a line to the viewport, empty if the line lies
+// completely outside of it.
 static std::optional<Line> bound_line(const Line& l, const Viewport& v) {
-  // bd
-  // ac
-  Vec2 a(v.left, v.bottom), b(v.left, v.top), c(v.right, v.bottom),
-      d(v.right, v.top);
-
   Vec2 p(l.start), dir = Vec2(l.end - l.start);
   if (dir.x == 0.0 && dir.y == 0.0) return {};
-  auto t1_res = intersect_lines(p, dir, a, c - a);
-  auto t2_res = intersect_lines(p, dir, a, b - a);
-  auto t3_res = intersect_lines(p, dir, b, d - b);
-  auto t4_res = intersect_lines(p, dir, c, d - c);
-  float t1 = 0.0f, t2 = 0.0f, t3 = 0.0f, t4 = 0.0f;
-
-  if (!t1_res.has_value()) {
-    if (p.x < v.left || p.x > v.right) return {};
-    UNWRAP(t2_res, t2);
-    UNWRAP(t4_res, t4);
-  } else if (!t2_res.has_value()) {
-    if (p.y < v.bottom || p.y > v.top) return {};
-    UNWRAP(t1_res, t1);
-    UNWRAP(t3_res, t3);
-  } else {
-    UNWRAP(t1_res, t1);
-    UNWRAP(t2_res, t2);
-    UNWRAP(t3_res, t3);
-    UNWRAP(t4_res, t4);
-  }
 
-  float t_min = std::clamp(std::min({t1, t2, t3, t4, 0.0f, 1.0f}), 0.0f, 1.0f);
-  float t_max = std::clamp(std::max({t1, t2, t3, t4, 0.0f, 1.0f}), 0.0f, 1.0f);
+  float t_min = 0.0f, t_max = 1.0f;
+  auto clip = [&](float denom, float dist) {
+    if (denom == 0.0f) return dist >= 0.0f;
+    float t = dist / denom;
+    if (denom < 0.0f) {
+      t_min = std::max(t_min, t);
+    } else {
+      t_max = std::min(t_max, t);
+    }
+    return t_min <= t_max;
+  };
+
+  float left = std::min(v.left, v.right), right = std::max(v.left, v.right);
+  float bottom = std::min(v.bottom, v.top), top = std::max(v.bottom, v.top);
+  if (!clip(-dir.x, p.x - left) || !clip(dir.x, right - p.x) ||
+      !clip(-dir.y, p.y - bottom) || !clip(dir.y, top - p.y))
+    return {};
+
   return Line{.start = p + dir * t_min,
               .end = p + dir * t_max,
               .color = l.color,
@@ -65,9 +48,29 @@ static std::optional<Line> bound_line(const Line& l, const Viewport& v) {
 
 namespace Canvas {
 
+static std::atomic<uint64_t> next_image_id = 1;
+
 FrameBufferCanvas::FrameBufferCanvas(uint32_t width, uint32_t height,
                                      Viewport viewport)
-    : Canvas(viewport), width(width), height(height) {}
+    : Canvas(viewport),
+      width(width),
+      height(height),
+      to_pixels(Transform2D::between(viewport, pixel_viewport())),
+      clip(PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height}),
+      image_id(next_image_id++) {}
+
+void FrameBufferCanvas::set_viewport(Viewport new_viewport) {
+  Canvas::set_viewport(new_viewport);
+  to_pixels = Transform2D::between(viewport, pixel_viewport());
+}
+
+std::optional<Transform2D> FrameBufferCanvas::pixel_transform() const {
+  // Canvas::set_viewport() asks before `to_pixels` follows the viewport.
+  return Transform2D::between(viewport, pixel_viewport());
+}
+
+uint32_t FrameBufferCanvas::get_width() const { return width; }
+uint32_t FrameBufferCanvas::get_height() const { return height; }
 
 Viewport FrameBufferCanvas::pixel_viewport() const {
   return Viewport{
@@ -79,21 +82,138 @@ Viewport FrameBufferCanvas::pixel_viewport() const {
 }
 
 std::optional<Rgba> FrameBufferCanvas::sample(float x, float y) const {
-  Vec2 pixel_coords = Viewport::convert(viewport, pixel_viewport(), Vec2(x, y));
+  Vec2 pixel_coords = to_pixels.apply(Vec2(x, y));
 
   if (pixel_coords.x < 0.0 || pixel_coords.x >= width || pixel_coords.y < 0.0 ||
       pixel_coords.y >= height)
     return {};
 
-  return get_pixel(pixel_coords.x, pixel_coords.y);
+  Rgba color = get_pixel(pixel_coords.x, pixel_coords.y);
+  return linear_blending ? linear_to_srgb(color) : color;
 }
 
+Rgba* FrameBufferCanvas::pixel_row(uint32_t y) { return nullptr; }
+
 void FrameBufferCanvas::blend_pixel(uint32_t x, uint32_t y, Rgba color) {
-  set_pixel(x, y, blend(color, get_pixel(x, y)));
+  if (layer_depth > 0) {
+    STATS(stats.pixels_blended++);
+    layers[layer_depth - 1].blend(x, y, color);
+    return;
+  }
+  // Opaque colors replace the pixel under OVER, so only translucent ones and
+  // the other modes read it.
+  if (draw_blend == BlendMode::REPLACE ||
+      (draw_blend == BlendMode::OVER && color.a >= 1.0f)) {
+    STATS(stats.pixels_written++);
+    set_pixel(x, y, to_storage(color));
+    return;
+  }
+  STATS(stats.pixels_blended++);
+  if (draw_blend == BlendMode::OVER) {
+    set_pixel(x, y, blend(to_storage(color), get_pixel(x, y)));
+  } else {
+    set_pixel(x, y, blend_colors(draw_blend, to_storage(color),
+                                 get_pixel(x, y)));
+  }
+}
+
+Rgba FrameBufferCanvas::to_storage(const Rgba& color) const {
+  return linear_blending ? srgb_to_linear(color) : color;
+}
+
+void FrameBufferCanvas::set_linear_blending(bool enabled) {
+  linear_blending = enabled;
+}
+bool FrameBufferCanvas::is_linear_blending() const { return linear_blending; }
+
+void FrameBufferCanvas::update() {
+  STATS(stats = RasterStats{});
+  Canvas::update();
+}
+
+void FrameBufferCanvas::draw_primitives(const std::list<Primitive>& list) {
+  PixelRect changed;
+  // Splats land at random in a framebuffer larger than the caches, so the
+  // pixels of the ones coming up are fetched while this one is blended.
+  auto ahead = list.begin();
+  for (size_t i = 0; lod_threshold > 0.0f && i < SPLAT_PREFETCH; i++) {
+    if (ahead != list.end()) prefetch_splat(*ahead++);
+  }
+
+  for (auto it = list.begin(); it != list.end(); ++it) {
+    if (lod_threshold > 0.0f && ahead != list.end()) {
+      prefetch_splat(*ahead++);
+    }
+    draw_list_entry(it, list.end());
+    changed = changed.unite(pixel_bounds(*it));
+  }
+
+  while (layer_depth > 0) end_layer();
+  changed = changed.intersect(clip);
+  if (!changed.empty()) mark_damaged(changed);
+}
+
+void FrameBufferCanvas::draw_list_entry(
+    std::list<Primitive>::const_iterator it,
+    std::list<Primitive>::const_iterator end) {
+  if (auto push = std::get_if<PushLayer>(&*it)) {
+    begin_layer(*push, std::next(it), end);
+    return;
+  }
+  if (std::holds_alternative<PopLayer>(*it)) {
+    if (layer_depth > 0) end_layer();
+    return;
+  }
+  draw_blend = primitive_blend_mode(*it);
+  if (lod_threshold > 0.0f && draw_lod_splat(*it)) return;
+
+#ifdef CANVAS_STATS
+  auto start = std::chrono::steady_clock::now();
+  dispatch_primitive(*it);
+  auto stop = std::chrono::steady_clock::now();
+  stats.primitives[it->index()]++;
+  stats.time_ns[it->index()] +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+          .count();
+#else
+  dispatch_primitive(*it);
+#endif
+}
+
+const RasterStats& FrameBufferCanvas::get_stats() const { return stats; }
+
+void FrameBufferCanvas::set_lod_threshold(float pixels) {
+  lod_threshold = std::max(pixels, 0.0f);
+}
+float FrameBufferCanvas::get_lod_threshold() const { return lod_threshold; }
+
+uint64_t FrameBufferCanvas::get_image_id() const { return image_id; }
+uint64_t FrameBufferCanvas::get_revision() const { return revision; }
+
+PixelRect FrameBufferCanvas::damage_since(uint64_t since) const {
+  if (since >= revision) return {};
+  if (damage.empty() || damage.front().first > since + 1) {
+    return PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height};
+  }
+
+  PixelRect rect;
+  for (const auto& [rev, r] : damage) {
+    if (rev > since) rect = rect.unite(r);
+  }
+  return rect;
+}
+
+void FrameBufferCanvas::mark_damaged(PixelRect rect) {
+  if (damage.size() == MAX_DAMAGE_HISTORY) damage.erase(damage.begin());
+  damage.emplace_back(++revision, rect);
+}
+
+void FrameBufferCanvas::mark_damaged() {
+  mark_damaged(PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height});
 }
 
 void FrameBufferCanvas::floodfill(float x, float y, Rgba color) {
-  Vec2 pixel = Viewport::convert(viewport, pixel_viewport(), Vec2(x, y));
+  Vec2 pixel = to_pixels.apply(Vec2(x, y));
   floodfill(uint32_t(pixel.x), uint32_t(pixel.y), color);
 }
 
@@ -103,13 +223,20 @@ void FrameBufferCanvas::floodfill(uint32_t x, uint32_t y, Rgba color) {
   std::stack<std::tuple<uint32_t, uint32_t>> points;
   points.push(std::make_tuple(x, y));
   auto c = get_pixel(x, y);
+  color = to_storage(color);
+  PixelRect filled = {.x0 = x, .y0 = y, .x1 = x + 1, .y1 = y + 1};
 
   while (!points.empty()) {
     auto [px, py] = points.top();
     uint32_t x = px, y = py;
     points.pop();
 
+    STATS(stats.pixels_written++);
     set_pixel(x, y, color);
+    filled = filled.unite(PixelRect{.x0 = std::max(x, 1u) - 1,
+                                    .y0 = std::max(y, 1u) - 1,
+                                    .x1 = x + 2,
+                                    .y1 = y + 2});
 
     if (x + 1 < width && c == get_pixel(x + 1, y)) {
       set_pixel(x + 1, y, color);
@@ -131,155 +258,309 @@ void FrameBufferCanvas::floodfill(uint32_t x, uint32_t y, Rgba color) {
       points.push(std::make_tuple(x, y - 1));
     }
   }
+  mark_damaged(filled.intersect(
+      PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height}));
 }
 
 void FrameBufferCanvas::blit_canvas(const FrameBufferCanvas& other,
                                     Viewport location) {
-  Vec2 pixel_p1 = Viewport::convert(viewport, pixel_viewport(),
-                                    Vec2(location.left, location.bottom));
-  Vec2 pixel_p2 = Viewport::convert(viewport, pixel_viewport(),
-                                    Vec2(location.right, location.top));
+  Vec2 pixel_p1 = to_pixels.apply(Vec2(location.left, location.bottom));
+  Vec2 pixel_p2 = to_pixels.apply(Vec2(location.right, location.top));
 
   uint32_t min_x = std::clamp(pixel_p1.x, 0.0f, float(width - 1));
   uint32_t max_x = std::clamp(pixel_p2.x, 0.0f, float(width - 1));
   uint32_t min_y = std::clamp(pixel_p1.y, 0.0f, float(height - 1));
   uint32_t max_y = std::clamp(pixel_p2.y, 0.0f, float(height - 1));
+  // Blits blend over, whatever mode the last primitive drawn used.
+  draw_blend = BlendMode::OVER;
 
   Viewport partial_pixel_viewport = {.top = float(max_y),
                                      .bottom = float(min_y),
                                      .left = float(min_x),
                                      .right = float(max_x)};
 
+  Transform2D to_other =
+      Transform2D::between(partial_pixel_viewport, other.pixel_viewport());
+
   for (uint32_t x = min_x; x <= max_x; x++) {
     for (uint32_t y = min_y; y <= max_y; y++) {
-      Vec2 other_point = Viewport::convert(partial_pixel_viewport,
-                                           other.pixel_viewport(), Vec2(x, y));
+      Vec2 other_point = to_other.apply(Vec2(x, y));
       Rgba other_color = other.get_pixel(other_point.x, other_point.y);
+      if (other.linear_blending) other_color = linear_to_srgb(other_color);
       blend_pixel(x, y, other_color);
     }
   }
+  mark_damaged(PixelRect{.x0 = min_x, .y0 = min_y, .x1 = max_x + 1,
+                         .y1 = max_y + 1});
 }
 
 void FrameBufferCanvas::draw_primitive(const Triangle& p) {
   if (p.color == NONE) return;
 
-  std::array<Vec2, 3> points = {
-      Viewport::convert(viewport, pixel_viewport(), p.points[0]),
-      Viewport::convert(viewport, pixel_viewport(), p.points[1]),
-      Viewport::convert(viewport, pixel_viewport(), p.points[2])};
-  for (auto& p : points) p = Vec2(int64_t(p.x), int64_t(p.y));
-
-  Viewport tri_pixels = {
-      .top = std::max({
-          points[0].y,
-          points[1].y,
-          points[2].y,
-      }),
-      .bottom = std::min({
-          points[0].y,
-          points[1].y,
-          points[2].y,
-      }),
-      .left = std::min({
-          points[0].x,
-          points[1].x,
-          points[2].x,
-      }),
-      .right = std::max({
-          points[0].x,
-          points[1].x,
-          points[2].x,
-      }),
-  };
-
-  BmpCanvas tri =
-      BmpCanvas(tri_pixels.right - tri_pixels.left + 1,
-                tri_pixels.top - tri_pixels.bottom + 1, "", tri_pixels, NONE);
-
-  tri.draw_pixel_triangle(
-      points[0].x - tri_pixels.left, points[0].y - tri_pixels.bottom,
-      points[1].x - tri_pixels.left, points[1].y - tri_pixels.bottom,
-      points[2].x - tri_pixels.left, points[2].y - tri_pixels.bottom, p.color);
-  // tri.draw_pixel_line(
-  //     points[0].x - tri_pixels.left, points[0].y - tri_pixels.bottom,
-  //     points[1].x - tri_pixels.left, points[1].y - tri_pixels.bottom,
-  //     p.color);
-  // tri.draw_pixel_line(
-  //     points[1].x - tri_pixels.left, points[1].y - tri_pixels.bottom,
-  //     points[2].x - tri_pixels.left, points[2].y - tri_pixels.bottom,
-  //     p.color);
-  // tri.draw_pixel_line(
-  //     points[2].x - tri_pixels.left, points[2].y - tri_pixels.bottom,
-  //     points[0].x - tri_pixels.left, points[0].y - tri_pixels.bottom,
-  //     p.color);
-
-  for (uint32_t x = 0; x < tri.width; x++) {
-    for (uint32_t y = 0; y < tri.height; y++) {
-      Rgba c = tri.get_pixel(x, y);
-      if (pixel_viewport().contains(
-              Vec2(x + tri_pixels.left, y + tri_pixels.bottom))) {
-        blend_pixel(x + tri_pixels.left, y + tri_pixels.bottom, c);
-      }
-    }
-  }
+  // Scanned straight into the canvas like any polygon, so pixels outside the
+  // triangle are left alone in every blend mode and triangles sharing an
+  // edge cover each of its pixels once.
+  STATS(stats.temp_allocations++);
+  std::vector<std::vector<Vec2>> contours = {
+      {p.points.begin(), p.points.end()}};
+  to_pixels.apply(contours[0].data(), contours[0].data(), 3);
+  fill_polygon(contours, FillRule::NON_ZERO, p.color);
 }
 
 void FrameBufferCanvas::draw_primitive(const Line& l) {
   if (l.thickness == 0.0f) {
     auto bounded_line_res = bound_line(l, viewport);
-    if (!bounded_line_res.has_value()) return;
+    if (!bounded_line_res.has_value()) {
+      STATS(stats.culled++);
+      return;
+    }
     Line bounded_line = bounded_line_res.value();
 
-    Vec2 a = Viewport::convert(viewport, pixel_viewport(), bounded_line.start);
-    Vec2 b = Viewport::convert(viewport, pixel_viewport(), bounded_line.end);
+    Vec2 a = to_pixels.apply(bounded_line.start);
+    Vec2 b = to_pixels.apply(bounded_line.end);
+    float max_x = width - 1, max_y = height - 1;
 
-    draw_pixel_line(a.x, a.y, b.x, b.y, l.color);
+    draw_pixel_line(std::clamp(a.x, 0.0f, max_x), std::clamp(a.y, 0.0f, max_y),
+                    std::clamp(b.x, 0.0f, max_x), std::clamp(b.y, 0.0f, max_y),
+                    l.color);
 
   } else {
-    Vec2 a = l.start, b = l.end;
-    Vec2 dir = b - a;
-    Vec2 c = a + Vec2(-dir.y, dir.x).normalize() * l.thickness;
-    Vec2 d = a + a - c;
-    Vec2 e = d + (b - a), f = c + (b - a);
+    if (l.color == NONE) return;
+    // The segment and its round caps are filled as one shape, so every
+    // pixel is blended once whatever the blend mode.
+    float scale =
+        std::max(std::abs(to_pixels.scale.x), std::abs(to_pixels.scale.y));
+    STATS(stats.temp_allocations++);
+    auto contours = stroke_outline({l.start, l.end}, l.thickness,
+                                   LineJoin::ROUND,
+                                   circle_segments(l.thickness * scale));
+    for (auto& c : contours) to_pixels.apply(c.data(), c.data(), c.size());
+    fill_polygon(contours, FillRule::NON_ZERO, l.color);
+  }
+}
 
-    draw_primitive(Triangle{.points = {c, d, e}, .color = l.color});
-    draw_primitive(Triangle{.points = {c, f, e}, .color = l.color});
+void FrameBufferCanvas::draw_primitive(const Circle& c) {
+  if (c.color == NONE) return;
 
-    draw_primitive(
-        Circle{.origin = a, .radius = l.thickness, .color = l.color});
-    draw_primitive(
-        Circle{.origin = b, .radius = l.thickness, .color = l.color});
+  Vec2 center = to_pixels.apply(c.origin);
+  float rx = std::abs(c.radius * to_pixels.scale.x),
+        ry = std::abs(c.radius * to_pixels.scale.y);
+  if (center.x + rx < float(clip.x0) || center.x - rx >= float(clip.x1) ||
+      center.y + ry < float(clip.y0) || center.y - ry >= float(clip.y1)) {
+    STATS(stats.culled++);
+    return;
   }
+
+  // A single contour around the ellipse the circle maps to, filled like a
+  // polygon so every pixel is blended once.
+  uint32_t segments = circle_segments(std::max(rx, ry));
+  STATS(stats.temp_allocations++);
+  std::vector<std::vector<Vec2>> contours(1);
+  contours[0].reserve(segments);
+  for (uint32_t i = 0; i < segments; i++) {
+    float t = 2.0 * M_PI * i / segments;
+    contours[0].push_back(center + Vec2(std::cos(t) * rx, std::sin(t) * ry));
+  }
+  fill_polygon(contours, FillRule::NON_ZERO, c.color);
 }
 
-void FrameBufferCanvas::draw_primitive(const Circle& c) {
-  Vec2 prev = Vec2(std::cos(0.0f), std::sin(0.0f)) * c.radius + c.origin;
-  float step = 0.1;
+void FrameBufferCanvas::draw_primitive(const Polygon& p) {
+  if (p.color == NONE) return;
+
+  STATS(stats.temp_allocations++);
+  std::vector<std::vector<Vec2>> contours = p.contours;
+  for (auto& c : contours) to_pixels.apply(c.data(), c.data(), c.size());
+  fill_polygon(contours, p.rule, p.color);
+}
+
+void FrameBufferCanvas::draw_primitive(const Polyline& p) {
+  if (p.color == NONE) return;
+
+  if (p.thickness == 0.0f) {
+    for (size_t i = 0; i + 1 < p.points.size(); i++) {
+      draw_primitive(Line{.start = p.points[i],
+                          .end = p.points[i + 1],
+                          .color = p.color,
+                          .thickness = 0.0f});
+    }
+    return;
+  }
+
+  float scale =
+      std::max(std::abs(to_pixels.scale.x), std::abs(to_pixels.scale.y));
+  STATS(stats.temp_allocations++);
+  auto contours = stroke_outline(p.points, p.thickness, p.join,
+                                 circle_segments(p.thickness * scale));
+  for (auto& c : contours) to_pixels.apply(c.data(), c.data(), c.size());
+  fill_polygon(contours, FillRule::NON_ZERO, p.color);
+}
+
+void FrameBufferCanvas::draw_primitive(const Bezier& b) {
+  if (b.color == NONE) return;
+
+  // Flattened to a quarter pixel at the current scale.
+  STATS(stats.temp_allocations++);
+  uint32_t segments = bezier_segments(b, to_pixels.scale, 0.25f);
+  draw_primitive(Polyline{.points = flatten_bezier(b, segments),
+                          .color = b.color,
+                          .thickness = b.thickness,
+                          .join = LineJoin::ROUND});
+}
+
+void FrameBufferCanvas::fill_polygon(
+    const std::vector<std::vector<Vec2>>& contours, FillRule rule,
+    Rgba color) {
+  struct Edge {
+    float y0, y1, x0, dxdy;
+    int winding;
+  };
+  std::vector<Edge> edges;
+  float min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY,
+        max_y = -INFINITY;
+
+  for (const auto& contour : contours) {
+    if (contour.size() < 3) continue;
+    for (size_t i = 0; i < contour.size(); i++) {
+      Vec2 a = contour[i], b = contour[(i + 1) % contour.size()];
+      min_x = std::min(min_x, a.x);
+      max_x = std::max(max_x, a.x);
+      if (a.y == b.y) continue;
+
+      int winding = 1;
+      if (a.y > b.y) {
+        std::swap(a, b);
+        winding = -1;
+      }
+      edges.push_back(Edge{.y0 = a.y,
+                           .y1 = b.y,
+                           .x0 = a.x,
+                           .dxdy = (b.x - a.x) / (b.y - a.y),
+                           .winding = winding});
+      min_y = std::min(min_y, a.y);
+      max_y = std::max(max_y, b.y);
+    }
+  }
+
+  // Rows are sampled at integer y, the half open [y0, y1) edge ranges make
+  // shared vertices count once.
+  int64_t first_row = std::max<int64_t>(std::ceil(min_y), clip.y0);
+  int64_t last_row = std::min<int64_t>(std::ceil(max_y) - 1, clip.y1 - 1);
+  if (edges.empty() || first_row > last_row || max_x < float(clip.x0) ||
+      min_x > float(clip.x1 - 1)) {
+    STATS(stats.culled++);
+    return;
+  }
+
+  std::sort(edges.begin(), edges.end(),
+            [](const Edge& a, const Edge& b) { return a.y0 < b.y0; });
+
+  std::vector<size_t> active;
+  std::vector<std::pair<float, int>> crossings;
+  size_t next_edge = 0;
+
+  for (int64_t y = first_row; y <= last_row; y++) {
+    float sample_y = y;
+    while (next_edge < edges.size() && edges[next_edge].y0 <= sample_y) {
+      active.push_back(next_edge++);
+    }
+    auto expired = [&](size_t i) { return edges[i].y1 <= sample_y; };
+    active.erase(std::remove_if(active.begin(), active.end(), expired),
+                 active.end());
+
+    crossings.clear();
+    for (size_t i : active) {
+      const Edge& e = edges[i];
+      crossings.emplace_back(e.x0 + (sample_y - e.y0) * e.dxdy, e.winding);
+    }
+    std::sort(crossings.begin(), crossings.end());
+
+    int winding = 0;
+    for (size_t i = 0; i + 1 < crossings.size(); i++) {
+      winding += crossings[i].second;
+      bool inside = rule == FillRule::NON_ZERO ? winding != 0 : (i % 2) == 0;
+      if (!inside) continue;
+
+      float x0 = std::max(std::ceil(crossings[i].first), float(clip.x0));
+      float x1 = std::min(std::ceil(crossings[i + 1].first), float(clip.x1));
+      if (x0 < x1) blend_span(y, x0, x1, color);
+    }
+  }
+}
+
+// Calls `f` with `mode` as a std::integral_constant, so per pixel loops are
+// instantiated for every mode instead of branching on it.
+template <typename F>
+static void with_blend_mode(BlendMode mode, F&& f) {
+  using M = BlendMode;
+  switch (mode) {
+    case M::OVER:
+      return f(std::integral_constant<M, M::OVER>{});
+    case M::REPLACE:
+      return f(std::integral_constant<M, M::REPLACE>{});
+    case M::ADD:
+      return f(std::integral_constant<M, M::ADD>{});
+    case M::MULTIPLY:
+      return f(std::integral_constant<M, M::MULTIPLY>{});
+    case M::MAX:
+      return f(std::integral_constant<M, M::MAX>{});
+    case M::MIN:
+      return f(std::integral_constant<M, M::MIN>{});
+    case M::ERASE:
+      return f(std::integral_constant<M, M::ERASE>{});
+  }
+}
+
+void FrameBufferCanvas::blend_span(uint32_t y, uint32_t x0, uint32_t x1,
+                                   Rgba color) {
+  Rgba* dst = layer_depth == 0 ? pixel_row(y) : nullptr;
+  if (dst == nullptr) {
+    for (uint32_t x = x0; x < x1; x++) blend_pixel(x, y, color);
+    return;
+  }
+
+  Rgba c = to_storage(color);
+  dst += x0;
+  uint32_t count = x1 - x0;
+  if (draw_blend == BlendMode::REPLACE ||
+      (draw_blend == BlendMode::OVER && c.a >= 1.0f)) {
+    STATS(stats.pixels_written += count);
+    std::fill(dst, dst + count, c);
+    return;
+  }
 
-  for (float t = step; t <= 2.0 * M_PI; t += step) {
-    Vec2 cur = Vec2(std::cos(t), std::sin(t)) * c.radius + c.origin;
-    draw_primitive(Triangle{.points = {c.origin, prev, cur}, .color = c.color});
+  STATS(stats.pixels_blended += count);
+  if (draw_blend == BlendMode::OVER) {
+    for (uint32_t i = 0; i < count; i++) dst[i] = blend(c, dst[i]);
+    return;
   }
+  with_blend_mode(draw_blend, [&](auto mode) {
+    for (uint32_t i = 0; i < count; i++) {
+      dst[i] = blend_colors<decltype(mode)::value>(c, dst[i]);
+    }
+  });
 }
 
-void FrameBufferCanvas::draw_pixel_line(uint32_t x1, uint32_t y1, uint32_t x2,
-                                        uint32_t y2, Rgba color) {
-  int64_t dx = std::abs(int64_t(x1) - int64_t(x2));
+void FrameBufferCanvas::draw_pixel_line(int64_t x1, int64_t y1, int64_t x2,
+                                        int64_t y2, Rgba color) {
+  int64_t dx = std::abs(x1 - x2);
   int64_t sx = (x1 > x2) ? -1 : +1;
-  int64_t dy = -std::abs(int64_t(y1) - int64_t(y2));
+  int64_t dy = -std::abs(y1 - y2);
   int64_t sy = (y1 > y2) ? -1 : +1;
   int64_t error = dx + dy;
 
-  while (!draw_pixel_line_step(x1, y1, x2, y2, dx, dy, sx, sy, error, color))
-    ;
+  // Rows only advance towards y2, so the walk can stop once it leaves the
+  // clip on that side.
+  while (!draw_pixel_line_step(x1, y1, x2, y2, dx, dy, sx, sy, error, color)) {
+    if (sy > 0 ? y1 >= clip.y1 : y1 < clip.y0) break;
+  }
 }
 
-bool FrameBufferCanvas::draw_pixel_line_step(uint32_t& x1, uint32_t& y1,
-                                             uint32_t x2, uint32_t y2,
+bool FrameBufferCanvas::draw_pixel_line_step(int64_t& x1, int64_t& y1,
+                                             int64_t x2, int64_t y2,
                                              int64_t dx, int64_t dy, int64_t sx,
                                              int64_t sy, int64_t& error,
                                              Rgba color) {
-  blend_pixel(x1, y1, color);
+  if (clip.contains(x1, y1)) blend_pixel(x1, y1, color);
   if (x1 == x2 && y1 == y2) return true;
   int64_t e2 = 2 * error;
   if (e2 >= dy) {
@@ -296,123 +577,612 @@ bool FrameBufferCanvas::draw_pixel_line_step(uint32_t& x1, uint32_t& y1,
   return false;
 }
 
-void FrameBufferCanvas::draw_pixel_triangle(uint32_t x1, uint32_t y1,
-                                            uint32_t x2, uint32_t y2,
-                                            uint32_t x3, uint32_t y3,
-                                            Rgba color) {
-  std::array<std ::pair<uint32_t, uint32_t>, 3> verts = {
-      std::make_pair(x1, y1),
-      std::make_pair(x2, y2),
-      std::make_pair(x3, y3),
+void FrameBufferCanvas::push_layer(float opacity,
+                                   std::optional<Viewport> clip) {
+  scene_version++;
+  primitives.push_back(PushLayer{.opacity = opacity, .clip = clip});
+}
+
+void FrameBufferCanvas::pop_layer() {
+  scene_version++;
+  primitives.push_back(PopLayer{});
+}
+
+PixelRect FrameBufferCanvas::pixel_bounds(const Primitive& p) const {
+  float min_x = 0.0f, max_x = 0.0f, min_y = 0.0f, max_y = 0.0f, pad = 0.0f;
+  auto add_point = [&](Vec2 pt, bool first) {
+    pt = to_pixels.apply(pt);
+    min_x = first ? pt.x : std::min(min_x, pt.x);
+    max_x = first ? pt.x : std::max(max_x, pt.x);
+    min_y = first ? pt.y : std::min(min_y, pt.y);
+    max_y = first ? pt.y : std::max(max_y, pt.y);
   };
-  std::sort(verts.begin(), verts.end(),
-            [](const std::pair<uint32_t, uint32_t>& a,
-               const std::pair<uint32_t, uint32_t>& b) {
-              return (a.second > b.second);
-            });
-
-  if (verts[1].second == verts[2].second) {
-    draw_flat_bottom_pixel_triangle(std::min(verts[1].first, verts[2].first),
-                                    std::max(verts[1].first, verts[2].first),
-                                    verts[2].second, verts[0].first,
-                                    verts[0].second, color);
-  } else if (verts[0].second == verts[1].second) {
-    draw_flat_top_pixel_triangle(std::min(verts[1].first, verts[0].first),
-                                 std::max(verts[1].first, verts[0].first),
-                                 verts[0].second, verts[2].first,
-                                 verts[2].second, color);
+  float scale =
+      std::max(std::abs(to_pixels.scale.x), std::abs(to_pixels.scale.y));
+
+  switch (p.index()) {
+    case 0: {
+      const Line& l = std::get<0>(p);
+      add_point(l.start, true);
+      add_point(l.end, false);
+      pad = l.thickness * scale;
+      break;
+    }
+    case 1: {
+      const Circle& c = std::get<1>(p);
+      add_point(c.origin, true);
+      pad = c.radius * scale;
+      break;
+    }
+    case 2: {
+      const Triangle& t = std::get<2>(p);
+      add_point(t.points[0], true);
+      add_point(t.points[1], false);
+      add_point(t.points[2], false);
+      break;
+    }
+    case 5: {
+      bool first = true;
+      for (const auto& contour : std::get<5>(p).contours) {
+        for (const auto& pt : contour) {
+          add_point(pt, first);
+          first = false;
+        }
+      }
+      if (first) return {};
+      break;
+    }
+    case 6: {
+      const Polyline& l = std::get<6>(p);
+      if (l.points.empty()) return {};
+      for (size_t i = 0; i < l.points.size(); i++) {
+        add_point(l.points[i], i == 0);
+      }
+      pad = l.thickness * scale;
+      break;
+    }
+    case 7: {
+      // The curve stays inside the hull of its control points.
+      const Bezier& b = std::get<7>(p);
+      for (uint32_t i = 0; i <= b.degree; i++) add_point(b.points[i], i == 0);
+      pad = b.thickness * scale;
+      break;
+    }
+    case 8: {
+      const Text& t = std::get<8>(p);
+      size_t lines = 1, longest = 0, column = 0;
+      for (char c : t.text) {
+        column = c == '\n' ? 0 : column + 1;
+        lines += c == '\n';
+        longest = std::max(longest, column);
+      }
+      float h = std::round(t.size * std::abs(to_pixels.scale.y));
+      add_point(t.origin, true);
+      max_x = min_x + longest * h * TEXT_CELL_WIDTH / TEXT_CELL_HEIGHT;
+      min_y = max_y - (lines - 1) * h;
+      max_y += h;
+      break;
+    }
+    case 9: {
+      const Image& i = std::get<9>(p);
+      add_point(Vec2(i.location.left, i.location.bottom), true);
+      add_point(Vec2(i.location.right, i.location.top), false);
+      break;
+    }
+    default:
+      return {};
+  }
+
+  // One extra pixel on each side covers the truncation in the rasterizers.
+  return PixelRect{.x0 = int64_t(std::floor(min_x - pad)) - 1,
+                   .y0 = int64_t(std::floor(min_y - pad)) - 1,
+                   .x1 = int64_t(std::ceil(max_x + pad)) + 2,
+                   .y1 = int64_t(std::ceil(max_y + pad)) + 2};
+}
+
+std::vector<std::vector<std::list<Primitive>::const_iterator>>
+FrameBufferCanvas::bin_primitives(uint32_t tile_width,
+                                  uint32_t tile_height) const {
+  int64_t columns = (int64_t(width) + tile_width - 1) / tile_width;
+  int64_t rows = (int64_t(height) + tile_height - 1) / tile_height;
+
+  // Tile range of every primitive, a layer covers the tiles of everything
+  // inside it, and its PopLayer the same tiles as its PushLayer.
+  std::vector<PixelRect> ranges;
+  std::vector<size_t> open_layers;
+  auto add_to_layer = [&](const PixelRect& range) {
+    if (open_layers.empty()) return;
+    PixelRect& layer = ranges[open_layers.back()];
+    layer = layer.unite(range);
+  };
+
+  ranges.reserve(primitives.size());
+  for (const auto& p : primitives) {
+    PixelRect& range = ranges.emplace_back();
+
+    if (std::holds_alternative<PushLayer>(p)) {
+      open_layers.push_back(ranges.size() - 1);
+      continue;
+    }
+    if (std::holds_alternative<PopLayer>(p)) {
+      if (open_layers.empty()) continue;
+      range = ranges[open_layers.back()];
+      open_layers.pop_back();
+      add_to_layer(range);
+      continue;
+    }
+
+    PixelRect rect = pixel_bounds(p).intersect(
+        PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height});
+    if (rect.empty()) continue;
+    range = PixelRect{.x0 = rect.x0 / tile_width,
+                      .y0 = rect.y0 / tile_height,
+                      .x1 = (rect.x1 - 1) / tile_width + 1,
+                      .y1 = (rect.y1 - 1) / tile_height + 1};
+    add_to_layer(range);
+  }
+
+  std::vector<std::vector<std::list<Primitive>::const_iterator>> bins(
+      columns * rows);
+  size_t i = 0;
+  for (auto it = primitives.begin(); it != primitives.end(); ++it, i++) {
+    for (int64_t y = ranges[i].y0; y < ranges[i].y1; y++) {
+      for (int64_t x = ranges[i].x0; x < ranges[i].x1; x++) {
+        bins[y * columns + x].push_back(it);
+      }
+    }
+  }
+  return bins;
+}
+
+template <typename T, typename = void>
+struct has_color : std::false_type {};
+template <typename T>
+struct has_color<T, std::void_t<decltype(T::color)>> : std::true_type {};
+
+void FrameBufferCanvas::begin_layer(const PushLayer& push,
+                                    std::list<Primitive>::const_iterator begin,
+                                    std::list<Primitive>::const_iterator end) {
+  PixelRect bounds;
+  std::optional<Rgba> color;
+  bool single_color = true;
+  size_t depth = 0;
+
+  for (auto it = begin; it != end; ++it) {
+    if (std::holds_alternative<PushLayer>(*it)) {
+      depth++;
+      single_color = false;
+      continue;
+    }
+    if (std::holds_alternative<PopLayer>(*it)) {
+      if (depth == 0) break;
+      depth--;
+      continue;
+    }
+
+    bounds = bounds.unite(pixel_bounds(*it));
+    Rgba c = std::visit(
+        [](const auto& v) {
+          if constexpr (has_color<std::decay_t<decltype(v)>>::value) {
+            return v.color;
+          } else {
+            return NONE;
+          }
+        },
+        *it);
+    if (!color.has_value()) color = c;
+    if (!(color.value() == c)) single_color = false;
+    // Images have no single color, their pixels need the RGBA8 buffer.
+    if (std::holds_alternative<Image>(*it)) single_color = false;
+  }
+
+  PixelRect rect = bounds.intersect(clip);
+  if (layer_depth > 0) rect = rect.intersect(layers[layer_depth - 1].rect);
+  if (push.clip.has_value()) {
+    Vec2 a = to_pixels.apply(Vec2(push.clip->left, push.clip->bottom));
+    Vec2 b = to_pixels.apply(Vec2(push.clip->right, push.clip->top));
+    rect = rect.intersect(
+        PixelRect{.x0 = int64_t(std::ceil(std::min(a.x, b.x))),
+                  .y0 = int64_t(std::ceil(std::min(a.y, b.y))),
+                  .x1 = int64_t(std::floor(std::max(a.x, b.x))) + 1,
+                  .y1 = int64_t(std::floor(std::max(a.y, b.y))) + 1});
+  }
+  if (rect.empty()) rect = PixelRect{};
+
+  if (layers.size() <= layer_depth) layers.emplace_back();
+  Layer& layer = layers[layer_depth++];
+  layer.rect = rect;
+  layer.opacity = std::clamp(push.opacity, 0.0f, 1.0f);
+  layer.color.reset();
+  layer.coverage.clear();
+  layer.pixels.clear();
+
+  if (single_color && color.has_value()) {
+    layer.color = color;
+    layer.coverage.assign(rect.area(), 0);
+  } else {
+    layer.pixels.assign(rect.area(), {0, 0, 0, 0});
+  }
+  STATS(stats.temp_allocations++);
+}
+
+static uint8_t to_u8(float v) {
+  return uint8_t(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static uint8_t mul_u8(uint32_t a, uint32_t b) {
+  return uint8_t((a * b + 127) / 255);
+}
+
+void FrameBufferCanvas::Layer::blend(uint32_t x, uint32_t y, const Rgba& c) {
+  if (!rect.contains(x, y) || c.a <= 0.0f) return;
+  size_t index = size_t(y - rect.y0) * (rect.x1 - rect.x0) + (x - rect.x0);
+
+  uint8_t a = to_u8(c.a);
+  if (color.has_value()) {
+    coverage[index] = a + mul_u8(coverage[index], 255 - a);
+    return;
+  }
+
+  auto& px = pixels[index];
+  px[0] = to_u8(c.r * c.a) + mul_u8(px[0], 255 - a);
+  px[1] = to_u8(c.g * c.a) + mul_u8(px[1], 255 - a);
+  px[2] = to_u8(c.b * c.a) + mul_u8(px[2], 255 - a);
+  px[3] = a + mul_u8(px[3], 255 - a);
+}
+
+// Blends `count` premultiplied colors over straight alpha canvas pixels, the
+// same operation as Canvas::blend.
+static void composite_over(Rgba* dst, const std::array<float, 4>* top,
+                           size_t count) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 rgb_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const __m128 alpha_one = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+  static_assert(sizeof(Rgba) == 4 * sizeof(float));
+
+  for (; i < count; i++) {
+    __m128 t = _mm_loadu_ps(top[i].data());
+    __m128 ta = _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 3, 3, 3));
+    if (_mm_comile_ss(ta, zero)) continue;
+
+    __m128 b = _mm_loadu_ps(&dst[i].r);
+    __m128 ba = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 k = _mm_mul_ps(ba, _mm_sub_ps(one, ta));
+    // (b.rgb, 1) * k + t leaves the new alpha in the last lane.
+    __m128 b1 = _mm_or_ps(_mm_and_ps(b, rgb_mask), alpha_one);
+    __m128 num = _mm_add_ps(t, _mm_mul_ps(b1, k));
+    __m128 out_a = _mm_shuffle_ps(num, num, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 out = _mm_div_ps(num, out_a);
+    out = _mm_or_ps(_mm_and_ps(out, rgb_mask), _mm_andnot_ps(rgb_mask, out_a));
+    _mm_storeu_ps(&dst[i].r, out);
+  }
+#endif
+  for (; i < count; i++) {
+    float ta = top[i][3];
+    if (ta <= 0.0f) continue;
+    Rgba& b = dst[i];
+    float k = b.a * (1.0f - ta);
+    float out_a = ta + k;
+    b = Rgba{.r = (top[i][0] + b.r * k) / out_a,
+             .g = (top[i][1] + b.g * k) / out_a,
+             .b = (top[i][2] + b.b * k) / out_a,
+             .a = out_a};
+  }
+}
+
+// composite_over() under any blend mode, the other modes blend the straight
+// alpha color of every covered pixel.
+static void composite_row(BlendMode mode, Rgba* dst,
+                          const std::array<float, 4>* top, size_t count) {
+  if (mode == BlendMode::OVER) {
+    composite_over(dst, top, count);
+    return;
+  }
+  with_blend_mode(mode, [&](auto m) {
+    for (size_t i = 0; i < count; i++) {
+      float a = top[i][3];
+      if (a <= 0.0f) continue;
+      Rgba t = {top[i][0] / a, top[i][1] / a, top[i][2] / a, a};
+      dst[i] = blend_colors<decltype(m)::value>(t, dst[i]);
+    }
+  });
+}
+
+bool FrameBufferCanvas::draw_lod_splat(const Primitive& p) {
+  // Centroid, extent and area of the primitive in pixels.
+  Vec2 center(0.0f, 0.0f);
+  float extent = 0.0f, area = 0.0f;
+  Rgba color;
+
+  if (auto l = std::get_if<Line>(&p)) {
+    Vec2 a = to_pixels.apply(l->start), b = to_pixels.apply(l->end);
+    float t = l->thickness * std::max(std::abs(to_pixels.scale.x),
+                                      std::abs(to_pixels.scale.y));
+    float length = std::sqrt((b - a).len_squared());
+    center = (a + b) * 0.5f;
+    extent = std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)) + 2.0f * t;
+    // Hairlines are one pixel wide, thick lines have round caps.
+    area = t == 0.0f ? length : length * 2.0f * t + float(M_PI) * t * t;
+    color = l->color;
+  } else if (auto c = std::get_if<Circle>(&p)) {
+    float rx = std::abs(c->radius * to_pixels.scale.x),
+          ry = std::abs(c->radius * to_pixels.scale.y);
+    center = to_pixels.apply(c->origin);
+    extent = 2.0f * std::max(rx, ry);
+    area = float(M_PI) * rx * ry;
+    color = c->color;
+  } else if (auto t = std::get_if<Triangle>(&p)) {
+    std::array<Vec2, 3> v = t->points;
+    to_pixels.apply(v.data(), v.data(), v.size());
+    center = (v[0] + v[1] + v[2]) * (1.0f / 3.0f);
+    extent = std::max(std::max({v[0].x, v[1].x, v[2].x}) -
+                          std::min({v[0].x, v[1].x, v[2].x}),
+                      std::max({v[0].y, v[1].y, v[2].y}) -
+                          std::min({v[0].y, v[1].y, v[2].y}));
+    Vec2 e1 = v[1] - v[0], e2 = v[2] - v[0];
+    area = std::abs(e1.x * e2.y - e1.y * e2.x) * 0.5f;
+    color = t->color;
   } else {
-    uint32_t x3 = verts[0].first +
-                  ((float(verts[1].second) - float(verts[0].second)) /
-                   (float(verts[2].second) - float(verts[0].second))) *
-                      (float(verts[2].first) - float(verts[0].first)),
-             y3 = verts[1].second;
-    draw_flat_bottom_pixel_triangle(std::min(verts[1].first, x3),
-                                    std::max(x3, verts[1].first), y3,
-                                    verts[0].first, verts[0].second, color);
-    draw_flat_top_pixel_triangle(std::min(verts[1].first, x3),
-                                 std::max(x3, verts[1].first), y3,
-                                 verts[2].first, verts[2].second, color);
+    return false;
   }
+
+  if (!(extent < lod_threshold)) return false;
+  STATS(stats.splats++);
+  if (color == NONE || area <= 0.0f) return true;
+  draw_splat(center, area, color);
+  return true;
 }
 
-void FrameBufferCanvas::draw_flat_top_pixel_triangle(
-    uint32_t left_x, uint32_t right_x, uint32_t top_y, uint32_t bottom_x,
-    uint32_t bottom_y, Rgba color) {
-  int64_t left_dx = std::abs(int64_t(left_x) - int64_t(bottom_x)),
-          right_dx = std::abs(int64_t(right_x) - int64_t(bottom_x));
-  int64_t left_sx = (left_x > bottom_x) ? +1 : -1,
-          right_sx = (right_x > bottom_x) ? +1 : -1;
-  int64_t dy = -std::abs(int64_t(top_y) - int64_t(bottom_y));
-  int64_t sy = (top_y > bottom_y) ? +1 : -1;
-  int64_t left_error = left_dx + dy, right_error = right_dx + dy;
-  uint32_t left_bottom_x = bottom_x, right_bottom_x = bottom_x,
-           left_bottom_y = bottom_y, right_bottom_y = bottom_y;
+void FrameBufferCanvas::prefetch_splat(const Primitive& p) {
+  Vec2 center(0.0f, 0.0f);
+  if (auto c = std::get_if<Circle>(&p)) {
+    center = to_pixels.apply(c->origin);
+  } else if (auto l = std::get_if<Line>(&p)) {
+    center = to_pixels.apply(l->start);
+  } else {
+    return;
+  }
 
-  while (true) {
-    bool left_finished = false, right_finished = false;
+  int64_t x = std::floor(center.x - 0.5f), y = std::floor(center.y - 0.5f);
+  if (layer_depth > 0 || x < clip.x0 || x >= clip.x1 - 1 || y < clip.y0 ||
+      y >= clip.y1 - 1)
+    return;
+  for (int64_t row = y; row < y + 2; row++) {
+    Rgba* dst = pixel_row(row);
+    if (dst != nullptr) __builtin_prefetch(dst + x, 1);
+  }
+}
 
-    uint32_t old_left_y = left_bottom_y, old_right_y = right_bottom_y;
+void FrameBufferCanvas::draw_splat(Vec2 center, float area, Rgba color) {
+  // Pixel x covers [x, x + 1), so its center is at x + 0.5.
+  float sx = center.x - 0.5f, sy = center.y - 0.5f;
+  float fx0 = std::floor(sx), fy0 = std::floor(sy);
+  if (!(fx0 >= float(clip.x0 - 1) && fx0 < float(clip.x1) &&
+        fy0 >= float(clip.y0 - 1) && fy0 < float(clip.y1))) {
+    STATS(stats.culled++);
+    return;
+  }
+  int64_t x0 = fx0, y0 = fy0;
+  float fx = sx - fx0, fy = sy - fy0;
+  const float weights[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy),
+                            (1.0f - fx) * fy, fx * fy};
+
+  // Layers keep their own buffer that blend_pixel() converts into, the
+  // canvas rows are composited here directly.
+  Rgba stored = to_storage(color);
+  for (int64_t y = std::max(y0, clip.y0); y < std::min(y0 + 2, clip.y1); y++) {
+    int64_t cx0 = std::max(x0, clip.x0), cx1 = std::min(x0 + 2, clip.x1);
+    Rgba* dst = layer_depth == 0 ? pixel_row(y) : nullptr;
+    std::array<float, 4> top[2];
+    for (int64_t x = cx0; x < cx1; x++) {
+      float a = color.a *
+                std::min(area * weights[2 * (y - y0) + (x - x0)], 1.0f);
+      if (dst == nullptr) {
+        blend_pixel(x, y, Rgba{color.r, color.g, color.b, a});
+      } else {
+        top[x - cx0] = {stored.r * a, stored.g * a, stored.b * a, a};
+      }
+    }
+    if (dst == nullptr || cx0 >= cx1) continue;
+    STATS(stats.pixels_blended += cx1 - cx0);
+    composite_row(draw_blend, dst + cx0, top, cx1 - cx0);
+  }
+}
 
-    while (!left_finished) {
-      left_finished =
-          draw_pixel_line_step(left_bottom_x, left_bottom_y, left_x, top_y,
-                               left_dx, dy, left_sx, sy, left_error, color);
-      if (old_left_y != left_bottom_y) break;
+// Converts premultiplied sRGB colors to premultiplied linear light.
+static void decode_premultiplied(std::array<float, 4>* row, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float a = row[i][3];
+    if (a <= 0.0f) continue;
+    for (size_t c = 0; c < 3; c++) {
+      row[i][c] = srgb_to_linear(row[i][c] / a) * a;
     }
+  }
+}
+
+void FrameBufferCanvas::end_layer() {
+  Layer& layer = layers[--layer_depth];
+  if (layer.rect.empty()) return;
+
+  uint32_t row_width = layer.rect.x1 - layer.rect.x0;
+  std::vector<std::array<float, 4>> row(row_width);
+  float scale = layer.opacity / 255.0f;
 
-    while (!right_finished) {
-      right_finished =
-          draw_pixel_line_step(right_bottom_x, right_bottom_y, right_x, top_y,
-                               right_dx, dy, right_sx, sy, right_error, color);
-      if (old_right_y != right_bottom_y) break;
+  for (int64_t y = layer.rect.y0; y < layer.rect.y1; y++) {
+    size_t offset = size_t(y - layer.rect.y0) * row_width;
+    // Rows composited directly are converted to storage space here,
+    // blend_pixel() converts the others.
+    Rgba* dst = layer_depth == 0 ? pixel_row(y) : nullptr;
+    if (layer.color.has_value()) {
+      Rgba c = layer.color.value();
+      if (dst != nullptr) c = to_storage(c);
+      for (uint32_t i = 0; i < row_width; i++) {
+        float a = layer.coverage[offset + i] * scale;
+        row[i] = {c.r * a, c.g * a, c.b * a, a};
+      }
+    } else {
+      for (uint32_t i = 0; i < row_width; i++) {
+        const auto& px = layer.pixels[offset + i];
+        row[i] = {px[0] * scale, px[1] * scale, px[2] * scale, px[3] * scale};
+      }
+      if (dst != nullptr && linear_blending) {
+        decode_premultiplied(row.data(), row_width);
+      }
     }
 
-    for (uint32_t x = left_bottom_x; x <= right_bottom_x; x++) {
-      blend_pixel(x, right_bottom_y, color);
+    if (dst != nullptr) {
+      composite_over(dst + layer.rect.x0, row.data(), row_width);
+      STATS(stats.pixels_blended += row_width);
+      continue;
     }
 
-    if (left_finished && right_finished) break;
+    for (uint32_t i = 0; i < row_width; i++) {
+      float a = row[i][3];
+      if (a <= 0.0f) continue;
+      blend_pixel(layer.rect.x0 + i, y,
+                  Rgba{.r = row[i][0] / a,
+                       .g = row[i][1] / a,
+                       .b = row[i][2] / a,
+                       .a = a});
+    }
   }
 }
 
-void FrameBufferCanvas::draw_flat_bottom_pixel_triangle(
-    uint32_t left_x, uint32_t right_x, uint32_t bottom_y, uint32_t top_x,
-    uint32_t top_y, Rgba color) {
-  int64_t left_dx = std::abs(int64_t(left_x) - int64_t(top_x)),
-          right_dx = std::abs(int64_t(right_x) - int64_t(top_x));
-  int64_t left_sx = (left_x > top_x) ? +1 : -1,
-          right_sx = (right_x > top_x) ? +1 : -1;
-  int64_t dy = -std::abs(int64_t(top_y) - int64_t(bottom_y));
-  int64_t sy = (top_y > bottom_y) ? -1 : +1;
-  int64_t left_error = left_dx + dy, right_error = right_dx + dy;
-  uint32_t left_top_x = top_x, right_top_x = top_x, left_top_y = top_y,
-           right_top_y = top_y;
+void FrameBufferCanvas::draw_primitive(const Text& t) {
+  if (t.color == NONE || t.text.empty()) return;
 
-  while (true) {
-    bool left_finished = false, right_finished = false;
-    uint32_t old_left_y = left_top_y, old_right_y = right_top_y;
+  // Glyphs are stamped at whole pixels and always upright, whatever the
+  // direction of the viewport axes.
+  uint32_t h = std::lround(t.size * std::abs(to_pixels.scale.y));
+  if (h == 0) {
+    STATS(stats.culled++);
+    return;
+  }
+  Vec2 origin = to_pixels.apply(t.origin);
+  int64_t ox = std::lround(origin.x), oy = std::lround(origin.y);
+  float advance = float(h) * TEXT_CELL_WIDTH / TEXT_CELL_HEIGHT;
 
-    while (!left_finished) {
-      left_finished =
-          draw_pixel_line_step(left_top_x, left_top_y, left_x, bottom_y,
-                               left_dx, dy, left_sx, sy, left_error, color);
-      if (old_left_y != left_top_y) break;
+  Rgba color = to_storage(t.color);
+  std::vector<std::array<float, 4>> row;
+  // Coverage of the glyphs too tall for the cache.
+  std::vector<uint8_t> sampled;
+  int64_t line = 0;
+  size_t column = 0;
+  for (char c : t.text) {
+    if (c == '\n') {
+      line++;
+      column = 0;
+      continue;
     }
+    int64_t x0 = ox + std::lround(column++ * advance);
+    int64_t top = oy - line * int64_t(h) + h - 1;
+    if (c == ' ') continue;
 
-    while (!right_finished) {
-      right_finished =
-          draw_pixel_line_step(right_top_x, right_top_y, right_x, bottom_y,
-                               right_dx, dy, right_sx, sy, right_error, color);
-      if (old_right_y != right_top_y) break;
+    // Culled before a stamp is made, glyphs far off the canvas are free.
+    uint32_t stamp_width = GlyphCache::width(h);
+    int64_t cx0 = std::max(x0, clip.x0);
+    int64_t cx1 = std::min<int64_t>(x0 + stamp_width, clip.x1);
+    if (cx0 >= cx1 || top - int64_t(h) >= clip.y1 || top < clip.y0) {
+      STATS(stats.culled++);
+      continue;
     }
+    const GlyphCache::Stamp* stamp =
+        h <= GlyphCache::MAX_HEIGHT ? &glyphs.get(c, h) : nullptr;
+    uint32_t count = cx1 - cx0;
+    row.resize(count);
+    if (stamp == nullptr) sampled.resize(count);
+
+    // Only the rows inside the clip.
+    int64_t r0 = std::max<int64_t>(0, top - (clip.y1 - 1));
+    int64_t r1 = std::min<int64_t>(h, top - clip.y0 + 1);
+    for (int64_t r = r0; r < r1; r++) {
+      int64_t y = top - r;
+      const uint8_t* coverage = sampled.data();
+      if (stamp != nullptr) {
+        coverage =
+            stamp->coverage.data() + size_t(r) * stamp_width + (cx0 - x0);
+      } else {
+        for (uint32_t i = 0; i < count; i++) {
+          sampled[i] = GlyphCache::coverage(c, h, cx0 - x0 + i, r);
+        }
+      }
 
-    for (uint32_t x = left_top_x; x <= right_top_x; x++) {
-      blend_pixel(x, right_top_y, color);
+      Rgba* dst = layer_depth == 0 ? pixel_row(y) : nullptr;
+      if (dst != nullptr) {
+        for (uint32_t i = 0; i < count; i++) {
+          float a = coverage[i] * color.a / 255.0f;
+          row[i] = {color.r * a, color.g * a, color.b * a, a};
+        }
+        composite_row(draw_blend, dst + cx0, row.data(), count);
+        STATS(stats.pixels_blended += count);
+        continue;
+      }
+
+      for (uint32_t i = 0; i < count; i++) {
+        if (coverage[i] == 0) continue;
+        Rgba color = t.color;
+        color.a *= coverage[i] / 255.0f;
+        blend_pixel(cx0 + i, y, color);
+      }
     }
+  }
+}
 
-    if (left_finished && right_finished) break;
+void FrameBufferCanvas::draw_primitive(const Image& i) {
+  if (i.source == nullptr || i.source.get() == this) return;
+  const FrameBufferCanvas& src = *i.source;
+
+  // Every pixel inside the location takes the nearest source pixel.
+  Vec2 a = to_pixels.apply(Vec2(i.location.left, i.location.bottom));
+  Vec2 b = to_pixels.apply(Vec2(i.location.right, i.location.top));
+  PixelRect rect =
+      PixelRect{.x0 = int64_t(std::ceil(std::min(a.x, b.x))),
+                .y0 = int64_t(std::ceil(std::min(a.y, b.y))),
+                .x1 = int64_t(std::floor(std::max(a.x, b.x))) + 1,
+                .y1 = int64_t(std::floor(std::max(a.y, b.y))) + 1}
+          .intersect(clip);
+  if (rect.empty() || a.x == b.x || a.y == b.y || src.width == 0 ||
+      src.height == 0) {
+    STATS(stats.culled++);
+    return;
+  }
+
+  auto source_index = [](int64_t p, float from, float to, uint32_t size) {
+    int64_t s = std::floor((p - from) / (to - from) * size);
+    return uint32_t(std::clamp<int64_t>(s, 0, size - 1));
+  };
+  uint32_t count = rect.x1 - rect.x0;
+  std::vector<uint32_t> columns(count);
+  for (uint32_t x = 0; x < count; x++) {
+    columns[x] = source_index(rect.x0 + x, a.x, b.x, src.width);
+  }
+
+  std::vector<std::array<float, 4>> row(count);
+  for (int64_t y = rect.y0; y < rect.y1; y++) {
+    uint32_t sy = source_index(y, a.y, b.y, src.height);
+
+    Rgba* dst = layer_depth == 0 ? pixel_row(y) : nullptr;
+    if (dst != nullptr) {
+      for (uint32_t x = 0; x < count; x++) {
+        Rgba c = src.get_pixel(columns[x], sy);
+        if (src.linear_blending != linear_blending) {
+          c = linear_blending ? srgb_to_linear(c) : linear_to_srgb(c);
+        }
+        row[x] = {c.r * c.a, c.g * c.a, c.b * c.a, c.a};
+      }
+      composite_row(draw_blend, dst + rect.x0, row.data(), count);
+      STATS(stats.pixels_blended += count);
+      continue;
+    }
+
+    for (uint32_t x = 0; x < count; x++) {
+      Rgba c = src.get_pixel(columns[x], sy);
+      blend_pixel(rect.x0 + x, y, src.linear_blending ? linear_to_srgb(c) : c);
+    }
   }
 }
 
-}  // namespace Canvas
\ No newline at end of file
+}  // namespace Canvas
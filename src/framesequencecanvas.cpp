@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+FrameSequenceCanvas::FrameSequenceCanvas(uint32_t width, uint32_t height,
+                                         const std::string& path,
+                                         SequenceFormat format,
+                                         Viewport viewport,
+                                         Rgba background_color,
+                                         uint32_t frame_rate,
+                                         size_t max_queued_frames)
+    : BmpCanvas(width, height, path, viewport, background_color),
+      format(format),
+      frame_rate(frame_rate),
+      max_buffers(std::max<size_t>(max_queued_frames, 1)) {
+  if (format != SequenceFormat::BMP_FILES) {
+    if (path == "-") {
+      out = &std::cout;
+    } else {
+      file.open(path, std::ios::binary);
+      if (!file.is_open()) {
+        std::cerr << "Could not open file " << path << "\n";
+        exit(1);
+      }
+      out = &file;
+    }
+  }
+
+  if (format == SequenceFormat::Y4M) {
+    *out << "YUV4MPEG2 W" << width << " H" << height << " F" << frame_rate
+         << ":1 Ip A1:1 C444\n";
+  }
+
+  encoder = std::thread(&FrameSequenceCanvas::encode_loop, this);
+}
+
+FrameSequenceCanvas::~FrameSequenceCanvas() { finish(); }
+
+void FrameSequenceCanvas::display() {
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  if (finishing) {
+    std::cerr << WHERE << " Frame displayed after finish()\n";
+    return;
+  }
+
+  queue_changed.wait(lock, [&] {
+    return !recycled.empty() || buffers_allocated < max_buffers;
+  });
+  if (recycled.empty()) {
+    recycled.emplace_back();
+    buffers_allocated++;
+  }
+
+  auto frame = recycled.begin();
+  frame->swap(pixels);
+  pending.splice(pending.end(), recycled, frame);
+  lock.unlock();
+  queue_changed.notify_all();
+
+  // A recycled buffer already has the capacity, only the first frames
+  // through a new buffer allocate here.
+  pixels.assign(size_t(width) * height, to_storage(background_color));
+  mark_damaged();
+}
+
+void FrameSequenceCanvas::finish() {
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    finishing = true;
+  }
+  queue_changed.notify_all();
+  if (encoder.joinable()) encoder.join();
+
+  if (out != nullptr) {
+    out->flush();
+    if (!*out) {
+      std::cerr << "Error writing to file " << file_path << "\n";
+      exit(1);
+    }
+    if (file.is_open()) file.close();
+    out = nullptr;
+  }
+}
+
+void FrameSequenceCanvas::encode_loop() {
+  std::vector<uint8_t> scratch;
+  uint64_t index = 0;
+
+  while (true) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_changed.wait(lock, [&] { return finishing || !pending.empty(); });
+    if (pending.empty()) break;
+
+    // display() only appends, so the front frame can be read unlocked.
+    auto frame = pending.begin();
+    lock.unlock();
+    encode(*frame, index++, scratch);
+    lock.lock();
+
+    recycled.splice(recycled.end(), pending, frame);
+    lock.unlock();
+    queue_changed.notify_all();
+  }
+}
+
+static uint8_t to_studio(float v, float offset) {
+  return uint8_t(std::clamp(v + offset + 0.5f, 0.0f, 255.0f));
+}
+
+void FrameSequenceCanvas::encode(const std::vector<Rgba>& frame,
+                                 uint64_t index,
+                                 std::vector<uint8_t>& scratch) {
+  size_t plane = size_t(width) * height;
+
+  switch (format) {
+    case SequenceFormat::Y4M: {
+      // Planar Y, Cb, Cr with the top row first.
+      scratch.resize(plane * 3);
+      uint8_t* y_plane = scratch.data();
+      uint8_t* cb_plane = y_plane + plane;
+      uint8_t* cr_plane = cb_plane + plane;
+      size_t i = 0;
+      for (uint32_t row = height; row-- > 0;) {
+        const Rgba* px = frame.data() + size_t(row) * width;
+        for (uint32_t x = 0; x < width; x++, i++) {
+          Rgba c = linear_blending ? linear_to_srgb(px[x]) : px[x];
+          float r = c.r, g = c.g, b = c.b;
+          y_plane[i] = to_studio(65.481f * r + 128.553f * g + 24.966f * b, 16);
+          cb_plane[i] =
+              to_studio(-37.797f * r - 74.203f * g + 112.0f * b, 128);
+          cr_plane[i] =
+              to_studio(112.0f * r - 93.786f * g - 18.214f * b, 128);
+        }
+      }
+      out->write("FRAME\n", 6);
+      out->write((char*)scratch.data(), scratch.size());
+      break;
+    }
+    case SequenceFormat::RAW_RGB: {
+      scratch.resize(size_t(width) * 3);
+      for (uint32_t row = height; row-- > 0;) {
+        const Rgba* px = frame.data() + size_t(row) * width;
+        for (uint32_t x = 0; linear_blending && x < width; x++) {
+          scratch[3 * size_t(x) + 0] = linear_to_srgb8(px[x].r);
+          scratch[3 * size_t(x) + 1] = linear_to_srgb8(px[x].g);
+          scratch[3 * size_t(x) + 2] = linear_to_srgb8(px[x].b);
+        }
+        for (uint32_t x = 0; !linear_blending && x < width; x++) {
+          scratch[3 * size_t(x) + 0] = px[x].r * 255.0;
+          scratch[3 * size_t(x) + 1] = px[x].g * 255.0;
+          scratch[3 * size_t(x) + 2] = px[x].b * 255.0;
+        }
+        out->write((char*)scratch.data(), scratch.size());
+      }
+      break;
+    }
+    case SequenceFormat::BMP_FILES: {
+      std::vector<char> name(file_path.size() + 32);
+      std::snprintf(name.data(), name.size(), file_path.c_str(), int(index));
+
+      auto f = std::ofstream(name.data(), std::ios::binary);
+      if (!f.is_open()) {
+        std::cerr << "Could not open file " << name.data() << "\n";
+        exit(1);
+      }
+      write_bmp_header(f, width, height);
+      for (uint32_t y = 0; y < height; y++) {
+        write_bmp_row(f, frame.data() + size_t(y) * width, width, scratch,
+                      linear_blending);
+      }
+      if (!f) {
+        std::cerr << "Error writing to file " << name.data() << "\n";
+        exit(1);
+      }
+      break;
+    }
+  }
+}
+
+}  // namespace Canvas
@@ -1,26 +1,34 @@
+#include <algorithm>
 #include <cmath>
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
 #include "canvas.h"
 
 namespace Canvas {
 
-Vec2::Vec2(float x, float y) : x(x), y(y) {}
-Vec2::Vec2(float t) : x(t), y(t) {}
-
-Vec2 Vec2::operator+(const Vec2& other) const {
-  return Vec2(x + other.x, y + other.y);
-}
+const std::array<uint16_t, 256> SRGB8_TO_LINEAR12 = [] {
+  std::array<uint16_t, 256> table;
+  for (uint32_t i = 0; i < table.size(); i++) {
+    double v = i / 255.0;
+    v = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+    table[i] = uint16_t(std::lround(v * 4095.0));
+  }
+  return table;
+}();
 
-Vec2 Vec2::operator-(const Vec2& other) const {
-  return Vec2(x - other.x, y - other.y);
-}
+const std::array<uint8_t, 4096> LINEAR12_TO_SRGB8 = [] {
+  std::array<uint8_t, 4096> table;
+  for (uint32_t i = 0; i < table.size(); i++) {
+    double v = i / 4095.0;
+    v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+    table[i] = uint8_t(std::lround(v * 255.0));
+  }
+  return table;
+}();
 
-Vec2 Vec2::operator*(float t) const { return Vec2(x * t, y * t); }
-Vec2 Vec2::operator/(float t) const { return Vec2(x / t, y / t); }
-
-float Vec2::dot(const Vec2& a, const Vec2& b) { return a.x * b.x + a.y * b.y; }
-
-float Vec2::len_squared() const { return Vec2::dot(*this, *this); }
 float Vec2::len() const { return std::sqrt(Vec2::dot(*this, *this)); }
 Vec2 Vec2::normalize() const { return *this / len(); }
 
@@ -30,18 +38,239 @@ std::ostream& operator<<(std::ostream& out, const Vec2& v) {
 }
 
 Vec2 Viewport::convert(const Viewport& from, const Viewport& to, Vec2 pt) {
-  float u = (pt.x - from.left) / (from.right - from.left);
-  float v = (pt.y - from.bottom) / (from.top - from.bottom);
-
-  return Vec2(u * (to.right - to.left) + to.left,
-              v * (to.top - to.bottom) + to.bottom);
+  return Transform2D::between(from, to).apply(pt);
 }
 
 float Viewport::convert(const Viewport& from, const Viewport& to, float len) {
-  float u = len / (from.right - from.left);
-  float v = len / (from.top - from.bottom);
+  return Transform2D::between(from, to).apply_length(len);
+}
+
+Transform2D Transform2D::between(const Viewport& from, const Viewport& to) {
+  Vec2 scale((to.right - to.left) / (from.right - from.left),
+             (to.top - to.bottom) / (from.top - from.bottom));
+  return Transform2D{
+      .scale = scale,
+      .offset = Vec2(to.left - from.left * scale.x,
+                     to.bottom - from.bottom * scale.y),
+  };
+}
+
+void Transform2D::apply(const Vec2* in, Vec2* out, size_t count) const {
+  size_t i = 0;
+#ifdef __SSE2__
+  // Vec2 is two packed floats, so one register holds two points.
+  __m128 s = _mm_setr_ps(scale.x, scale.y, scale.x, scale.y);
+  __m128 o = _mm_setr_ps(offset.x, offset.y, offset.x, offset.y);
+  for (; i + 2 <= count; i += 2) {
+    __m128 p = _mm_loadu_ps(&in[i].x);
+    _mm_storeu_ps(&out[i].x, _mm_add_ps(_mm_mul_ps(p, s), o));
+  }
+#endif
+  for (; i < count; i++) out[i] = apply(in[i]);
+}
+
+uint32_t circle_segments(float radius_px) {
+  if (radius_px <= 0.25f) return 8;
+  float angle = 2.0f * std::acos(1.0f - 0.25f / radius_px);
+  return std::clamp(uint32_t(std::ceil(2.0 * M_PI / angle)), 8u, 256u);
+}
+
+static float signed_area(const std::vector<Vec2>& contour) {
+  float area = 0.0f;
+  for (size_t i = 0; i < contour.size(); i++) {
+    const Vec2& a = contour[i];
+    const Vec2& b = contour[(i + 1) % contour.size()];
+    area += a.x * b.y - b.x * a.y;
+  }
+  return area * 0.5f;
+}
+
+std::vector<std::vector<Vec2>> stroke_outline(const std::vector<Vec2>& points,
+                                              float thickness, LineJoin join,
+                                              uint32_t round_segments) {
+  std::vector<Vec2> pts;
+  for (const auto& p : points) {
+    if (pts.empty() || p.x != pts.back().x || p.y != pts.back().y)
+      pts.push_back(p);
+  }
+
+  std::vector<std::vector<Vec2>> contours;
+  if (pts.empty() || thickness <= 0.0f) return contours;
+
+  auto add_circle = [&](Vec2 center) {
+    std::vector<Vec2> circle;
+    circle.reserve(round_segments);
+    for (uint32_t i = 0; i < round_segments; i++) {
+      float t = 2.0 * M_PI * i / round_segments;
+      circle.push_back(center + Vec2(std::cos(t), std::sin(t)) * thickness);
+    }
+    contours.push_back(std::move(circle));
+  };
+  auto add_ccw = [&](std::vector<Vec2> contour) {
+    float area = signed_area(contour);
+    if (area == 0.0f) return;
+    if (area < 0.0f) std::reverse(contour.begin(), contour.end());
+    contours.push_back(std::move(contour));
+  };
+
+  add_circle(pts.front());
+  if (pts.size() > 1) add_circle(pts.back());
+
+  for (size_t i = 0; i + 1 < pts.size(); i++) {
+    Vec2 a = pts[i], b = pts[i + 1];
+    Vec2 dir = (b - a).normalize();
+    Vec2 n = Vec2(-dir.y, dir.x) * thickness;
+    contours.push_back({a - n, b - n, b + n, a + n});
+  }
+
+  for (size_t i = 1; i + 1 < pts.size(); i++) {
+    if (join == LineJoin::ROUND) {
+      add_circle(pts[i]);
+      continue;
+    }
+
+    Vec2 d0 = (pts[i] - pts[i - 1]).normalize();
+    Vec2 d1 = (pts[i + 1] - pts[i]).normalize();
+    float cross = d0.x * d1.y - d0.y * d1.x;
+    if (cross == 0.0f) {
+      // Turning back on itself leaves nothing to bevel, cap it instead.
+      if (Vec2::dot(d0, d1) < 0.0f) add_circle(pts[i]);
+      continue;
+    }
+
+    // The gap to fill is on the outside of the turn.
+    float side = cross > 0.0f ? -1.0f : 1.0f;
+    Vec2 o0 = Vec2(-d0.y, d0.x) * (thickness * side);
+    Vec2 o1 = Vec2(-d1.y, d1.x) * (thickness * side);
+
+    Vec2 bisector = (o0 + o1).normalize();
+    float cos_half = Vec2::dot(bisector, o0) / thickness;
+    if (join == LineJoin::MITER && cos_half > 0.25f) {
+      Vec2 miter = pts[i] + bisector * (thickness / cos_half);
+      add_ccw({pts[i], pts[i] + o0, miter, pts[i] + o1});
+    } else {
+      add_ccw({pts[i], pts[i] + o0, pts[i] + o1});
+    }
+  }
+
+  return contours;
+}
+
+uint32_t bezier_segments(const Bezier& b, Vec2 scale, float tolerance_px) {
+  float max_diff = 0.0f;
+  for (uint32_t i = 0; i + 2 <= b.degree; i++) {
+    Vec2 d = b.points[i] - b.points[i + 1] * 2.0f + b.points[i + 2];
+    max_diff = std::max(max_diff, Vec2(d.x * scale.x, d.y * scale.y).len());
+  }
+
+  float n = std::ceil(std::sqrt(float(b.degree * (b.degree - 1)) * max_diff /
+                                (8.0f * tolerance_px)));
+  if (!(n >= 1.0f)) return 1;
+  return std::min(n, 1024.0f);
+}
+
+std::vector<Vec2> flatten_bezier(const Bezier& b, uint32_t segments) {
+  std::vector<Vec2> out;
+  out.reserve(segments + 1);
+  out.push_back(b.points[0]);
+
+  for (uint32_t i = 1; i < segments; i++) {
+    float t = float(i) / float(segments), u = 1.0f - t;
+    if (b.degree == 2) {
+      out.push_back(b.points[0] * (u * u) + b.points[1] * (2.0f * u * t) +
+                    b.points[2] * (t * t));
+    } else {
+      out.push_back(b.points[0] * (u * u * u) +
+                    b.points[1] * (3.0f * u * u * t) +
+                    b.points[2] * (3.0f * u * t * t) +
+                    b.points[3] * (t * t * t));
+    }
+  }
+
+  out.push_back(b.points[b.degree]);
+  return out;
+}
+
+bool is_x_monotonic(const std::vector<Vec2>& points) {
+  bool increasing = true, decreasing = true;
+  for (size_t i = 1; i < points.size(); i++) {
+    increasing &= points[i].x >= points[i - 1].x;
+    decreasing &= points[i].x <= points[i - 1].x;
+  }
+  return increasing || decreasing;
+}
+
+std::vector<Vec2> decimate_m4(const std::vector<Vec2>& points,
+                              const Transform2D& to_pixels) {
+  std::vector<Vec2> out;
+  size_t begin = 0;
+  while (begin < points.size()) {
+    float column = std::floor(to_pixels.apply(points[begin]).x);
+    size_t end = begin + 1, low = begin, high = begin;
+    for (; end < points.size() &&
+           std::floor(to_pixels.apply(points[end]).x) == column;
+         end++) {
+      if (points[end].y < points[low].y) low = end;
+      if (points[end].y > points[high].y) high = end;
+    }
+
+    std::array<size_t, 4> keep = {begin, low, high, end - 1};
+    std::sort(keep.begin(), keep.end());
+    for (size_t i = 0; i < keep.size(); i++) {
+      if (i == 0 || keep[i] != keep[i - 1]) out.push_back(points[keep[i]]);
+    }
+    begin = end;
+  }
+  return out;
+}
+
+std::vector<Vec2> simplify_polyline(const std::vector<Vec2>& points,
+                                    const Transform2D& to_pixels,
+                                    float tolerance_px) {
+  if (points.size() < 3) return points;
+  std::vector<Vec2> pixels(points.size(), Vec2(0.0f));
+  to_pixels.apply(points.data(), pixels.data(), points.size());
+
+  // Ranges still to split, iterative so long paths cannot overflow the
+  // stack.
+  std::vector<bool> keep(points.size(), false);
+  keep.front() = keep.back() = true;
+  std::vector<std::pair<size_t, size_t>> ranges = {{0, points.size() - 1}};
+  float tolerance_squared = tolerance_px * tolerance_px;
+
+  while (!ranges.empty()) {
+    auto [a, b] = ranges.back();
+    ranges.pop_back();
+    Vec2 d = pixels[b] - pixels[a];
+    float len_squared = d.len_squared();
+
+    float farthest = 0.0f;
+    size_t index = a;
+    for (size_t i = a + 1; i < b; i++) {
+      // Distance to the segment, so points past its ends count as well.
+      Vec2 v = pixels[i] - pixels[a];
+      float t = len_squared > 0.0f
+                    ? std::clamp(Vec2::dot(v, d) / len_squared, 0.0f, 1.0f)
+                    : 0.0f;
+      float dist = (v - d * t).len_squared();
+      if (dist > farthest) {
+        farthest = dist;
+        index = i;
+      }
+    }
+
+    if (farthest > tolerance_squared) {
+      keep[index] = true;
+      ranges.emplace_back(a, index);
+      ranges.emplace_back(index, b);
+    }
+  }
 
-  return (u * (to.right - to.left) + v * (to.top - to.bottom)) * 0.5;
+  std::vector<Vec2> out;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (keep[i]) out.push_back(points[i]);
+  }
+  return out;
 }
 
 bool Viewport::contains(const Vec2& pt) {
@@ -52,4 +281,42 @@ bool operator==(const Rgba& a, const Rgba& b) {
   return a.a == b.a && a.r == b.r && a.g == b.g && a.b == b.b;
 }
 
+template <typename T, typename = void>
+struct has_blend : std::false_type {};
+template <typename T>
+struct has_blend<T, std::void_t<decltype(T::blend)>> : std::true_type {};
+
+BlendMode primitive_blend_mode(const Primitive& p) {
+  return std::visit(
+      [](const auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (has_blend<T>::value) {
+          return v.blend;
+        } else {
+          return BlendMode::OVER;
+        }
+      },
+      p);
+}
+
+Rgba blend_colors(BlendMode mode, const Rgba& top, const Rgba& bottom) {
+  switch (mode) {
+    case BlendMode::OVER:
+      return blend_colors<BlendMode::OVER>(top, bottom);
+    case BlendMode::REPLACE:
+      return blend_colors<BlendMode::REPLACE>(top, bottom);
+    case BlendMode::ADD:
+      return blend_colors<BlendMode::ADD>(top, bottom);
+    case BlendMode::MULTIPLY:
+      return blend_colors<BlendMode::MULTIPLY>(top, bottom);
+    case BlendMode::MAX:
+      return blend_colors<BlendMode::MAX>(top, bottom);
+    case BlendMode::MIN:
+      return blend_colors<BlendMode::MIN>(top, bottom);
+    case BlendMode::ERASE:
+      return blend_colors<BlendMode::ERASE>(top, bottom);
+  }
+  return top;
+}
+
 }  // namespace Canvas
@@ -1,7 +1,19 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <functional>
+#include <iterator>
+#include <limits>
 
 #include "canvas.h"
+#include "font/font5x7.h"
 #include "shader/circle.h"
+#include "shader/image.h"
+#include "shader/text.h"
 #include "shader/thickline.h"
 #include "shader/triangle.h"
 
@@ -54,72 +66,209 @@ void GLFWCanvas::set_event_callbacks() {
       window, [](GLFWwindow* window, int width, int height) {
         auto self = static_cast<GLFWCanvas*>(glfwGetWindowUserPointer(window));
         GL_CALL(glViewport(0, 0, width, height));
+        self->width = width;
+        self->height = height;
         self->event_queue.push_front(WindowResizeEvent{
             .new_width = (uint32_t)width,
             .new_height = (uint32_t)height,
         });
+        self->request_redraw();
       });
+
+  glfwSetWindowRefreshCallback(window, [](GLFWwindow* window) {
+    static_cast<GLFWCanvas*>(glfwGetWindowUserPointer(window))
+        ->request_redraw();
+  });
 }
 
 static uint32_t compile_shader(const char* src, uint32_t shader_type) {
   uint32_t shader_id = 0;
   GL_CALL(shader_id = glCreateShader(shader_type));
   GL_CALL(glShaderSource(shader_id, 1, &src, nullptr));
+  // The status is only asked for after linking, asking now would wait for
+  // a parallel compile.
   GL_CALL(glCompileShader(shader_id));
+  return shader_id;
+}
 
-  int compile_status = 0;
-  GL_CALL(glGetShaderiv(shader_id, GL_COMPILE_STATUS, &compile_status));
-  if (!compile_status) {
-    int log_length = 0;
-    GL_CALL(glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_length));
-    std::string msg;
-    msg.resize(log_length);
-    GL_CALL(glGetShaderInfoLog(shader_id, log_length, &log_length, msg.data()));
-    std::cerr << WHERE << " Linking error: " << msg << "\n";
+// Attaches freshly compiled shaders and starts linking. The shaders live on
+// until the program is deleted, for their logs.
+static void link_from_source(uint32_t program_id, const char* vert_src,
+                             const char* geom_src, const char* frag_src,
+                             bool retrievable) {
+  std::pair<const char*, uint32_t> stages[] = {
+      {vert_src, GL_VERTEX_SHADER},
+      {frag_src, GL_FRAGMENT_SHADER},
+      {geom_src, GL_GEOMETRY_SHADER},
+  };
+  for (auto [src, type] : stages) {
+    if (src == nullptr) continue;
+    uint32_t shader_id = compile_shader(src, type);
+    GL_CALL(glAttachShader(program_id, shader_id));
+    GL_CALL(glDeleteShader(shader_id));
   }
+  if (retrievable) {
+    GL_CALL(glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE));
+  }
+  GL_CALL(glLinkProgram(program_id));
+}
 
-  return shader_id;
+static std::optional<std::string> program_cache_dir;
+
+void GLFWCanvas::set_program_cache_dir(const std::string& dir) {
+  program_cache_dir = dir;
+}
+
+std::string GLFWCanvas::get_program_cache_dir() {
+  if (program_cache_dir.has_value()) return program_cache_dir.value();
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+    return std::string(xdg) + "/canvas";
+  }
+  if (const char* home = std::getenv("HOME"); home && *home) {
+    return std::string(home) + "/.cache/canvas";
+  }
+  return "";
 }
 
-uint32_t GLFWCanvas::load_shader(const char* vert_src, const char* geom_src,
-                                 const char* frag_src) {
-  std::optional<int> vert_id, geom_id, frag_id;
+// FNV-1a, including the terminating zero so the sources cannot run into
+// each other.
+static uint64_t hash_string(uint64_t hash, const char* s) {
+  if (s == nullptr) s = "";
+  do {
+    hash = (hash ^ uint8_t(*s)) * 1099511628211ull;
+  } while (*s++ != 0);
+  return hash;
+}
 
-  uint32_t program_id = 0;
-  GL_CALL(program_id = glCreateProgram());
-  if (vert_src) {
-    vert_id = compile_shader(vert_src, GL_VERTEX_SHADER);
-    GL_CALL(glAttachShader(program_id, vert_id.value()));
-    GL_CALL(glDeleteShader(vert_id.value()));
+// The cache file holds "CVPB", the binary format and the binary.
+static bool load_program_binary(uint32_t program_id, const std::string& path,
+                                const std::vector<int>& formats) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f.is_open()) return false;
+  std::vector<char> data(std::istreambuf_iterator<char>(f), {});
+  uint32_t format = 0;
+  if (data.size() <= 8 || std::memcmp(data.data(), "CVPB", 4) != 0) {
+    return false;
+  }
+  std::memcpy(&format, data.data() + 4, 4);
+  if (std::find(formats.begin(), formats.end(), int(format)) ==
+      formats.end()) {
+    return false;
   }
-  if (frag_src) {
-    frag_id = compile_shader(frag_src, GL_FRAGMENT_SHADER);
-    GL_CALL(glAttachShader(program_id, frag_id.value()));
-    GL_CALL(glDeleteShader(frag_id.value()));
+  GL_CALL(glProgramBinary(program_id, format, data.data() + 8,
+                          data.size() - 8));
+  return true;
+}
+
+// Failures only cost the next process a compile, so they are ignored. The
+// file appears under its name complete or not at all, as other processes
+// may be reading the cache.
+static void store_program_binary(uint32_t program_id,
+                                 const std::string& path) {
+  int length = 0;
+  GL_CALL(glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &length));
+  if (length <= 0) return;
+  std::vector<char> data(8 + length);
+  GLenum format = 0;
+  GL_CALL(glGetProgramBinary(program_id, length, &length, &format,
+                             data.data() + 8));
+  std::memcpy(data.data(), "CVPB", 4);
+  uint32_t format32 = format;
+  std::memcpy(data.data() + 4, &format32, 4);
+
+  std::error_code error;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), error);
+  std::string temp_path = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream f(temp_path, std::ios::binary);
+    f.write(data.data(), 8 + length);
+    if (!f) {
+      f.close();
+      std::remove(temp_path.c_str());
+      return;
+    }
   }
-  if (geom_src) {
-    geom_id = compile_shader(geom_src, GL_GEOMETRY_SHADER);
-    GL_CALL(glAttachShader(program_id, geom_id.value()));
-    GL_CALL(glDeleteShader(geom_id.value()));
+  if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
   }
+}
 
-  GL_CALL(glLinkProgram(program_id));
-  GL_CALL(glValidateProgram(program_id));
+GLFWCanvas::PendingProgram GLFWCanvas::start_program(const char* vert_src,
+                                                     const char* geom_src,
+                                                     const char* frag_src) {
+  PendingProgram program{
+      .vert_source = vert_src,
+      .geometry_source = geom_src,
+      .frag_source = frag_src,
+  };
+  GL_CALL(program.id = glCreateProgram());
+
+  std::string dir = get_program_cache_dir();
+  if (!program_binary_formats.empty() && !dir.empty()) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* s : {driver_id.c_str(), vert_src, geom_src, frag_src}) {
+      hash = hash_string(hash, s);
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bin",
+                  (unsigned long long)hash);
+    program.cache_path = dir + name;
+    program.from_cache = load_program_binary(program.id, program.cache_path,
+                                             program_binary_formats);
+  }
+
+  if (!program.from_cache) {
+    link_from_source(program.id, vert_src, geom_src, frag_src,
+                     !program.cache_path.empty());
+  }
+  return program;
+}
+
+uint32_t GLFWCanvas::finish_program(PendingProgram& program) {
   int status = 0;
-  GL_CALL(glGetProgramiv(program_id, GL_LINK_STATUS, &status));
+  GL_CALL(glGetProgramiv(program.id, GL_LINK_STATUS, &status));
+  if (status != GL_TRUE && program.from_cache) {
+    // Drivers refuse binaries of another build, this one gets replaced.
+    program.from_cache = false;
+    link_from_source(program.id, program.vert_source, program.geometry_source,
+                     program.frag_source, true);
+    GL_CALL(glGetProgramiv(program.id, GL_LINK_STATUS, &status));
+  }
+
   if (status != GL_TRUE) {
+    std::array<uint32_t, 3> shader_ids = {0};
+    int shader_count = 0;
+    GL_CALL(glGetAttachedShaders(program.id, shader_ids.size(), &shader_count,
+                                 shader_ids.data()));
+    for (int i = 0; i < shader_count; i++) {
+      int compile_status = 0;
+      GL_CALL(
+          glGetShaderiv(shader_ids[i], GL_COMPILE_STATUS, &compile_status));
+      if (compile_status) continue;
+      int log_length = 0;
+      GL_CALL(glGetShaderiv(shader_ids[i], GL_INFO_LOG_LENGTH, &log_length));
+      std::string msg;
+      msg.resize(log_length);
+      GL_CALL(glGetShaderInfoLog(shader_ids[i], log_length, &log_length,
+                                 msg.data()));
+      std::cerr << WHERE << " Compile error: " << msg << "\n";
+    }
+
     int log_length = 0;
-    GL_CALL(glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &log_length));
+    GL_CALL(glGetProgramiv(program.id, GL_INFO_LOG_LENGTH, &log_length));
     std::string msg;
     msg.resize(log_length);
     GL_CALL(
-        glGetProgramInfoLog(program_id, log_length, &log_length, msg.data()));
+        glGetProgramInfoLog(program.id, log_length, &log_length, msg.data()));
     std::cerr << WHERE << " Linking error: " << msg << "\n";
+  } else if (!program.from_cache && !program.cache_path.empty()) {
+    store_program_binary(program.id, program.cache_path);
   }
 
-  GL_CALL(glUseProgram(program_id));
-
-  return program_id;
+  GL_CALL(glUseProgram(program.id));
+  return program.id;
 }
 
 void GLFWCanvas::error_callback(int error, const char* error_message) {
@@ -127,17 +276,19 @@ void GLFWCanvas::error_callback(int error, const char* error_message) {
             << "\n";
 }
 
-void GLFWCanvas::set_viewport(Viewport new_viewport) {
+void GLFWCanvas::wake() { glfwPostEmptyEvent(); }
+
+void GLFWCanvas::begin_frame(const Viewport& frame_viewport) {
+  this->frame_viewport = frame_viewport;
   float near = 0.0f, far = 1.0f;
-  WindowCanvas::set_viewport(new_viewport);
 
-  mvp[0] = 2.0f / (viewport.right - viewport.left);
+  mvp[0] = 2.0f / (frame_viewport.right - frame_viewport.left);
   mvp[1] = 0.0f;
   mvp[2] = 0.0f;
   mvp[3] = 0.0f;
 
   mvp[4] = 0.0f;
-  mvp[5] = 2.0f / (viewport.top - viewport.bottom);
+  mvp[5] = 2.0f / (frame_viewport.top - frame_viewport.bottom);
   mvp[6] = 0.0f;
   mvp[7] = 0.0f;
 
@@ -146,17 +297,22 @@ void GLFWCanvas::set_viewport(Viewport new_viewport) {
   mvp[10] = 2.0f / (near - far);
   mvp[11] = 0.0f;
 
-  mvp[12] = (viewport.right + viewport.left) / (viewport.left - viewport.right);
-  mvp[13] = (viewport.top + viewport.bottom) / (viewport.bottom - viewport.top);
+  mvp[12] = (frame_viewport.right + frame_viewport.left) /
+            (frame_viewport.left - frame_viewport.right);
+  mvp[13] = (frame_viewport.top + frame_viewport.bottom) /
+            (frame_viewport.bottom - frame_viewport.top);
   mvp[14] = (far + near) / (near - far);
   mvp[15] = 1.0f;
 
   GL_CALL(glUseProgram(shaders[TRIANGLE]));
   GL_CALL(glUniformMatrix4fv(umvps[TRIANGLE], 1, GL_FALSE, mvp.data()));
-  GL_CALL(glUseProgram(shaders[CIRCLE]));
-  GL_CALL(glUniformMatrix4fv(umvps[CIRCLE], 1, GL_FALSE, mvp.data()));
-  GL_CALL(glUseProgram(shaders[THICK_LINE]));
-  GL_CALL(glUniformMatrix4fv(umvps[THICK_LINE], 1, GL_FALSE, mvp.data()));
+  for (size_t program : {CIRCLE, THICK_LINE, TEXT}) {
+    GL_CALL(glUseProgram(shaders[program]));
+    GL_CALL(glUniformMatrix4fv(umvps[program], 1, GL_FALSE, mvp.data()));
+    GL_CALL(glUniform2f(uviewport_sizes[program], width, height));
+  }
+  GL_CALL(glUseProgram(shaders[IMAGE]));
+  GL_CALL(glUniformMatrix4fv(umvps[IMAGE], 1, GL_FALSE, mvp.data()));
 }
 
 GLFWCanvas::GLFWCanvas(uint32_t width, uint32_t height,
@@ -164,12 +320,15 @@ GLFWCanvas::GLFWCanvas(uint32_t width, uint32_t height,
                        std::shared_ptr<WindowHandler>&& handler,
                        Viewport viewport)
     : WindowCanvas(std::move(handler), viewport), width(width), height(height) {
+  event_width = width;
+  event_height = height;
   ASSERT(glfwInit(), == true);
   glfwSetErrorCallback(GLFWCanvas::error_callback);
 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_SAMPLES, 4);
+  glfwWindowHint(GLFW_STENCIL_BITS, 8);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
   ASSERT((window =
@@ -189,16 +348,58 @@ GLFWCanvas::GLFWCanvas(uint32_t width, uint32_t height,
 
   GL_CALL(glEnable(GL_MULTISAMPLE));
 
-  GL_CALL(glGenVertexArrays(4, vaos.data()));
-  GL_CALL(glGenBuffers(4, vbos.data()));
+  for (uint32_t name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char* s = nullptr;
+    GL_CALL(s = (const char*)glGetString(name));
+    driver_id += std::string(s ? s : "") + "\n";
+  }
+  // Program binaries are core from GL 4.1, the 3.3 context only has them
+  // with the extension. Without either the cache stays off.
+  int major = 0, minor = 0;
+  GL_CALL(glGetIntegerv(GL_MAJOR_VERSION, &major));
+  GL_CALL(glGetIntegerv(GL_MINOR_VERSION, &minor));
+  if (major > 4 || (major == 4 && minor >= 1) ||
+      glfwExtensionSupported("GL_ARB_get_program_binary")) {
+    int format_count = 0;
+    GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count));
+    program_binary_formats.resize(format_count);
+    GL_CALL(glGetIntegerv(GL_PROGRAM_BINARY_FORMATS,
+                          program_binary_formats.data()));
+  }
+  // The extension defaults to as many compiler threads as the driver likes,
+  // asking is for drivers that start out with none.
+  if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+    typedef void(APIENTRY* MaxShaderCompilerThreads)(GLuint);
+    auto set_threads = (MaxShaderCompilerThreads)glfwGetProcAddress(
+        "glMaxShaderCompilerThreadsKHR");
+    if (set_threads != nullptr) {
+      GL_CALL(set_threads(0xffffffff));
+    }
+  }
+
+  // Started together, so parallel compilation builds them while the buffers
+  // and the glyph atlas are set up.
+  std::array<PendingProgram, 6> pending;
+  pending[TRIANGLE] = start_program(triangle_shader_vert_source, nullptr,
+                                    triangle_shader_frag_source);
+  pending[CIRCLE] = start_program(circle_shader_vert_source, nullptr,
+                                  circle_shader_frag_source);
+  pending[THICK_LINE] = start_program(thick_line_shader_vert_source, nullptr,
+                                      thick_line_shader_frag_source);
+  pending[TEXT] = start_program(text_shader_vert_source, nullptr,
+                                text_shader_frag_source);
+  pending[IMAGE] = start_program(image_shader_vert_source, nullptr,
+                                 image_shader_frag_source);
+
+  GL_CALL(glGenVertexArrays(6, vaos.data()));
+  GL_CALL(glGenBuffers(6, vbos.data()));
 
   GL_CALL(glBindVertexArray(vaos[TRIANGLE]));
   GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[TRIANGLE]));
   GL_CALL(glEnableVertexAttribArray(0));
   GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
                                 nullptr));
-  shaders[TRIANGLE] = load_shader(triangle_shader_vert_source, nullptr,
-                                  triangle_shader_frag_source);
+  shaders[TRIANGLE] = finish_program(pending[TRIANGLE]);
   GL_CALL(
       ASSERT(umvps[TRIANGLE] = glGetUniformLocation(shaders[TRIANGLE], "uMVP"),
              != -1));
@@ -206,60 +407,174 @@ GLFWCanvas::GLFWCanvas(uint32_t width, uint32_t height,
       ucolors[TRIANGLE] = glGetUniformLocation(shaders[TRIANGLE], "uColor"),
       != -1));
 
-  GL_CALL(glBindVertexArray(vaos[CIRCLE]));
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[CIRCLE]));
-  GL_CALL(glEnableVertexAttribArray(0));
-  GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                                nullptr));
-  GL_CALL(glEnableVertexAttribArray(1));
-  GL_CALL(glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
-                                (void*)(2 * sizeof(float))));
-  shaders[CIRCLE] =
-      load_shader(circle_shader_vert_source, circle_shader_geom_source,
-                  circle_shader_frag_source);
+  // Circles, thick lines and glyphs share a unit quad, everything else comes
+  // from per instance attributes.
+  std::array<float, 8> quad = {-1.0f, -1.0f, 1.0f, -1.0f,
+                               -1.0f, 1.0f,  1.0f, 1.0f};
+  GL_CALL(glGenBuffers(1, &quad_vbo));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, quad_vbo));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, quad.size() * sizeof(quad[0]),
+                       quad.data(), GL_STATIC_DRAW));
+
+  auto setup_instanced = [&](size_t program,
+                             std::initializer_list<int> attribute_sizes) {
+    GL_CALL(glBindVertexArray(vaos[program]));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, quad_vbo));
+    GL_CALL(glEnableVertexAttribArray(0));
+    GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float),
+                                  nullptr));
+
+    int stride = 0;
+    for (int size : attribute_sizes) stride += size;
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[program]));
+    int location = 1, offset = 0;
+    for (int size : attribute_sizes) {
+      GL_CALL(glEnableVertexAttribArray(location));
+      GL_CALL(glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE,
+                                    stride * sizeof(float),
+                                    (void*)(offset * sizeof(float))));
+      GL_CALL(glVertexAttribDivisor(location, 1));
+      location++;
+      offset += size;
+    }
+  };
+
+  setup_instanced(CIRCLE, {3, 4});
+  shaders[CIRCLE] = finish_program(pending[CIRCLE]);
   GL_CALL(ASSERT(umvps[CIRCLE] = glGetUniformLocation(shaders[CIRCLE], "uMVP"),
                  != -1));
+  GL_CALL(ASSERT(uviewport_sizes[CIRCLE] =
+                     glGetUniformLocation(shaders[CIRCLE], "uViewportSize"),
+                 != -1));
+
+  setup_instanced(THICK_LINE, {4, 1, 4});
+  shaders[THICK_LINE] = finish_program(pending[THICK_LINE]);
+  GL_CALL(ASSERT(
+      umvps[THICK_LINE] = glGetUniformLocation(shaders[THICK_LINE], "uMVP"),
+      != -1));
+  GL_CALL(ASSERT(uviewport_sizes[THICK_LINE] = glGetUniformLocation(
+                     shaders[THICK_LINE], "uViewportSize"),
+                 != -1));
+
+  setup_instanced(TEXT, {2, 4, 4});
+  shaders[TEXT] = finish_program(pending[TEXT]);
+  GL_CALL(ASSERT(umvps[TEXT] = glGetUniformLocation(shaders[TEXT], "uMVP"),
+                 != -1));
+  GL_CALL(ASSERT(uviewport_sizes[TEXT] =
+                     glGetUniformLocation(shaders[TEXT], "uViewportSize"),
+                 != -1));
+  GL_CALL(glUniform1i(glGetUniformLocation(shaders[TEXT], "uAtlas"), 0));
+  GL_CALL(glUniform2f(glGetUniformLocation(shaders[TEXT], "uAtlasCells"),
+                      std::size(font5x7), 1.0f));
+
+  // The atlas holds every character at its font resolution, magnified
+  // without filtering so small text stays as sharp as on the CPU canvases.
+  constexpr uint32_t cell_w = TEXT_CELL_WIDTH + 2,
+                     cell_h = TEXT_CELL_HEIGHT + 2;
+  uint32_t atlas_w = cell_w * std::size(font5x7);
+  std::vector<uint8_t> atlas(size_t(atlas_w) * cell_h, 0);
+  for (size_t i = 0; i < std::size(font5x7); i++) {
+    for (uint32_t y = 0; y < 7; y++) {
+      for (uint32_t x = 0; x < 5; x++) {
+        if ((font5x7[i][y] >> (4 - x)) & 1) {
+          atlas[size_t(y + 1) * atlas_w + i * cell_w + x + 1] = 255;
+        }
+      }
+    }
+  }
+  GL_CALL(glGenTextures(1, &glyph_atlas));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, glyph_atlas));
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas_w, cell_h, 0, GL_RED,
+                       GL_UNSIGNED_BYTE, atlas.data()));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
   GL_CALL(
-      ASSERT(ucolors[CIRCLE] = glGetUniformLocation(shaders[CIRCLE], "uColor"),
-             != -1));
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
-  GL_CALL(glBindVertexArray(vaos[THICK_LINE]));
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[THICK_LINE]));
+  GL_CALL(glBindVertexArray(vaos[IMAGE]));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[IMAGE]));
   GL_CALL(glEnableVertexAttribArray(0));
-  GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+  GL_CALL(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
                                 nullptr));
   GL_CALL(glEnableVertexAttribArray(1));
-  GL_CALL(glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+  GL_CALL(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
                                 (void*)(2 * sizeof(float))));
-  shaders[THICK_LINE] =
-      load_shader(thick_line_shader_vert_source, thick_line_shader_geom_source,
-                  thick_line_shader_frag_source);
-  GL_CALL(ASSERT(
-      umvps[THICK_LINE] = glGetUniformLocation(shaders[THICK_LINE], "uMVP"),
-      != -1));
-  GL_CALL(ASSERT(
-      ucolors[THICK_LINE] = glGetUniformLocation(shaders[THICK_LINE], "uColor"),
-      != -1));
+  shaders[IMAGE] = finish_program(pending[IMAGE]);
+  GL_CALL(ASSERT(umvps[IMAGE] = glGetUniformLocation(shaders[IMAGE], "uMVP"),
+                 != -1));
+  GL_CALL(glUniform1i(glGetUniformLocation(shaders[IMAGE], "uImage"), 0));
 
-  set_viewport(viewport);
   GL_CALL(glViewport(0, 0, width, height));
 }
 
 GLFWCanvas::~GLFWCanvas() {
+  set_threaded(false);
+
   GL_CALL(glDeleteProgram(shaders[TRIANGLE]));
-  GL_CALL(glDeleteVertexArrays(4, vaos.data()));
-  GL_CALL(glDeleteBuffers(4, vbos.data()));
+  GL_CALL(glDeleteProgram(shaders[CIRCLE]));
+  GL_CALL(glDeleteProgram(shaders[THICK_LINE]));
+  GL_CALL(glDeleteProgram(shaders[TEXT]));
+  GL_CALL(glDeleteProgram(shaders[IMAGE]));
+  GL_CALL(glDeleteVertexArrays(6, vaos.data()));
+  GL_CALL(glDeleteBuffers(6, vbos.data()));
+  GL_CALL(glDeleteBuffers(1, &quad_vbo));
+  GL_CALL(glDeleteTextures(1, &glyph_atlas));
+  if (static_msaa_fbo != 0) {
+    GL_CALL(glDeleteFramebuffers(1, &static_msaa_fbo));
+    GL_CALL(glDeleteFramebuffers(1, &static_fbo));
+    GL_CALL(glDeleteRenderbuffers(1, &static_color_rb));
+    GL_CALL(glDeleteRenderbuffers(1, &static_stencil_rb));
+    GL_CALL(glDeleteTextures(1, &static_texture));
+  }
+  for (auto& [id, entry] : image_textures) {
+    GL_CALL(glDeleteTextures(1, &entry.texture));
+  }
 
   glfwDestroyWindow(window);
   glfwTerminate();
 }
 
 void GLFWCanvas::display() {
+  double last_frame = -std::numeric_limits<double>::infinity();
+
   while (!glfwWindowShouldClose(window) && !has_quit()) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    update();
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    if (get_redraw_mode() == RedrawMode::CONTINUOUS) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+              GL_STENCIL_BUFFER_BIT);
+      update();
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+      continue;
+    }
+
+    process_events();
+    if (has_quit()) break;
+
+    double timeout = get_idle_timeout();
+    if (needs_redraw()) {
+      float fps = get_max_frame_rate();
+      double now = glfwGetTime();
+      double next_frame = fps > 0.0f ? last_frame + 1.0 / fps : now;
+      if (now >= next_frame) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+                GL_STENCIL_BUFFER_BIT);
+        render();
+        glfwSwapBuffers(window);
+        last_frame = now;
+        glfwPollEvents();
+        continue;
+      }
+      timeout = next_frame - now;
+    }
+
+    if (timeout > 0.0) {
+      glfwWaitEventsTimeout(timeout);
+    } else {
+      glfwWaitEvents();
+    }
   }
 }
 
@@ -283,31 +598,318 @@ void GLFWCanvas::draw_primitive(const Line& l) {
                          pts.data(), GL_DYNAMIC_DRAW));
     GL_CALL(glDrawArrays(GL_LINES, 0, pts.size() / 2));
   } else {
-    std::array<float, 6> pts = {l.start.x, l.start.y, l.thickness,
-                                l.end.x,   l.end.y,   l.thickness};
-
-    GL_CALL(glUseProgram(shaders[THICK_LINE]));
-    GL_CALL(glUniform4f(ucolors[THICK_LINE], l.color.r, l.color.g, l.color.b,
-                        l.color.a));
-    GL_CALL(glBindVertexArray(vaos[THICK_LINE]));
-    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[THICK_LINE]));
-    GL_CALL(glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(pts[0]),
-                         pts.data(), GL_DYNAMIC_DRAW));
-    GL_CALL(glDrawArrays(GL_LINES, 0, pts.size() / 3));
+    if (!circle_instances.empty() || !text_instances.empty()) {
+      flush_instances();
+    }
+    line_instances.insert(line_instances.end(),
+                          {l.start.x, l.start.y, l.end.x, l.end.y, l.thickness,
+                           l.color.r, l.color.g, l.color.b, l.color.a});
   }
 }
 
 void GLFWCanvas::draw_primitive(const Circle& c) {
-  std::array<float, 3> pts = {c.origin.x, c.origin.y, c.radius};
+  if (!line_instances.empty() || !text_instances.empty()) flush_instances();
+  circle_instances.insert(circle_instances.end(),
+                          {c.origin.x, c.origin.y, c.radius, c.color.r,
+                           c.color.g, c.color.b, c.color.a});
+}
 
-  GL_CALL(glUseProgram(shaders[CIRCLE]));
-  GL_CALL(
-      glUniform4f(ucolors[CIRCLE], c.color.r, c.color.g, c.color.b, c.color.a));
-  GL_CALL(glBindVertexArray(vaos[CIRCLE]));
-  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[CIRCLE]));
-  GL_CALL(glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(pts[0]), pts.data(),
-                       GL_DYNAMIC_DRAW));
-  GL_CALL(glDrawArrays(GL_POINTS, 0, pts.size() / 3));
+void GLFWCanvas::draw_primitive(const Text& t) {
+  if (!circle_instances.empty() || !line_instances.empty()) flush_instances();
+
+  float line = 0.0f, column = 0.0f;
+  for (char c : t.text) {
+    if (c == '\n') {
+      line++;
+      column = 0.0f;
+      continue;
+    }
+    if (c != ' ') {
+      if (c < font5x7_first || c > font5x7_last) c = '?';
+      text_instances.insert(text_instances.end(),
+                            {t.origin.x, t.origin.y, t.size, column, line,
+                             float(c - font5x7_first), t.color.r, t.color.g,
+                             t.color.b, t.color.a});
+    }
+    column++;
+  }
+}
+
+void GLFWCanvas::draw_primitives(const std::list<Primitive>& list) {
+  draw_range(list.begin(), list.end());
+  evict_image_textures();
+}
+
+void GLFWCanvas::draw_range(std::list<Primitive>::const_iterator begin,
+                            std::list<Primitive>::const_iterator end) {
+  for (auto it = begin; it != end; ++it) {
+    // Anything but another instance of the pending kind has to be drawn
+    // after the pending instances, and so do primitives blending otherwise.
+    BlendMode mode = primitive_blend_mode(*it);
+    if (mode != gl_blend) {
+      flush_instances();
+      set_gl_blend(mode);
+    }
+    auto line = std::get_if<Line>(&*it);
+    bool batched = std::holds_alternative<Circle>(*it) ||
+                   std::holds_alternative<Text>(*it) ||
+                   (line != nullptr && line->thickness != 0.0f);
+    if (!batched) flush_instances();
+    dispatch_primitive(*it);
+  }
+  flush_instances();
+  if (gl_blend != BlendMode::OVER) set_gl_blend(BlendMode::OVER);
+}
+
+void GLFWCanvas::set_gl_blend(BlendMode mode) {
+  gl_blend = mode;
+  GLenum equation = GL_FUNC_ADD;
+  if (mode == BlendMode::MAX) equation = GL_MAX;
+  if (mode == BlendMode::MIN) equation = GL_MIN;
+  GL_CALL(glBlendEquation(equation));
+
+  switch (mode) {
+    case BlendMode::OVER:
+    case BlendMode::MAX:
+    case BlendMode::MIN:
+      // The factors are ignored by GL_MAX and GL_MIN.
+      GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+      break;
+    case BlendMode::REPLACE:
+      GL_CALL(glBlendFunc(GL_ONE, GL_ZERO));
+      break;
+    case BlendMode::ADD:
+      GL_CALL(glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE));
+      break;
+    case BlendMode::MULTIPLY:
+      GL_CALL(glBlendFuncSeparate(GL_ZERO, GL_SRC_COLOR, GL_ONE,
+                                  GL_ONE_MINUS_SRC_ALPHA));
+      break;
+    case BlendMode::ERASE:
+      GL_CALL(glBlendFuncSeparate(GL_ZERO, GL_ONE, GL_ZERO,
+                                  GL_ONE_MINUS_SRC_ALPHA));
+      break;
+  }
+}
+
+void GLFWCanvas::draw_scene(std::list<Primitive>::const_iterator static_begin,
+                            std::list<Primitive>::const_iterator static_end,
+                            std::list<Primitive>::const_iterator dynamic_begin,
+                            std::list<Primitive>::const_iterator dynamic_end,
+                            uint64_t static_version) {
+  if (static_begin == static_end) {
+    draw_range(dynamic_begin, dynamic_end);
+    evict_image_textures();
+    return;
+  }
+
+  if (static_width != width || static_height != height) {
+    resize_static_layer();
+    static_drawn_version.reset();
+  }
+  if (static_drawn_version != static_version) {
+    // Drawn over the same clear color as the window, so the layer replaces
+    // the background exactly as drawing it directly would.
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, static_msaa_fbo));
+    GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT));
+    draw_range(static_begin, static_end);
+    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, static_msaa_fbo));
+    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_fbo));
+    GL_CALL(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                              GL_COLOR_BUFFER_BIT, GL_NEAREST));
+    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    static_drawn_version = static_version;
+  }
+
+  const Viewport& v = frame_viewport;
+  std::array<float, 16> quad = {
+      v.left, v.bottom, 0.0f, 0.0f, v.right, v.bottom, 1.0f, 0.0f,
+      v.left, v.top,    0.0f, 1.0f, v.right, v.top,    1.0f, 1.0f,
+  };
+  GL_CALL(glDisable(GL_BLEND));
+  GL_CALL(glUseProgram(shaders[IMAGE]));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, static_texture));
+  GL_CALL(glBindVertexArray(vaos[IMAGE]));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[IMAGE]));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, quad.size() * sizeof(quad[0]),
+                       quad.data(), GL_DYNAMIC_DRAW));
+  GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+  GL_CALL(glEnable(GL_BLEND));
+
+  draw_range(dynamic_begin, dynamic_end);
+  evict_image_textures();
+}
+
+void GLFWCanvas::resize_static_layer() {
+  if (static_msaa_fbo == 0) {
+    GL_CALL(glGenFramebuffers(1, &static_msaa_fbo));
+    GL_CALL(glGenFramebuffers(1, &static_fbo));
+    GL_CALL(glGenRenderbuffers(1, &static_color_rb));
+    GL_CALL(glGenRenderbuffers(1, &static_stencil_rb));
+    GL_CALL(glGenTextures(1, &static_texture));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, static_texture));
+    // One texel per window pixel.
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  }
+  static_width = width;
+  static_height = height;
+
+  // Stencil as well, for the polygon fills.
+  GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, static_color_rb));
+  GL_CALL(glRenderbufferStorageMultisample(
+      GL_RENDERBUFFER, STATIC_LAYER_SAMPLES, GL_RGBA8, width, height));
+  GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, static_stencil_rb));
+  GL_CALL(glRenderbufferStorageMultisample(GL_RENDERBUFFER,
+                                           STATIC_LAYER_SAMPLES,
+                                           GL_DEPTH24_STENCIL8, width, height));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, static_msaa_fbo));
+  GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                    GL_RENDERBUFFER, static_color_rb));
+  GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                                    GL_DEPTH_STENCIL_ATTACHMENT,
+                                    GL_RENDERBUFFER, static_stencil_rb));
+  GL_CALL(ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER),
+                 == GL_FRAMEBUFFER_COMPLETE));
+
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, static_texture));
+  GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                       GL_UNSIGNED_BYTE, nullptr));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, static_fbo));
+  GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                 GL_TEXTURE_2D, static_texture, 0));
+  GL_CALL(ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER),
+                 == GL_FRAMEBUFFER_COMPLETE));
+  GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void GLFWCanvas::flush_instances() {
+  auto draw = [&](size_t program, std::vector<float>& instances,
+                  size_t floats_per_instance) {
+    if (instances.empty()) return;
+    GL_CALL(glUseProgram(shaders[program]));
+    GL_CALL(glBindVertexArray(vaos[program]));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[program]));
+    GL_CALL(glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float),
+                         instances.data(), GL_STREAM_DRAW));
+    GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+                                  instances.size() / floats_per_instance));
+    instances.clear();
+  };
+
+  draw(CIRCLE, circle_instances, 7);
+  draw(THICK_LINE, line_instances, 9);
+  if (!text_instances.empty()) {
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, glyph_atlas));
+    draw(TEXT, text_instances, 10);
+  }
+}
+
+void GLFWCanvas::draw_primitive(const Image& i) {
+  if (i.source == nullptr) return;
+  const FrameBufferCanvas& source = *i.source;
+  // Threaded, the source may be drawn into right now and only its snapshot
+  // is read.
+  const ImageSnapshot* snapshot = image_snapshot(source.get_image_id());
+  if (is_threaded() && snapshot == nullptr) return;
+  uint32_t w = snapshot ? snapshot->width : source.get_width();
+  uint32_t h = snapshot ? snapshot->height : source.get_height();
+  uint64_t revision = snapshot ? snapshot->revision : source.get_revision();
+  if (w == 0 || h == 0) return;
+
+  auto [it, inserted] = image_textures.try_emplace(source.get_image_id());
+  ImageTexture& entry = it->second;
+  if (inserted) {
+    entry.source = i.source;
+    GL_CALL(glGenTextures(1, &entry.texture));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, entry.texture));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GL_CALL(
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  } else {
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, entry.texture));
+  }
+
+  PixelRect full = {.x0 = 0, .y0 = 0, .x1 = w, .y1 = h};
+  PixelRect rect;
+  if (entry.width != w || entry.height != h) {
+    entry.width = w;
+    entry.height = h;
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA,
+                         GL_UNSIGNED_BYTE, nullptr));
+    rect = full;
+  } else if (entry.revision != revision) {
+    rect = (snapshot ? snapshot->damage_since(entry.revision)
+                     : source.damage_since(entry.revision))
+               .intersect(full);
+  }
+  if (snapshot) {
+    upload_pixels(snapshot->pixels.data(), w, rect);
+  } else {
+    upload_image(source, rect);
+  }
+  entry.revision = revision;
+
+  const Viewport& l = i.location;
+  std::array<float, 16> quad = {
+      l.left, l.bottom, 0.0f, 0.0f, l.right, l.bottom, 1.0f, 0.0f,
+      l.left, l.top,    0.0f, 1.0f, l.right, l.top,    1.0f, 1.0f,
+  };
+  GL_CALL(glUseProgram(shaders[IMAGE]));
+  GL_CALL(glBindVertexArray(vaos[IMAGE]));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[IMAGE]));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, quad.size() * sizeof(quad[0]),
+                       quad.data(), GL_DYNAMIC_DRAW));
+  GL_CALL(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
+}
+
+void GLFWCanvas::upload_image(const FrameBufferCanvas& source,
+                              PixelRect rect) {
+  if (rect.empty()) return;
+
+  // Texture rows start at the bottom, like the canvas rows.
+  uint32_t w = rect.x1 - rect.x0;
+  upload_buffer.resize(rect.area() * 4);
+  encode_rgba8(source, rect, upload_buffer.data(), size_t(w) * 4);
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x0, rect.y0, w,
+                          rect.y1 - rect.y0, GL_RGBA, GL_UNSIGNED_BYTE,
+                          upload_buffer.data()));
+}
+
+void GLFWCanvas::upload_pixels(const uint8_t* pixels, uint32_t width,
+                               PixelRect rect) {
+  if (rect.empty()) return;
+
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, width));
+  GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x0, rect.y0,
+                          rect.x1 - rect.x0, rect.y1 - rect.y0, GL_RGBA,
+                          GL_UNSIGNED_BYTE,
+                          pixels + (size_t(rect.y0) * width + rect.x0) * 4));
+  GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+}
+
+void GLFWCanvas::evict_image_textures() {
+  for (auto it = image_textures.begin(); it != image_textures.end();) {
+    if (!it->second.source.expired()) {
+      ++it;
+      continue;
+    }
+    GL_CALL(glDeleteTextures(1, &it->second.texture));
+    it = image_textures.erase(it);
+  }
 }
 
 void GLFWCanvas::draw_primitive(const Triangle& p) {
@@ -325,4 +927,115 @@ void GLFWCanvas::draw_primitive(const Triangle& p) {
                        GL_DYNAMIC_DRAW));
   GL_CALL(glDrawArrays(GL_TRIANGLES, 0, pts.size() / 2));
 }
+std::optional<Transform2D> GLFWCanvas::pixel_transform() const {
+  return Transform2D::between(viewport, Viewport{.top = float(event_height),
+                                                 .bottom = 0.0f,
+                                                 .left = 0.0f,
+                                                 .right = float(event_width)});
+}
+
+float GLFWCanvas::pixels_per_unit() const {
+  return std::max(std::abs(mvp[0]) * width, std::abs(mvp[5]) * height) * 0.5f;
+}
+
+void GLFWCanvas::fill_stencil(const std::vector<std::vector<Vec2>>& contours,
+                              FillRule rule, Rgba color) {
+  std::vector<float> pts;
+  std::vector<int> firsts, counts;
+  float min_x = INFINITY, max_x = -INFINITY, min_y = INFINITY,
+        max_y = -INFINITY;
+
+  for (const auto& contour : contours) {
+    if (contour.size() < 3) continue;
+    firsts.push_back(pts.size() / 2);
+    counts.push_back(contour.size());
+    for (const auto& p : contour) {
+      pts.push_back(p.x);
+      pts.push_back(p.y);
+      min_x = std::min(min_x, p.x);
+      max_x = std::max(max_x, p.x);
+      min_y = std::min(min_y, p.y);
+      max_y = std::max(max_y, p.y);
+    }
+  }
+  if (firsts.empty()) return;
+
+  // Covering quad drawn after the fans.
+  size_t cover = pts.size() / 2;
+  pts.insert(pts.end(), {min_x, min_y, max_x, min_y, max_x, max_y,
+                         min_x, min_y, max_x, max_y, min_x, max_y});
+
+  GL_CALL(glUseProgram(shaders[TRIANGLE]));
+  GL_CALL(glUniform4f(ucolors[TRIANGLE], color.r, color.g, color.b, color.a));
+  GL_CALL(glBindVertexArray(vaos[TRIANGLE]));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[TRIANGLE]));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(pts[0]),
+                       pts.data(), GL_DYNAMIC_DRAW));
+
+  // Triangle fans from the first vertex of each contour leave the winding
+  // number of every pixel in the stencil buffer.
+  GL_CALL(glEnable(GL_STENCIL_TEST));
+  GL_CALL(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+  GL_CALL(glStencilMask(0xFF));
+  GL_CALL(glStencilFunc(GL_ALWAYS, 0, 0xFF));
+  if (rule == FillRule::NON_ZERO) {
+    GL_CALL(glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP));
+    GL_CALL(glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP));
+  } else {
+    GL_CALL(glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT));
+  }
+  GL_CALL(glMultiDrawArrays(GL_TRIANGLE_FAN, firsts.data(), counts.data(),
+                            firsts.size()));
+
+  // Cover pass, clearing the stencil behind it.
+  GL_CALL(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+  GL_CALL(glStencilFunc(GL_NOTEQUAL, 0,
+                        rule == FillRule::NON_ZERO ? 0xFF : 0x01));
+  GL_CALL(glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO));
+  GL_CALL(glDrawArrays(GL_TRIANGLES, cover, 6));
+  GL_CALL(glDisable(GL_STENCIL_TEST));
+}
+
+void GLFWCanvas::draw_primitive(const Polygon& p) {
+  fill_stencil(p.contours, p.rule, p.color);
+}
+
+void GLFWCanvas::draw_primitive(const Polyline& p) {
+  if (p.points.size() < 2) return;
+
+  if (p.thickness > 0.0f) {
+    fill_stencil(
+        stroke_outline(p.points, p.thickness, p.join,
+                       circle_segments(p.thickness * pixels_per_unit())),
+        FillRule::NON_ZERO, p.color);
+    return;
+  }
+
+  std::vector<float> pts;
+  pts.reserve(p.points.size() * 2);
+  for (const auto& pt : p.points) {
+    pts.push_back(pt.x);
+    pts.push_back(pt.y);
+  }
+
+  GL_CALL(glUseProgram(shaders[TRIANGLE]));
+  GL_CALL(glUniform4f(ucolors[TRIANGLE], p.color.r, p.color.g, p.color.b,
+                      p.color.a));
+  GL_CALL(glBindVertexArray(vaos[TRIANGLE]));
+  GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbos[TRIANGLE]));
+  GL_CALL(glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(pts[0]),
+                       pts.data(), GL_DYNAMIC_DRAW));
+  GL_CALL(glDrawArrays(GL_LINE_STRIP, 0, pts.size() / 2));
+}
+
+void GLFWCanvas::draw_primitive(const Bezier& b) {
+  // Re-flattened every frame, so the segment count follows the zoom level.
+  Vec2 scale(mvp[0] * width * 0.5f, mvp[5] * height * 0.5f);
+  uint32_t segments = bezier_segments(b, scale, 0.25f);
+  draw_primitive(Polyline{.points = flatten_bezier(b, segments),
+                          .color = b.color,
+                          .thickness = b.thickness,
+                          .join = LineJoin::ROUND});
+}
+
 }  // namespace Canvas
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cmath>
+
+#include "canvas.h"
+#include "font/font5x7.h"
+
+namespace Canvas {
+
+// Font pixel (x, y) of a character cell, counting rows from the top.
+static bool font_pixel(char c, uint32_t x, uint32_t y) {
+  if (c < font5x7_first || c > font5x7_last) c = '?';
+  if (x >= 5 || y >= 7) return false;
+  return (font5x7[c - font5x7_first][y] >> (4 - x)) & 1;
+}
+
+uint32_t GlyphCache::width(uint32_t pixel_height) {
+  return std::ceil(float(pixel_height) * TEXT_CELL_WIDTH / TEXT_CELL_HEIGHT);
+}
+
+uint8_t GlyphCache::coverage(char c, uint32_t pixel_height, uint32_t x,
+                             uint32_t y) {
+  // Every stamp pixel covers a k x k square of font pixels, its coverage is
+  // the area of that square that lies on set font pixels. Doubles keep the
+  // square exact for glyphs millions of pixels tall.
+  double k = double(TEXT_CELL_HEIGHT) / pixel_height;
+  auto overlap = [&](uint32_t dst, uint32_t src) {
+    return std::max(0.0, std::min((dst + 1) * k, src + 1.0) -
+                             std::max(dst * k, double(src)));
+  };
+
+  uint32_t src_y0 = y * k, src_y1 = std::min<uint32_t>(std::ceil((y + 1) * k),
+                                                       TEXT_CELL_HEIGHT);
+  uint32_t src_x0 = x * k, src_x1 = std::min<uint32_t>(std::ceil((x + 1) * k),
+                                                       TEXT_CELL_WIDTH);
+  double area = 0.0;
+  for (uint32_t sy = src_y0; sy < src_y1; sy++) {
+    for (uint32_t sx = src_x0; sx < src_x1; sx++) {
+      if (font_pixel(c, sx, sy)) area += overlap(x, sx) * overlap(y, sy);
+    }
+  }
+  return std::min(255.0, area / (k * k) * 255.0 + 0.5);
+}
+
+const GlyphCache::Stamp& GlyphCache::get(char c, uint32_t pixel_height) {
+  uint64_t key = (uint64_t(pixel_height) << 8) | uint8_t(c);
+  auto it = stamps.find(key);
+  if (it != stamps.end()) return it->second;
+
+  // Zooming through many heights would otherwise keep every one of them.
+  size_t size = size_t(width(pixel_height)) * pixel_height;
+  if (bytes + size > MAX_BYTES) clear();
+  bytes += size;
+
+  Stamp& stamp = stamps[key];
+  stamp.height = pixel_height;
+  stamp.width = width(pixel_height);
+  stamp.coverage.resize(size);
+  for (uint32_t y = 0; y < stamp.height; y++) {
+    for (uint32_t x = 0; x < stamp.width; x++) {
+      stamp.coverage[size_t(y) * stamp.width + x] =
+          coverage(c, pixel_height, x, y);
+    }
+  }
+  return stamp;
+}
+
+void GlyphCache::clear() {
+  stamps.clear();
+  bytes = 0;
+}
+
+}  // namespace Canvas
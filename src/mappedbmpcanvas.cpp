@@ -0,0 +1,66 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+MappedBmpCanvas::Mapping MappedBmpCanvas::map_file(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Could not open file " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("Not a BMP file: " + path);
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) throw std::runtime_error("Could not map " + path);
+
+  try {
+    BmpLayout layout = read_bmp_layout((const uint8_t*)data, st.st_size);
+    return Mapping{.data = data, .size = size_t(st.st_size), .layout = layout};
+  } catch (const std::runtime_error& e) {
+    munmap(data, st.st_size);
+    throw std::runtime_error(std::string(e.what()) + ": " + path);
+  }
+}
+
+MappedBmpCanvas::MappedBmpCanvas(const std::string& path, Viewport viewport)
+    : MappedBmpCanvas(map_file(path), viewport) {}
+
+MappedBmpCanvas::MappedBmpCanvas(Mapping m, Viewport viewport)
+    : FrameBufferCanvas(m.layout.width, m.layout.height, viewport),
+      mapping(m.data),
+      mapping_size(m.size),
+      layout(m.layout) {}
+
+MappedBmpCanvas::~MappedBmpCanvas() { munmap(mapping, mapping_size); }
+
+const BmpLayout& MappedBmpCanvas::get_layout() const { return layout; }
+
+const uint8_t* MappedBmpCanvas::stored_row(uint32_t y) const {
+  ASSERT(y, < height);
+  uint32_t row = layout.top_down ? height - 1 - y : y;
+  return (const uint8_t*)mapping + layout.data_offset +
+         row * layout.row_stride;
+}
+
+Rgba MappedBmpCanvas::get_pixel(uint32_t x, uint32_t y) const {
+  ASSERT(x, < width);
+  Rgba color;
+  convert_bmp_row(stored_row(y) + size_t(x) * layout.bytes_per_pixel, &color,
+                  1, layout);
+  return linear_blending ? srgb_to_linear(color) : color;
+}
+
+void MappedBmpCanvas::set_pixel(uint32_t x, uint32_t y, Rgba color) {}
+
+void MappedBmpCanvas::display() {}
+
+}  // namespace Canvas
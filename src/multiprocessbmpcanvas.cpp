@@ -0,0 +1,180 @@
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <new>
+
+#include "canvas.h"
+
+namespace Canvas {
+
+MultiProcessBmpCanvas::MultiProcessBmpCanvas(uint32_t width, uint32_t height,
+                                             uint32_t tile_size,
+                                             uint32_t workers,
+                                             const std::string& file_path,
+                                             Viewport viewport,
+                                             Rgba background_color)
+    : FrameBufferCanvas(width, height, viewport),
+      file_path(file_path),
+      background_color(background_color),
+      tile_size(std::max(tile_size, 1u)),
+      workers(std::max(workers, 1u)) {
+  size_t bytes = std::max<size_t>(size_t(width) * height * sizeof(Rgba), 1);
+  pixels_fd = memfd_create("canvas-pixels", MFD_CLOEXEC);
+  if (pixels_fd < 0 || ftruncate(pixels_fd, bytes) != 0) {
+    std::cerr << WHERE << " Could not create shared pixels: "
+              << std::strerror(errno) << "\n";
+    exit(1);
+  }
+  void* mapping =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, pixels_fd, 0);
+  if (mapping == MAP_FAILED) {
+    std::cerr << WHERE << " Could not map shared pixels: "
+              << std::strerror(errno) << "\n";
+    exit(1);
+  }
+  pixels = (Rgba*)mapping;
+  std::fill(pixels, pixels + size_t(width) * height, background_color);
+}
+
+MultiProcessBmpCanvas::~MultiProcessBmpCanvas() {
+  munmap(pixels,
+         std::max<size_t>(size_t(width) * height * sizeof(Rgba), 1));
+  close(pixels_fd);
+}
+
+void MultiProcessBmpCanvas::set_pixel(uint32_t x, uint32_t y, Rgba color) {
+  if (!in_worker) return;
+  ASSERT(size_t(y) * width + x, < size_t(width) * height);
+  pixels[size_t(y) * width + x] = color;
+}
+Rgba MultiProcessBmpCanvas::get_pixel(uint32_t x, uint32_t y) const {
+  ASSERT(size_t(y) * width + x, < size_t(width) * height);
+  return pixels[size_t(y) * width + x];
+}
+
+Rgba* MultiProcessBmpCanvas::pixel_row(uint32_t y) {
+  return pixels + size_t(y) * width;
+}
+
+void MultiProcessBmpCanvas::floodfill(uint32_t x, uint32_t y, Rgba color) {
+  std::cerr << WHERE << " Not supported by MultiProcessBmpCanvas\n";
+}
+void MultiProcessBmpCanvas::floodfill(float x, float y, Rgba color) {
+  std::cerr << WHERE << " Not supported by MultiProcessBmpCanvas\n";
+}
+void MultiProcessBmpCanvas::blit_canvas(const FrameBufferCanvas& other,
+                                        Viewport location) {
+  std::cerr << WHERE << " Not supported by MultiProcessBmpCanvas\n";
+}
+
+void MultiProcessBmpCanvas::set_file_path(const std::string& new_path) {
+  file_path = new_path;
+}
+
+void MultiProcessBmpCanvas::update() {}
+
+void MultiProcessBmpCanvas::render_tiles(int scene_fd,
+                                         std::atomic<uint32_t>& next_tile) {
+  in_worker = true;
+  int status = 0;
+  try {
+    // The forked primitive list is replaced by the shared one, which every
+    // worker decodes in place from the same pages.
+    DisplayList scene = DisplayList::map(scene_fd);
+    clear_primitives();
+    scene.replay(*this);
+    auto bins = bin_primitives(tile_size, tile_size);
+
+    uint32_t columns = (width + tile_size - 1) / tile_size;
+    Rgba background = to_storage(background_color);
+
+    for (uint32_t tile; (tile = next_tile++) < bins.size();) {
+      int64_t x0 = int64_t(tile % columns) * tile_size;
+      int64_t y0 = int64_t(tile / columns) * tile_size;
+      clip = PixelRect{.x0 = x0,
+                       .y0 = y0,
+                       .x1 = std::min<int64_t>(x0 + tile_size, width),
+                       .y1 = std::min<int64_t>(y0 + tile_size, height)};
+      for (int64_t y = clip.y0; y < clip.y1; y++) {
+        std::fill(pixel_row(y) + clip.x0, pixel_row(y) + clip.x1, background);
+      }
+
+      for (auto it : bins[tile]) draw_list_entry(it, primitives.end());
+      while (layer_depth > 0) end_layer();
+    }
+  } catch (const std::exception& e) {
+    std::cerr << WHERE << " " << e.what() << "\n";
+    status = 1;
+  }
+  std::cerr.flush();
+  _exit(status);
+}
+
+void MultiProcessBmpCanvas::display() {
+  merge_submissions();
+  std::vector<uint8_t> scene = DisplayList::encode(*this);
+
+  int scene_fd = memfd_create("canvas-scene", MFD_CLOEXEC);
+  bool ok = scene_fd >= 0;
+  for (size_t written = 0; ok && written < scene.size();) {
+    ssize_t n = write(scene_fd, scene.data() + written, scene.size() - written);
+    ok = n > 0;
+    written += ok ? n : 0;
+  }
+  void* counter = mmap(nullptr, sizeof(std::atomic<uint32_t>),
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1,
+                       0);
+  if (!ok || counter == MAP_FAILED) {
+    std::cerr << WHERE << " Could not share the scene: "
+              << std::strerror(errno) << "\n";
+    exit(1);
+  }
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+  auto next_tile = new (counter) std::atomic<uint32_t>(0);
+
+  // Buffered output would otherwise be written again by every worker.
+  std::cout.flush();
+  std::cerr.flush();
+  std::vector<pid_t> pids;
+  for (uint32_t i = 0; i < workers; i++) {
+    pid_t pid = fork();
+    if (pid == 0) render_tiles(scene_fd, *next_tile);
+    if (pid < 0) break;
+    pids.push_back(pid);
+  }
+
+  bool failed = pids.empty();
+  for (pid_t pid : pids) {
+    int status = 0;
+    failed |= waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+              WEXITSTATUS(status) != 0;
+  }
+  munmap(counter, sizeof(std::atomic<uint32_t>));
+  close(scene_fd);
+  if (failed) {
+    std::cerr << WHERE << " Rendering in worker processes failed\n";
+    exit(1);
+  }
+  mark_damaged();
+
+  auto f = std::ofstream(file_path, std::ios::binary);
+  if (!f.is_open()) {
+    std::cerr << "Could not open file " << file_path << "\n";
+    exit(1);
+  }
+  write_bmp_header(f, width, height);
+  std::vector<uint8_t> row;
+  for (uint32_t y = 0; y < height; y++) {
+    write_bmp_row(f, pixel_row(y), width, row, linear_blending);
+  }
+  f.close();
+  if (!f) {
+    std::cerr << "Error writing to file " << file_path << "\n";
+    exit(1);
+  }
+}
+
+}  // namespace Canvas
@@ -1,92 +1,48 @@
 static constexpr const char* circle_shader_frag_source = R"SHADER(
 
-#version 400 core
+#version 330 core
 
+in vec2 uv;
+in vec4 fillColor;
 out vec4 color;
-in UvData {
-	vec2 uv;
-	float radius;
-} geomOut;
-
-uniform mat4 uMVP;
-uniform vec4 uColor;
 
 void main()
 {
-	if (dot(geomOut.uv, geomOut.uv) <= 1.0)
-		color = uColor;
-	else
-		color = vec4(0, 0, 0, 0);
+	// Coverage from the distance to the edge in pixels.
+	float d = length(uv);
+	float alpha = clamp((1.0 - d) / fwidth(d) + 0.5, 0.0, 1.0);
+	if (alpha <= 0.0)
+		discard;
+	color = vec4(fillColor.rgb, fillColor.a * alpha);
 }
 
 )SHADER";
 
 static constexpr const char* circle_shader_vert_source = R"SHADER(
     
-#version 400 core
+#version 330 core
 
-layout(location = 0) in vec4 vertInPosition;
-layout(location = 1) in float vertInRadius;
+// Corner of the unit quad, then per instance data.
+layout(location = 0) in vec2 vertInCorner;
+layout(location = 1) in vec3 vertInCircle;
+layout(location = 2) in vec4 vertInColor;
 
 uniform mat4 uMVP;
-uniform vec4 uColor;
+uniform vec2 uViewportSize;
 
-out VertexData 
-{
-	vec4 position;
-	float radius;
-} vertOut;
+out vec2 uv;
+out vec4 fillColor;
 
 void main()
 {
-	gl_Position = uMVP * vertInPosition;
-	vertOut.position = vertInPosition;
-	vertOut.radius = vertInRadius;
+	vec2 radius = abs(vec2(uMVP[0][0], uMVP[1][1])) * vertInCircle.z;
+	// One pixel of margin for the antialiased edge.
+	vec2 extent = radius + 2.0 / uViewportSize;
+
+	gl_Position = uMVP * vec4(vertInCircle.xy, 0.0, 1.0) +
+	              vec4(vertInCorner * extent, 0.0, 0.0);
+	uv = vertInCorner * extent / radius;
+	fillColor = vertInColor;
 }
 
 )SHADER";
-
-static constexpr const char* circle_shader_geom_source = R"SHADER(
-
-#version 400 core
-layout(points) in;
-layout(triangle_strip, max_vertices = 4) out;
-
-uniform mat4 uMVP;
-uniform vec4 uColor;
-
-in VertexData 
-{
-	vec4 position;
-	float radius;
-} vertOut[];
-
-out UvData {
-	vec2 uv;
-	float radius;
-} geomOut;
-
-void main() {
-	gl_Position = uMVP * (vertOut[0].position + vec4(-vertOut[0].radius, vertOut[0].radius, 0, 0));
-	geomOut.uv = vec2(-1, 1);
-	geomOut.radius = vertOut[0].radius;
-	EmitVertex();
-	
-	gl_Position = uMVP * (vertOut[0].position + vec4(vertOut[0].radius, vertOut[0].radius, 0, 0));
-	geomOut.uv = vec2(1, 1);
-	geomOut.radius = vertOut[0].radius;
-	EmitVertex();
-	
-	gl_Position = uMVP * (vertOut[0].position + vec4(-vertOut[0].radius, -vertOut[0].radius, 0, 0));
-	geomOut.uv = vec2(-1, -1);
-	geomOut.radius = vertOut[0].radius;
-	EmitVertex();
-	
-	gl_Position = uMVP * (vertOut[0].position + vec4(vertOut[0].radius, -vertOut[0].radius, 0, 0));
-	geomOut.uv = vec2(1, -1);
-	geomOut.radius = vertOut[0].radius;
-	EmitVertex();
-	EndPrimitive();
-}
-
-)SHADER";
\ No newline at end of file
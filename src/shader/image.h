@@ -0,0 +1,34 @@
+static constexpr const char* image_shader_frag_source = R"SHADER(
+
+#version 330 core
+
+in vec2 texCoord;
+out vec4 color;
+
+uniform sampler2D uImage;
+
+void main()
+{
+	color = texture(uImage, texCoord);
+}
+
+)SHADER";
+
+static constexpr const char* image_shader_vert_source = R"SHADER(
+
+#version 330 core
+
+layout(location = 0) in vec2 vertInPosition;
+layout(location = 1) in vec2 vertInTexCoord;
+
+uniform mat4 uMVP;
+
+out vec2 texCoord;
+
+void main()
+{
+	gl_Position = uMVP * vec4(vertInPosition, 0.0, 1.0);
+	texCoord = vertInTexCoord;
+}
+
+)SHADER";
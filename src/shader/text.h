@@ -0,0 +1,61 @@
+static constexpr const char* text_shader_frag_source = R"SHADER(
+
+#version 330 core
+
+in vec2 texCoord;
+in vec4 fillColor;
+out vec4 color;
+
+uniform sampler2D uAtlas;
+
+void main()
+{
+	float coverage = texture(uAtlas, texCoord).r;
+	if (coverage <= 0.0)
+		discard;
+	color = vec4(fillColor.rgb, fillColor.a * coverage);
+}
+
+)SHADER";
+
+static constexpr const char* text_shader_vert_source = R"SHADER(
+
+#version 330 core
+
+// Corner of the unit quad, then per instance data: the text origin, and the
+// size, column, line and atlas cell of the glyph.
+layout(location = 0) in vec2 vertInCorner;
+layout(location = 1) in vec2 vertInOrigin;
+layout(location = 2) in vec4 vertInGlyph;
+layout(location = 3) in vec4 vertInColor;
+
+uniform mat4 uMVP;
+uniform vec2 uViewportSize;
+uniform vec2 uAtlasCells;
+
+out vec2 texCoord;
+out vec4 fillColor;
+
+void main()
+{
+	// Cells are laid out in clip space so the text stays upright and left to
+	// right whatever the direction of the viewport axes. Their width follows
+	// from the height in pixels, as on the CPU canvases, so glyphs keep their
+	// shape when the viewport is stretched.
+	float height = abs(uMVP[1][1]) * vertInGlyph.x;
+	vec2 cell = vec2(height * 0.75 * uViewportSize.y / uViewportSize.x,
+	                 height);
+	vec2 corner = vertInCorner * 0.5 + 0.5;
+	vec2 offset = (vec2(vertInGlyph.y, -vertInGlyph.z) + corner) * cell;
+
+	gl_Position = uMVP * vec4(vertInOrigin, 0.0, 1.0) +
+	              vec4(offset, 0.0, 0.0);
+	// Every atlas cell is 8x10 texels, the 6x8 glyph cell with a one texel
+	// border.
+	texCoord = vec2((vertInGlyph.w * 8.0 + 1.0 + corner.x * 6.0) /
+	                    (uAtlasCells.x * 8.0),
+	                (1.0 + (1.0 - corner.y) * 8.0) / 10.0);
+	fillColor = vertInColor;
+}
+
+)SHADER";
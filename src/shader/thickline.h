@@ -1,118 +1,64 @@
 static constexpr const char* thick_line_shader_frag_source = R"SHADER(
 
-#version 400 core
+#version 330 core
 
+in vec2 position;
+flat in vec4 segment;
+flat in float radius;
+in vec4 fillColor;
 out vec4 color;
-in UvData {
-	vec2 uv;
-} geomOut;
-
-uniform mat4 uMVP;
-uniform vec4 uColor;
 
 void main()
 {
-	if (dot(geomOut.uv, geomOut.uv) <= 1.0)
-		color = uColor;
-	else
-		color = vec4(0, 0, 0, 0);
+	// Distance to the segment gives the round capped stroke.
+	vec2 a = segment.xy, ab = segment.zw - segment.xy;
+	float t = clamp(dot(position - a, ab) / max(dot(ab, ab), 1e-20), 0.0, 1.0);
+	float d = length(position - (a + ab * t));
+
+	float alpha = clamp((radius - d) / fwidth(d) + 0.5, 0.0, 1.0);
+	if (alpha <= 0.0)
+		discard;
+	color = vec4(fillColor.rgb, fillColor.a * alpha);
 }
 
 )SHADER";
 
 static constexpr const char* thick_line_shader_vert_source = R"SHADER(
     
-#version 400 core
+#version 330 core
 
-layout(location = 0) in vec4 vertInPosition;
-layout(location = 1) in float vertInRadius;
+// Corner of the unit quad, then per instance data.
+layout(location = 0) in vec2 vertInCorner;
+layout(location = 1) in vec4 vertInSegment;
+layout(location = 2) in float vertInRadius;
+layout(location = 3) in vec4 vertInColor;
 
 uniform mat4 uMVP;
-uniform vec4 uColor;
+uniform vec2 uViewportSize;
 
-out VertexData 
-{
-	vec4 position;
-	float radius;
-} vertOut;
+out vec2 position;
+flat out vec4 segment;
+flat out float radius;
+out vec4 fillColor;
 
 void main()
 {
-	gl_Position = uMVP * vertInPosition;
-	vertOut.position = vertInPosition;
-	vertOut.radius = vertInRadius;
+	vec2 a = vertInSegment.xy, b = vertInSegment.zw;
+	vec2 dir = b - a;
+	float half_length = 0.5 * length(dir);
+	dir = half_length > 0.0 ? dir / (2.0 * half_length) : vec2(1.0, 0.0);
+	vec2 normal = vec2(-dir.y, dir.x);
+
+	// One pixel of margin for the antialiased edge.
+	vec2 pixel = 2.0 / (uViewportSize * abs(vec2(uMVP[0][0], uMVP[1][1])));
+	float extent = vertInRadius + max(pixel.x, pixel.y);
+
+	position = (a + b) * 0.5 + dir * vertInCorner.x * (half_length + extent) +
+	           normal * vertInCorner.y * extent;
+	gl_Position = uMVP * vec4(position, 0.0, 1.0);
+	segment = vertInSegment;
+	radius = vertInRadius;
+	fillColor = vertInColor;
 }
 
 )SHADER";
-
-static constexpr const char* thick_line_shader_geom_source = R"SHADER(
-
-#version 400 core
-layout(lines) in;
-layout(triangle_strip, max_vertices = 8) out;
-
-uniform mat4 uMVP;
-uniform vec4 uColor;
-
-in VertexData 
-{
-	vec4 position;
-	float radius;
-} vertOut[];
-
-out UvData {
-	vec2 uv;
-} geomOut;
-
-void main() {
-
-    vec4 dir = normalize(vertOut[1].position - vertOut[0].position);
-    float r1 = vertOut[0].radius;
-    float r2 = vertOut[1].radius;
-
-    vec4 a = vertOut[0].position + vec4(-dir.y, dir.x, 0, 0) * r1;
-    vec4 b = a + (vertOut[0].position - a) * 2.0;
-
-	vec4 p0 = uMVP * (b - dir * r1);
-	vec4 p1 = uMVP * (a - dir * r1);
-    vec4 p2 = uMVP * b;
-    vec4 p3 = uMVP * a;
-    
-    a = vertOut[1].position + vec4(-dir.y, dir.x, 0, 0) * r2;
-    b = a + (vertOut[1].position - a) * 2.0;
-    
-    vec4 p4 = uMVP * b;
-    vec4 p5 = uMVP * a;
-    vec4 p6 = uMVP * (b + dir * r2);
-    vec4 p7 = uMVP * (a + dir * r2);
-
-    gl_Position = p0;
-    geomOut.uv = vec2(1,1);
-    EmitVertex();
-    gl_Position = p1;
-    geomOut.uv = vec2(-1,1);
-    EmitVertex();
-    gl_Position = p2;
-    geomOut.uv = vec2(1,0);
-    EmitVertex();
-    gl_Position = p3;
-    geomOut.uv = vec2(-1,0);
-    EmitVertex();
-
-    gl_Position = p4;
-    geomOut.uv = vec2(1,0);
-    EmitVertex();
-    gl_Position = p5;
-    geomOut.uv = vec2(-1,0);
-    EmitVertex();
-    gl_Position = p6;
-    geomOut.uv = vec2(1,1);
-    EmitVertex();
-    gl_Position = p7;
-    geomOut.uv = vec2(-1,1);
-    EmitVertex();
-
-    EndPrimitive();
-}
-
-)SHADER";
\ No newline at end of file
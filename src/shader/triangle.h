@@ -1,6 +1,6 @@
 static constexpr const char* triangle_shader_frag_source = R"SHADER(
 
-#version 400 core
+#version 330 core
 
 in VertexData
 {
@@ -18,7 +18,7 @@ void main()
 
 static constexpr const char* triangle_shader_vert_source = R"SHADER(
     
-#version 400 core
+#version 330 core
 
 layout(location = 0) in vec4 vertInPosition;
 
@@ -0,0 +1,90 @@
+#include "canvas.h"
+
+namespace Canvas {
+
+SubmissionContext::SubmissionContext(uint32_t id) : id(id) {}
+
+uint32_t SubmissionContext::get_id() const { return id; }
+
+void SubmissionContext::set_blend_mode(BlendMode mode) { blend_mode = mode; }
+BlendMode SubmissionContext::get_blend_mode() const { return blend_mode; }
+
+void SubmissionContext::add(Primitive p) {
+  std::lock_guard<std::mutex> lock(mutex);
+  pending.push_back(std::move(p));
+}
+
+void SubmissionContext::add_line(float x1, float y1, float x2, float y2,
+                                 Rgba color, float thickness) {
+  add(Line{
+      .start = Vec2(x1, y1),
+      .end = Vec2(x2, y2),
+      .color = color,
+      .thickness = thickness,
+      .blend = blend_mode,
+  });
+}
+void SubmissionContext::add_circle(float x, float y, float radius,
+                                   Rgba color) {
+  add(Circle{.origin = Vec2(x, y),
+             .radius = radius,
+             .color = color,
+             .blend = blend_mode});
+}
+void SubmissionContext::add_triangle(Vec2 p1, Vec2 p2, Vec2 p3, Rgba color) {
+  add(Triangle{
+      .points = {p1, p2, p3}, .color = color, .blend = blend_mode});
+}
+void SubmissionContext::add_polygon(const std::vector<Vec2>& points,
+                                    Rgba color, FillRule rule) {
+  add_polygon(std::vector<std::vector<Vec2>>{points}, color, rule);
+}
+void SubmissionContext::add_polygon(
+    const std::vector<std::vector<Vec2>>& contours, Rgba color,
+    FillRule rule) {
+  add(Polygon{.contours = contours,
+              .color = color,
+              .rule = rule,
+              .blend = blend_mode});
+}
+void SubmissionContext::add_polyline(const std::vector<Vec2>& points,
+                                     Rgba color, float thickness,
+                                     LineJoin join) {
+  add(Polyline{.points = points,
+               .color = color,
+               .thickness = thickness,
+               .join = join,
+               .blend = blend_mode});
+}
+void SubmissionContext::add_quadratic_bezier(Vec2 p0, Vec2 p1, Vec2 p2,
+                                             Rgba color, float thickness) {
+  add(Bezier{.points = {p0, p1, p2, p2},
+             .degree = 2,
+             .color = color,
+             .thickness = thickness,
+             .blend = blend_mode});
+}
+void SubmissionContext::add_cubic_bezier(Vec2 p0, Vec2 p1, Vec2 p2, Vec2 p3,
+                                         Rgba color, float thickness) {
+  add(Bezier{.points = {p0, p1, p2, p3},
+             .degree = 3,
+             .color = color,
+             .thickness = thickness,
+             .blend = blend_mode});
+}
+void SubmissionContext::add_text(float x, float y, const std::string& text,
+                                 float size, Rgba color) {
+  add(Text{.text = text,
+           .origin = Vec2(x, y),
+           .size = size,
+           .color = color,
+           .blend = blend_mode});
+}
+void SubmissionContext::add_image(std::shared_ptr<FrameBufferCanvas> source,
+                                  Viewport location) {
+  add(Image{.source = std::move(source),
+            .location = location,
+            .blend = blend_mode});
+}
+
+}  // namespace Canvas
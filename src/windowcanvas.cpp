@@ -6,18 +6,276 @@ WindowCanvas::WindowCanvas(std::shared_ptr<WindowHandler>&& handler,
                            Viewport viewport)
     : Canvas(viewport), handler(handler) {}
 
-void WindowCanvas::stop() { quit = true; }
+WindowCanvas::~WindowCanvas() { WindowCanvas::set_threaded(false); }
+
+void WindowCanvas::stop() {
+  quit = true;
+  { std::lock_guard<std::mutex> lock(scene_mutex); }
+  handler_wakeup.notify_all();
+}
 
 void WindowCanvas::update() {
-  Canvas::update();
+  render();
+  process_events();
+}
+
+void WindowCanvas::render() {
+  redraw_requested = false;
+  if (!is_threaded()) {
+    drawn_version = scene_version;
+    begin_frame(viewport);
+    merge_submissions();
+    draw_scene(primitives.cbegin(), dynamic_begin(), dynamic_begin(),
+               primitives.cend(), static_version);
+    return;
+  }
+
+  acquire_scene();
+  begin_frame(front.viewport);
+  draw_scene(front.static_primitives.cbegin(), front.static_primitives.cend(),
+             front.primitives.cbegin(), front.primitives.cend(),
+             front.static_version);
+}
+
+void WindowCanvas::draw_scene(
+    std::list<Primitive>::const_iterator static_begin,
+    std::list<Primitive>::const_iterator static_end,
+    std::list<Primitive>::const_iterator dynamic_begin,
+    std::list<Primitive>::const_iterator dynamic_end,
+    uint64_t static_version) {
+  for (auto it = static_begin; it != static_end; ++it) dispatch_primitive(*it);
+  for (auto it = dynamic_begin; it != dynamic_end; ++it) {
+    dispatch_primitive(*it);
+  }
+}
+
+void WindowCanvas::process_events() {
+  if (!is_threaded()) {
+    while (true) {
+      auto event = next_event();
+      if (!event.has_value()) break;
+      handle_event(event.value());
+    }
+
+    handler->on_update(*this);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex);
+    while (true) {
+      auto event = next_event();
+      if (!event.has_value()) break;
+      handler_events.push_back(event.value());
+    }
+    frame_counter++;
+  }
+  handler_wakeup.notify_one();
+}
+
+void WindowCanvas::set_threaded(bool enabled) {
+  if (enabled == is_threaded()) return;
+
+  if (enabled) {
+    published_version = scene_version - 1;
+    publish_scene();
+    handler_running = true;
+    handler_thread = std::thread(&WindowCanvas::handler_loop, this);
+    return;
+  }
+
+  ASSERT(std::this_thread::get_id(), != handler_thread.get_id());
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex);
+    handler_running = false;
+  }
+  handler_wakeup.notify_all();
+  handler_thread.join();
+
+  for (const auto& e : handler_events) handle_event(e);
+  handler_events.clear();
+}
+
+bool WindowCanvas::is_threaded() const { return handler_running; }
+
+void WindowCanvas::handle_event(const Event& e) {
+  if (e.index() == Events::WindowResizeEvent) {
+    const auto& resize = std::get<WindowResizeEvent>(e);
+    event_width = resize.new_width;
+    event_height = resize.new_height;
+    redecimate();
+  }
+  handler->process_event(*this, e);
+}
+
+void WindowCanvas::handler_loop() {
+  uint64_t seen_frame = 0;
+  std::list<Event> events;
+
   while (true) {
-    auto event = next_event();
-    if (!event.has_value()) break;
-    handler->process_event(*this, event.value());
+    {
+      std::unique_lock<std::mutex> lock(scene_mutex);
+      handler_wakeup.wait(lock, [&] {
+        return !handler_running || has_quit() || frame_counter != seen_frame ||
+               !handler_events.empty();
+      });
+      if (!handler_running || has_quit()) break;
+      seen_frame = frame_counter;
+      events.swap(handler_events);
+    }
+
+    for (const auto& e : events) handle_event(e);
+    events.clear();
+    handler->on_update(*this);
+    publish_scene();
   }
+}
+
+void WindowCanvas::publish_scene() {
+  merge_submissions();
+  // Only while the scene is unchanged are the sources surely still alive.
+  auto images_changed = [&] {
+    for (auto [source, revision] : published_images) {
+      if (source->get_revision() != revision) return true;
+    }
+    return false;
+  };
+  if (published_version == scene_version && !images_changed()) return;
+  published_version = scene_version;
+
+  // Assigning over the recycled buffer reuses its list nodes, so a steady
+  // scene does not allocate here. The static layer is only copied when it
+  // changed since this buffer last held it.
+  if (back.static_version != static_version) {
+    back.static_primitives.assign(primitives.cbegin(), dynamic_begin());
+    back.static_version = static_version;
+  }
+  back.primitives.assign(dynamic_begin(), primitives.cend());
+  back.viewport = viewport;
+  snapshot_images();
+  bool pending;
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex);
+    std::swap(back, ready);
+    pending = ready_fresh;
+    ready_fresh = true;
+  }
+  // With a frame already pending the render thread is drawing or waiting out
+  // the frame rate cap, and waking it would only run on_update once more.
+  if (!pending) wake();
+}
+
+void WindowCanvas::snapshot_images() {
+  back.images.clear();
+  published_images.clear();
+  for (const auto* list : {&back.static_primitives, &back.primitives}) {
+    for (const auto& p : *list) {
+      auto image = std::get_if<Image>(&p);
+      if (image == nullptr || image->source == nullptr) continue;
+      const FrameBufferCanvas& source = *image->source;
+      uint64_t id = source.get_image_id();
+      if (back.images.count(id) != 0) continue;
+      published_images.emplace_back(&source, source.get_revision());
+
+      // A new snapshot starts from the previous one and only reads what
+      // changed since.
+      auto& latest = image_snapshots[id];
+      uint32_t w = source.get_width(), h = source.get_height();
+      if (latest == nullptr || latest->revision != source.get_revision() ||
+          latest->width != w || latest->height != h) {
+        auto next = std::make_shared<ImageSnapshot>();
+        PixelRect full = {.x0 = 0, .y0 = 0, .x1 = w, .y1 = h};
+        PixelRect rect = full;
+        if (latest != nullptr && latest->width == w && latest->height == h) {
+          *next = *latest;
+          rect = source.damage_since(latest->revision).intersect(full);
+        } else {
+          next->width = w;
+          next->height = h;
+          next->pixels.assign(size_t(w) * h * 4, 0);
+        }
+        next->revision = source.get_revision();
+        encode_rgba8(source, rect,
+                     next->pixels.data() + (size_t(rect.y0) * w + rect.x0) * 4,
+                     size_t(w) * 4);
+        if (next->damage.size() == ImageSnapshot::MAX_DAMAGE_HISTORY) {
+          next->damage_base = next->damage.front().first;
+          next->damage.erase(next->damage.begin());
+        }
+        next->damage.emplace_back(next->revision, rect);
+        latest = std::move(next);
+      }
+      back.images.emplace(id, latest);
+    }
+  }
+
+  // Sources gone from the scene.
+  for (auto it = image_snapshots.begin(); it != image_snapshots.end();) {
+    if (back.images.count(it->first) != 0) {
+      ++it;
+    } else {
+      it = image_snapshots.erase(it);
+    }
+  }
+}
+
+PixelRect WindowCanvas::ImageSnapshot::damage_since(uint64_t since) const {
+  if (since >= revision) return {};
+  if (since < damage_base) {
+    return PixelRect{.x0 = 0, .y0 = 0, .x1 = width, .y1 = height};
+  }
+
+  PixelRect rect;
+  for (const auto& [rev, r] : damage) {
+    if (rev > since) rect = rect.unite(r);
+  }
+  return rect;
+}
+
+const WindowCanvas::ImageSnapshot* WindowCanvas::image_snapshot(
+    uint64_t image_id) const {
+  if (!is_threaded()) return nullptr;
+  auto it = front.images.find(image_id);
+  return it == front.images.end() ? nullptr : it->second.get();
+}
+
+void WindowCanvas::acquire_scene() {
+  std::lock_guard<std::mutex> lock(scene_mutex);
+  if (!ready_fresh) return;
+  std::swap(front, ready);
+  ready_fresh = false;
+}
+
+bool WindowCanvas::needs_redraw() {
+  if (redraw_requested) return true;
+  if (!is_threaded()) {
+    merge_submissions();
+    return drawn_version != scene_version;
+  }
+
+  std::lock_guard<std::mutex> lock(scene_mutex);
+  return ready_fresh;
+}
+
+void WindowCanvas::set_redraw_mode(RedrawMode mode) {
+  redraw_mode = mode;
+  request_redraw();
+}
+RedrawMode WindowCanvas::get_redraw_mode() const { return redraw_mode; }
+
+void WindowCanvas::request_redraw() {
+  redraw_requested = true;
+  wake();
+}
+
+void WindowCanvas::set_max_frame_rate(float fps) { max_frame_rate = fps; }
+float WindowCanvas::get_max_frame_rate() const { return max_frame_rate; }
 
-  handler->on_update(*this);
+void WindowCanvas::set_idle_timeout(double seconds) {
+  idle_timeout = seconds;
+  wake();
 }
+double WindowCanvas::get_idle_timeout() const { return idle_timeout; }
 
 bool WindowCanvas::has_quit() const { return quit; }
 
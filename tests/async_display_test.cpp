@@ -0,0 +1,44 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+int main() {
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+
+  BmpCanvas sync(120, 80, "async_expected.bmp", viewport, WHITE);
+  sync.add_circle(0.0, 0.0, 2.0, RED);
+  sync.update();
+  sync.display();
+
+  BmpCanvas img(120, 80, "async.bmp", viewport, WHITE);
+  img.add_circle(0.0, 0.0, 2.0, RED);
+  img.update();
+  auto written = img.display_async();
+
+  // The canvas starts over from the background while the image is written.
+  if (!(img.get_pixel(60, 40) == WHITE)) {
+    std::cerr << "Canvas was not reset after display_async\n";
+    return 1;
+  }
+  img.add_circle(3.0, 3.0, 1.0, BLUE);
+  img.update();
+
+  written.get();
+  if (read_file("async.bmp") != read_file("async_expected.bmp")) {
+    std::cerr << "Asynchronous image differs from display()\n";
+    return 1;
+  }
+
+  img.set_file_path("missing_directory/async.bmp");
+  try {
+    img.display_async().get();
+    std::cerr << "Write error was not reported\n";
+    return 1;
+  } catch (const std::runtime_error& e) {
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+int main() {
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+  auto tile = make_test_tile();
+
+  for (bool linear : {false, true}) {
+    BmpCanvas reference(203, 157, "banded_reference.bmp", viewport, WHITE);
+    reference.set_linear_blending(linear);
+    add_test_scene(reference, tile, "Banded\ntext 123");
+    reference.update();
+    reference.display();
+    std::string expected = read_file("banded_reference.bmp");
+
+    // Band heights that split primitives and do not divide the image height
+    // must give the same file as drawing the whole image at once.
+    for (uint32_t band_height : {1u, 7u, 64u, 1000u}) {
+      BandedBmpCanvas img(203, 157, band_height, "banded.bmp", viewport,
+                          WHITE);
+      img.set_linear_blending(linear);
+      add_test_scene(img, tile, "Banded\ntext 123");
+      img.update();
+      img.display();
+
+      if (read_file("banded.bmp") != expected) {
+        std::cerr << "Band height " << band_height
+                  << " differs from the full image"
+                  << (linear ? " with linear blending\n" : "\n");
+        return 1;
+      }
+    }
+  }
+
+  // Outside of display() there are no pixels. Immediate operations are
+  // refused, and images of the canvas read its background.
+  auto banded = std::make_shared<BandedBmpCanvas>(
+      8, 8, 4, "banded_unused.bmp", viewport, RED);
+  banded->floodfill(0.0f, 0.0f, BLUE);
+  banded->blit_canvas(*tile, viewport);
+  if (banded->sample(0.0, 0.0).has_value() || banded->pixel_row(3) != nullptr ||
+      !(banded->get_pixel(3, 3) == RED)) {
+    std::cerr << "Banded canvas has pixels outside of display()\n";
+    return 1;
+  }
+  BmpCanvas user(8, 8, "", viewport, WHITE);
+  user.add_image(banded, viewport);
+  user.update();
+  if (!(user.get_pixel(4, 4) == RED)) {
+    std::cerr << "Image of a banded canvas is not its background\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+// Point at `t` on the curve, straight from the Bernstein form.
+static Vec2 evaluate(const Bezier& b, float t) {
+  float u = 1.0f - t;
+  if (b.degree == 2) {
+    return b.points[0] * (u * u) + b.points[1] * (2.0f * u * t) +
+           b.points[2] * (t * t);
+  }
+  return b.points[0] * (u * u * u) + b.points[1] * (3.0f * u * u * t) +
+         b.points[2] * (3.0f * u * t * t) + b.points[3] * (t * t * t);
+}
+
+static bool same(Vec2 a, Vec2 b) { return a.x == b.x && a.y == b.y; }
+
+int main() {
+  Bezier quadratic = {.points = {Vec2(0.0, 0.0), Vec2(5.0, 10.0),
+                                 Vec2(10.0, 0.0), Vec2(99.0, 99.0)},
+                      .degree = 2,
+                      .color = BLACK,
+                      .thickness = 0.5};
+  Bezier cubic = {.points = {Vec2(0.0, 0.0), Vec2(0.0, 10.0),
+                             Vec2(10.0, -10.0), Vec2(10.0, 0.0)},
+                  .degree = 3,
+                  .color = BLACK,
+                  .thickness = 0.5};
+
+  // Flattening starts and ends on the end points, ignores control points
+  // past the degree and spaces the points evenly in t.
+  for (const Bezier& b : {quadratic, cubic}) {
+    for (uint32_t segments : {1u, 2u, 7u, 64u}) {
+      std::vector<Vec2> points = flatten_bezier(b, segments);
+      bool ok = points.size() == segments + 1 &&
+                same(points.front(), b.points[0]) &&
+                same(points.back(), b.points[b.degree]);
+      for (uint32_t i = 0; ok && i <= segments; i++) {
+        Vec2 d = points[i] - evaluate(b, float(i) / float(segments));
+        ok = d.len() < 1e-4f;
+      }
+      if (!ok) {
+        std::cerr << "Degree " << b.degree << " curve flattened to "
+                  << segments << " segments is wrong\n";
+        return 1;
+      }
+    }
+  }
+
+  // Zooming in takes more segments, each one staying within the tolerance
+  // of the curve, until the cap.
+  for (const Bezier& b : {quadratic, cubic}) {
+    uint32_t previous = 0;
+    for (float zoom : {1.0f, 10.0f, 100.0f, 1000.0f}) {
+      Vec2 scale(zoom, -zoom);
+      uint32_t segments = bezier_segments(b, scale, 0.25f);
+      std::vector<Vec2> points = flatten_bezier(b, segments);
+      float error = 0.0f;
+      for (uint32_t i = 0; i < segments; i++) {
+        Vec2 chord = (points[i] + points[i + 1]) * 0.5f;
+        Vec2 d = chord - evaluate(b, (i + 0.5f) / float(segments));
+        error = std::max(error, Vec2(d.x * scale.x, d.y * scale.y).len());
+      }
+      if (segments <= previous || error > 0.25f) {
+        std::cerr << "Degree " << b.degree << " curve at zoom " << zoom
+                  << " has " << segments << " segments and error " << error
+                  << "\n";
+        return 1;
+      }
+      previous = segments;
+    }
+    if (bezier_segments(b, Vec2(1e6, 1e6), 0.25f) != 1024) {
+      std::cerr << "Degree " << b.degree << " curve is not capped\n";
+      return 1;
+    }
+  }
+
+  // Curves with their control points on a line need a single segment.
+  Bezier straight = {.points = {Vec2(0.0, 0.0), Vec2(1.0, 1.0),
+                                Vec2(2.0, 2.0), Vec2(3.0, 3.0)},
+                     .degree = 3,
+                     .color = BLACK,
+                     .thickness = 0.5};
+  if (bezier_segments(straight, Vec2(1000.0, 1000.0), 0.25f) != 1) {
+    std::cerr << "Straight curve is split\n";
+    return 1;
+  }
+
+  // Both degrees are drawn along the curve and not through the control
+  // points.
+  Viewport viewport = {.top = 6.0, .bottom = -6.0, .left = -1.0, .right = 11.0};
+  for (const Bezier& b : {quadratic, cubic}) {
+    BmpCanvas img(121, 121, "", viewport, WHITE);
+    if (b.degree == 2) {
+      img.add_quadratic_bezier(b.points[0], b.points[1], b.points[2], BLACK,
+                               b.thickness);
+    } else {
+      img.add_cubic_bezier(b.points[0], b.points[1], b.points[2], b.points[3],
+                           BLACK, b.thickness);
+    }
+    img.update();
+
+    bool ok = true;
+    for (float t = 0.0f; t <= 1.0f; t += 0.125f) {
+      Vec2 p = evaluate(b, t);
+      ok = ok && *img.sample(p.x, p.y) == BLACK;
+    }
+    Vec2 off = b.degree == 2 ? Vec2(5.0, 4.0) : Vec2(2.0, 4.0);
+    ok = ok && *img.sample(off.x, off.y) == WHITE;
+    if (!ok) {
+      std::cerr << "Degree " << b.degree << " curve is drawn wrong\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+static const BlendMode MODES[] = {
+    BlendMode::OVER, BlendMode::REPLACE, BlendMode::ADD,  BlendMode::MULTIPLY,
+    BlendMode::MAX,  BlendMode::MIN,     BlendMode::ERASE};
+
+static bool near(const Rgba& a, const Rgba& b) {
+  return std::abs(a.r - b.r) < 1e-5f && std::abs(a.g - b.g) < 1e-5f &&
+         std::abs(a.b - b.b) < 1e-5f && std::abs(a.a - b.a) < 1e-5f;
+}
+
+int main() {
+  // World coordinates are pixel coordinates.
+  Viewport pixels = {.top = 7.0, .bottom = 0.0, .left = 0.0, .right = 15.0};
+  Rgba background = {.r = 0.2, .g = 0.6, .b = 0.4, .a = 0.8};
+  Rgba color = {.r = 0.9, .g = 0.3, .b = 0.5, .a = 0.6};
+  Rgba opaque = {.r = 0.9, .g = 0.3, .b = 0.5, .a = 1.0};
+
+  // Every mode combines a filled rectangle, pixels [2, 10) x [2, 6), with
+  // the background as blend_colors() does and leaves the rest alone.
+  for (BlendMode mode : MODES) {
+    for (Rgba c : {color, opaque}) {
+      BmpCanvas img(16, 8, "", pixels, background);
+      img.set_blend_mode(mode);
+      img.add_polygon({{1.5, 1.5}, {9.5, 1.5}, {9.5, 5.5}, {1.5, 5.5}}, c);
+      img.update();
+
+      Rgba expected = blend_colors(mode, c, background);
+      for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 16; x++) {
+          bool inside = x >= 2 && x < 10 && y >= 2 && y < 6;
+          if (!near(img.get_pixel(x, y), inside ? expected : background)) {
+            std::cerr << "Mode " << int(mode) << " is wrong at pixel " << x
+                      << ", " << y << "\n";
+            return 1;
+          }
+        }
+      }
+    }
+  }
+
+  // Circles and thick lines with round caps are filled as one shape, so
+  // every pixel they cover is blended exactly once in every mode.
+  for (BlendMode mode : MODES) {
+    for (int shape = 0; shape < 2; shape++) {
+      BmpCanvas img(16, 8, "", pixels, background);
+      img.set_blend_mode(mode);
+      if (shape == 0) {
+        img.add_circle(7.0, 4.0, 3.0, color);
+      } else {
+        img.add_line(3.0, 4.0, 12.0, 3.0, color, 1.5);
+      }
+      img.update();
+
+      Rgba expected = blend_colors(mode, color, background);
+      bool covered = near(img.get_pixel(7, 4), expected);
+      for (uint32_t y = 0; y < 8; y++) {
+        for (uint32_t x = 0; x < 16; x++) {
+          Rgba px = img.get_pixel(x, y);
+          covered = covered && (near(px, expected) || near(px, background));
+        }
+      }
+      if (!covered) {
+        std::cerr << "Mode " << int(mode) << " blends "
+                  << (shape == 0 ? "circle" : "thick line")
+                  << " pixels more than once\n";
+        return 1;
+      }
+    }
+  }
+
+  // Opaque OVER stores the color as it is, and REPLACE any color.
+  if (!(blend_colors(BlendMode::OVER, opaque, background) == opaque) ||
+      !(blend_colors(BlendMode::REPLACE, color, background) == color)) {
+    std::cerr << "Opaque blends do not store the color\n";
+    return 1;
+  }
+
+  // Triangles only touch the pixels they cover, even when replacing them
+  // with a translucent color.
+  BmpCanvas tri(16, 8, "", pixels, background);
+  tri.set_blend_mode(BlendMode::REPLACE);
+  tri.add_triangle(Vec2(1.0, 1.0), Vec2(12.0, 1.0), Vec2(1.0, 6.0), color);
+  tri.update();
+  if (!(tri.get_pixel(2, 2) == color) ||
+      !(tri.get_pixel(14, 6) == background)) {
+    std::cerr << "Replaced triangle is wrong\n";
+    return 1;
+  }
+
+  // Two translucent triangles sharing their diagonal blend every pixel of
+  // the square once.
+  BmpCanvas quad(16, 8, "", pixels, background);
+  quad.add_triangle(Vec2(1.5, 0.5), Vec2(13.5, 0.5), Vec2(13.5, 6.5), color);
+  quad.add_triangle(Vec2(1.5, 0.5), Vec2(13.5, 6.5), Vec2(1.5, 6.5), color);
+  quad.update();
+  Rgba blended = blend_colors(BlendMode::OVER, color, background);
+  for (uint32_t y = 1; y < 7; y++) {
+    for (uint32_t x = 2; x < 14; x++) {
+      if (!near(quad.get_pixel(x, y), blended)) {
+        std::cerr << "Triangles sharing an edge blend pixel " << x << ", "
+                  << y << " wrongly\n";
+        return 1;
+      }
+    }
+  }
+
+  // Images composite through the same modes.
+  auto source = std::make_shared<BmpCanvas>(
+      2, 2, "", Viewport{.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0},
+      color);
+  BmpCanvas image(16, 8, "", pixels, background);
+  image.set_blend_mode(BlendMode::MULTIPLY);
+  image.add_image(source, Viewport{.top = 5.0, .bottom = 2.0, .left = 2.0,
+                                   .right = 9.0});
+  image.update();
+  if (!near(image.get_pixel(4, 3),
+            blend_colors(BlendMode::MULTIPLY, color, background)) ||
+      !(image.get_pixel(12, 3) == background)) {
+    std::cerr << "Multiplied image is wrong\n";
+    return 1;
+  }
+
+  // Display lists and submission contexts keep the mode of every primitive.
+  BmpCanvas scene(16, 8, "", pixels, background);
+  auto context = scene.submission_context(1);
+  context->set_blend_mode(BlendMode::ERASE);
+  context->add_circle(3.0, 3.0, 2.0, BLACK);
+  for (BlendMode mode : MODES) {
+    scene.set_blend_mode(mode);
+    scene.add_line(0.0, 0.0, 5.0, 5.0, RED, 1.0);
+    scene.add_text(1.0, 1.0, "ab", 4.0, BLUE);
+  }
+  scene.update();
+
+  BmpCanvas replayed(16, 8, "", pixels, background);
+  DisplayList(DisplayList::encode(scene)).replay(replayed);
+  const auto& a = scene.get_primitives();
+  const auto& b = replayed.get_primitives();
+  if (a.size() != 2 * std::size(MODES) + 1 ||
+      primitive_blend_mode(a.back()) != BlendMode::ERASE ||
+      !std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                  [](const Primitive& p, const Primitive& q) {
+                    return primitive_blend_mode(p) == primitive_blend_mode(q);
+                  })) {
+    std::cerr << "Blend modes were lost\n";
+    return 1;
+  }
+
+  // Records written without a blend mode blend over.
+  BmpCanvas old(16, 8, "", pixels, background);
+  old.set_blend_mode(BlendMode::ADD);
+  old.add_circle(3.0, 3.0, 2.0, BLACK);
+  std::vector<uint8_t> bytes = DisplayList::encode(old);
+  bytes.resize(bytes.size() - 4);
+  bytes[36] -= 4;
+  BmpCanvas legacy(16, 8, "", pixels, background);
+  DisplayList(bytes).replay(legacy);
+  if (primitive_blend_mode(legacy.get_primitives().front()) !=
+      BlendMode::OVER) {
+    std::cerr << "Legacy record did not blend over\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+static void put_u32(std::string& s, size_t at, uint32_t v) {
+  for (int i = 0; i < 4; i++) s[at + i] = char(v >> (8 * i));
+}
+
+int main() {
+  Viewport v = {.top = 1.0, .bottom = -1.0, .left = -1.0, .right = 1.0};
+
+  // Odd width, so rows are padded and the vector loop has a tail.
+  BmpCanvas original(37, 21, "bmp_load.bmp", v, WHITE);
+  original.add_circle(0.0, 0.0, 0.6, BLUE);
+  original.add_triangle(Vec2(-1.0, -1.0), Vec2(0.5, -1.0), Vec2(-1.0, 0.8),
+                        Rgba{.r = 0.8, .g = 0.3, .b = 0.1, .a = 0.5});
+  original.update();
+  original.display();
+
+  // Loading and writing again reproduces the file byte for byte.
+  auto loaded = BmpCanvas::load("bmp_load.bmp", "bmp_load_copy.bmp", v);
+  loaded->display();
+  if (read_file("bmp_load.bmp") != read_file("bmp_load_copy.bmp")) {
+    std::cerr << "Loaded BMP does not write back the same\n";
+    return 1;
+  }
+
+  MappedBmpCanvas view("bmp_load.bmp", v);
+  for (uint32_t y = 0; y < 21; y++) {
+    for (uint32_t x = 0; x < 37; x++) {
+      if (!(view.get_pixel(x, y) == loaded->get_pixel(x, y))) {
+        std::cerr << "Mapped pixel " << x << ", " << y << " differs\n";
+        return 1;
+      }
+    }
+  }
+
+  // The view is a blit source like any other canvas.
+  BmpCanvas from_view(50, 50, "bmp_load_blit.bmp", v, WHITE);
+  BmpCanvas from_loaded(50, 50, "bmp_load_blit_reference.bmp", v, WHITE);
+  Viewport location = {.top = 0.5, .bottom = -0.7, .left = -0.9, .right = 0.2};
+  from_view.blit_canvas(view, location);
+  from_loaded.blit_canvas(*loaded, location);
+  from_view.display();
+  from_loaded.display();
+  if (read_file("bmp_load_blit.bmp") !=
+      read_file("bmp_load_blit_reference.bmp")) {
+    std::cerr << "Blit from the mapped view differs\n";
+    return 1;
+  }
+
+  // A top down 32 bit file with an alpha mask, as image editors write them.
+  std::string bgra(122 + 3 * 2 * 4, '\0');
+  bgra[0] = 'B';
+  bgra[1] = 'M';
+  put_u32(bgra, 2, bgra.size());
+  put_u32(bgra, 10, 122);
+  put_u32(bgra, 14, 108);
+  put_u32(bgra, 18, 3);
+  put_u32(bgra, 22, uint32_t(-2));
+  bgra[26] = 1;
+  bgra[28] = 32;
+  put_u32(bgra, 30, 3);
+  put_u32(bgra, 54, 0x00ff0000);
+  put_u32(bgra, 58, 0x0000ff00);
+  put_u32(bgra, 62, 0x000000ff);
+  put_u32(bgra, 66, 0xff000000);
+  const uint8_t pixels[2][3][4] = {
+      {{255, 0, 0, 255}, {0, 255, 0, 128}, {0, 0, 255, 0}},
+      {{10, 20, 30, 40}, {50, 60, 70, 80}, {90, 100, 110, 120}},
+  };
+  std::memcpy(&bgra[122], pixels, sizeof(pixels));
+  std::ofstream("bmp_load_bgra.bmp", std::ios::binary) << bgra;
+
+  auto rgba = BmpCanvas::load("bmp_load_bgra.bmp", "unused.bmp", v);
+  MappedBmpCanvas rgba_view("bmp_load_bgra.bmp", v);
+  for (uint32_t row = 0; row < 2; row++) {
+    for (uint32_t x = 0; x < 3; x++) {
+      const uint8_t* p = pixels[row][x];
+      Rgba expected = {.r = p[2] / 255.0f,
+                       .g = p[1] / 255.0f,
+                       .b = p[0] / 255.0f,
+                       .a = p[3] / 255.0f};
+      // The first stored row is the top one.
+      uint32_t y = 1 - row;
+      for (FrameBufferCanvas* c : {(FrameBufferCanvas*)rgba.get(),
+                                   (FrameBufferCanvas*)&rgba_view}) {
+        Rgba got = c->get_pixel(x, y);
+        if (std::abs(got.r - expected.r) > 1e-6 ||
+            std::abs(got.g - expected.g) > 1e-6 ||
+            std::abs(got.b - expected.b) > 1e-6 ||
+            std::abs(got.a - expected.a) > 1e-6) {
+          std::cerr << "BGRA pixel " << x << ", " << y << " decoded wrong\n";
+          return 1;
+        }
+      }
+    }
+  }
+
+  // Compressed or palette files are refused.
+  put_u32(bgra, 30, 1);
+  std::ofstream("bmp_load_rle.bmp", std::ios::binary) << bgra;
+  try {
+    MappedBmpCanvas rle("bmp_load_rle.bmp", v);
+    std::cerr << "RLE file was accepted\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+static size_t stored_points(const Canvas::Canvas& img) {
+  return std::get<Polyline>(img.get_primitives().front()).points.size();
+}
+
+// A window without a display, resized through its event queue like
+// GLFWCanvas.
+class HeadlessWindow : public WindowCanvas {
+ public:
+  std::list<Event> events;
+
+  HeadlessWindow(Viewport viewport)
+      : WindowCanvas(std::make_shared<WindowHandler>(), viewport) {
+    event_width = 300;
+    event_height = 200;
+  }
+
+  void resize(uint32_t new_width, uint32_t new_height) {
+    events.push_back(WindowResizeEvent{.new_width = new_width,
+                                       .new_height = new_height});
+  }
+  virtual std::optional<Transform2D> pixel_transform() const override {
+    return Transform2D::between(
+        viewport, Viewport{.top = float(event_height),
+                           .bottom = 0.0f,
+                           .left = 0.0f,
+                           .right = float(event_width)});
+  }
+  virtual void display() override { update(); }
+
+ protected:
+  virtual std::optional<Event> next_event() override {
+    if (events.empty()) return {};
+    Event e = events.front();
+    events.pop_front();
+    return e;
+  }
+  virtual void draw_primitive(const Line& l) override {}
+  virtual void draw_primitive(const Circle& c) override {}
+  virtual void draw_primitive(const Triangle& p) override {}
+  virtual void draw_primitive(const Polygon& p) override {}
+  virtual void draw_primitive(const Polyline& p) override {}
+  virtual void draw_primitive(const Bezier& b) override {}
+  virtual void draw_primitive(const Text& t) override {}
+  virtual void draw_primitive(const Image& i) override {}
+};
+
+int main() {
+  // A random walk sampled far more densely than the pixel columns.
+  std::vector<std::pair<float, float>> series;
+  uint64_t state = 1;
+  auto next = [&] {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return float(state >> 40) / float(1ull << 24) - 0.5f;
+  };
+  float y = 0.0f;
+  for (uint32_t i = 0; i < 200000; i++) {
+    y += next() * 0.05f;
+    series.emplace_back(i * 10.0f / 200000, y);
+  }
+
+  // Hairlines through the M4 points cover the same pixels as through all
+  // of them, at the first viewport and after zooming in.
+  Viewport full = {.top = 3.0, .bottom = -3.0, .left = 0.0, .right = 10.0};
+  Viewport zoomed = {.top = 1.0, .bottom = -1.0, .left = 4.0, .right = 5.0};
+  for (Viewport v : {full, zoomed}) {
+    BmpCanvas reference(300, 200, "decimation_reference.bmp", full, WHITE);
+    BmpCanvas img(300, 200, "decimation.bmp", full, WHITE);
+    img.set_decimation(true);
+    for (BmpCanvas* c : {&reference, &img}) {
+      c->add_connected_points(series, BLACK, 0.0);
+      c->set_viewport(v);
+      c->update();
+      c->display();
+    }
+
+    // At most four points per column, plus the ones off canvas.
+    size_t visible = 300;
+    if (v.left == zoomed.left) visible = 300 * 10 + 1;
+    if (stored_points(img) > 4 * visible) {
+      std::cerr << "Kept " << stored_points(img) << " points\n";
+      return 1;
+    }
+    if (read_file("decimation.bmp") != read_file("decimation_reference.bmp")) {
+      std::cerr << "M4 polyline differs at viewport " << v.left << " to "
+                << v.right << "\n";
+      return 1;
+    }
+
+    img.set_decimation(false);
+    if (stored_points(img) != series.size()) {
+      std::cerr << "Turning decimation off kept " << stored_points(img)
+                << " points\n";
+      return 1;
+    }
+  }
+
+  // A path doubling back is simplified instead, every dropped point stays
+  // within a quarter pixel of the segment replacing it.
+  std::vector<std::pair<float, float>> path;
+  Vec2 p(0.0f, 0.0f);
+  for (uint32_t i = 0; i < 50000; i++) {
+    p = p + Vec2(next(), next()) * 0.01f;
+    path.emplace_back(p.x, p.y);
+  }
+  BmpCanvas img(200, 200, "", Viewport{.top = 3.0, .bottom = -3.0,
+                                       .left = -3.0, .right = 3.0},
+                WHITE);
+  img.set_decimation(true);
+  img.add_connected_points(path, BLACK, 0.0);
+  const auto& kept = std::get<Polyline>(img.get_primitives().front()).points;
+  if (kept.size() >= path.size() / 4) {
+    std::cerr << "Simplified to " << kept.size() << " points\n";
+    return 1;
+  }
+
+  Transform2D to_pixels = img.pixel_transform().value();
+  size_t segment = 0;
+  for (auto [x, y] : path) {
+    Vec2 q(x, y);
+    if (segment + 1 < kept.size() && q.x == kept[segment + 1].x &&
+        q.y == kept[segment + 1].y) {
+      segment++;
+      continue;
+    }
+    Vec2 a = to_pixels.apply(kept[segment]);
+    Vec2 d = to_pixels.apply(kept[segment + 1]) - a;
+    Vec2 v = to_pixels.apply(q) - a;
+    float t = std::clamp(Vec2::dot(v, d) / d.len_squared(), 0.0f, 1.0f);
+    float dist = std::sqrt((v - d * t).len_squared());
+    if (dist > 0.25f + 1e-4f) {
+      std::cerr << "Dropped point " << dist << " pixels away\n";
+      return 1;
+    }
+  }
+
+  // Resizing a window decimates again for its new width.
+  HeadlessWindow window(full);
+  window.set_decimation(true);
+  window.add_connected_points(series, BLACK, 0.0);
+  size_t narrow = stored_points(window);
+  window.resize(3000, 200);
+  window.display();
+  if (narrow > 4 * 300 || stored_points(window) <= 4 * 300) {
+    std::cerr << "Resized window kept " << stored_points(window)
+              << " points, down from " << narrow << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+int main() {
+  // World coordinates are pixel coordinates, pixel (x, y) covers [x, x + 1).
+  Viewport pixels = {.top = 63.0, .bottom = 0.0, .left = 0.0, .right = 63.0};
+
+  // Enough points to be split over threads, some of them off the canvas.
+  std::vector<Vec2> points;
+  std::vector<float> weights;
+  for (uint32_t i = 0; i < 600000; i++) {
+    float x = std::fmod(i * 0.618034f, 1.0f) * 70.0f - 3.0f;
+    float y = std::fmod(i * 0.414214f, 1.0f) * 40.0f * (1 + i % 3 / 2.0f);
+    points.emplace_back(x, y);
+    weights.push_back(i % 4 * 0.5f);
+  }
+
+  // Counts and sums come out the same however many threads add them up, and
+  // match counting one point at a time.
+  std::vector<double> counts(64 * 64, 0.0), sums(64 * 64, 0.0);
+  for (size_t i = 0; i < points.size(); i++) {
+    Vec2 p = points[i];
+    if (p.x < 0.0f || p.x >= 64.0f || p.y < 0.0f || p.y >= 64.0f) continue;
+    counts[size_t(p.y) * 64 + size_t(p.x)] += 1.0;
+    sums[size_t(p.y) * 64 + size_t(p.x)] += weights[i];
+  }
+  for (uint32_t threads : {1, 2, 7}) {
+    DensityCanvas count(64, 64, "", pixels, WHITE, threads);
+    DensityCanvas sum(64, 64, "", pixels, WHITE, threads);
+    count.add_points(points);
+    count.add_points(points.data(), nullptr, 1000);
+    sum.add_points(points, weights);
+    for (uint32_t y = 0; y < 64; y++) {
+      for (uint32_t x = 0; x < 64; x++) {
+        double expected = counts[y * 64 + x];
+        for (size_t i = 0; i < 1000; i++) {
+          expected += uint32_t(points[i].x) == x &&
+                      uint32_t(points[i].y) == y && points[i].x >= 0.0f;
+        }
+        if (count.get_bin(x, y) != expected ||
+            sum.get_bin(x, y) != sums[y * 64 + x]) {
+          std::cerr << "Bin " << x << ", " << y << " with " << threads
+                    << " threads is " << count.get_bin(x, y) << " and "
+                    << sum.get_bin(x, y) << " instead of " << expected
+                    << " and " << sums[y * 64 + x] << "\n";
+          return 1;
+        }
+      }
+    }
+  }
+
+  // Bins of 1, 10 and 1000 points under each scale, with a black to white
+  // colormap.
+  struct Case {
+    DensityScale scale;
+    float expected[3];
+  };
+  for (auto c : {Case{DensityScale::LINEAR, {1 / 1000.0f, 0.01f, 1.0f}},
+                 Case{DensityScale::LOG,
+                      {float(std::log(2.0) / std::log(1001.0)),
+                       float(std::log(11.0) / std::log(1001.0)), 1.0f}},
+                 Case{DensityScale::EQUALIZED, {1 / 3.0f, 2 / 3.0f, 1.0f}}}) {
+    DensityCanvas img(4, 1, "", Viewport{.top = 1.0, .bottom = 0.0,
+                                         .left = 0.0, .right = 3.0},
+                      RED);
+    img.set_colormap({BLACK, WHITE});
+    img.set_scale(c.scale);
+    img.add_points(std::vector<Vec2>(1, Vec2(0.0, 0.0)));
+    img.add_points(std::vector<Vec2>(10, Vec2(1.0, 0.0)));
+    img.add_points(std::vector<Vec2>(1000, Vec2(2.0, 0.0)));
+    img.update();
+
+    for (uint32_t x = 0; x < 3; x++) {
+      if (std::abs(img.get_pixel(x, 0).r - c.expected[x]) > 1e-5f) {
+        std::cerr << "Scale " << int(c.scale) << " maps bin " << x << " to "
+                  << img.get_pixel(x, 0).r << " instead of " << c.expected[x]
+                  << "\n";
+        return 1;
+      }
+    }
+    if (!(img.get_pixel(3, 0) == RED)) {
+      std::cerr << "Empty bin is not the background\n";
+      return 1;
+    }
+  }
+
+  // Primitives are drawn over the density, and updating again starts from
+  // the bins rather than the previous pixels.
+  DensityCanvas img(8, 8, "", Viewport{.top = 7.0, .bottom = 0.0, .left = 0.0,
+                                       .right = 7.0},
+                    WHITE);
+  img.set_colormap({BLUE});
+  img.add_points({Vec2(2.5, 2.5)});
+  img.add_triangle(Vec2(-1.0, 4.0), Vec2(9.0, 4.0), Vec2(4.0, 20.0),
+                   Rgba{.r = 0.0, .g = 0.0, .b = 0.0, .a = 0.5});
+  img.update();
+  img.update();
+  if (!(img.get_pixel(2, 2) == BLUE) || !(img.get_pixel(0, 0) == WHITE) ||
+      std::abs(img.get_pixel(4, 6).r - 0.5f) > 1e-5f) {
+    std::cerr << "Primitives over the density are wrong\n";
+    return 1;
+  }
+  return 0;
+}
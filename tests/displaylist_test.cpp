@@ -0,0 +1,96 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+template <typename F>
+static bool throws(F f) {
+  try {
+    f();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+
+  BmpCanvas reference(151, 117, "displaylist_reference.bmp", viewport, WHITE);
+  add_test_scene(reference, make_test_tile(), "Display\nlist");
+  reference.update();
+  reference.display();
+  std::string expected = read_file("displaylist_reference.bmp");
+
+  DisplayList::save("scene.cvdl", reference);
+
+  // Replaying the mapped file, or the same bytes from memory, draws the
+  // scene exactly as recorded.
+  DisplayList mapped = DisplayList::map("scene.cvdl");
+  DisplayList in_memory(DisplayList::encode(reference));
+  for (const DisplayList* list : {&mapped, &in_memory}) {
+    if (list->get_primitive_count() != reference.get_primitives().size()) {
+      std::cerr << "Unexpected primitive count\n";
+      return 1;
+    }
+    Viewport v = list->get_viewport();
+    BmpCanvas replayed(151, 117, "displaylist.bmp", v, WHITE);
+    list->replay(replayed);
+    replayed.update();
+    replayed.display();
+    if (read_file("displaylist.bmp") != expected) {
+      std::cerr << "Replayed scene differs from the recorded one\n";
+      return 1;
+    }
+  }
+
+  // Broken input is reported instead of drawn.
+  std::vector<uint8_t> bytes = DisplayList::encode(reference);
+  std::vector<uint8_t> bad_magic = bytes;
+  bad_magic[0] = 'X';
+  std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 8);
+  std::vector<uint8_t> bad_size = bytes;
+  bad_size[36] = 0xff;
+  bad_size[37] = 0xff;
+
+  // Fill rules and joins out of range, just after the record header and
+  // the color.
+  BmpCanvas shapes(8, 8, "", viewport, WHITE);
+  shapes.add_polygon({{0, 0}, {1, 0}, {1, 1}}, BLACK);
+  std::vector<uint8_t> bad_rule = DisplayList::encode(shapes);
+  bad_rule[32 + 8 + 16] = 7;
+  BmpCanvas lines(8, 8, "", viewport, WHITE);
+  lines.add_polyline({{0, 0}, {1, 1}}, BLACK, 0.1);
+  std::vector<uint8_t> bad_join = DisplayList::encode(lines);
+  bad_join[32 + 8 + 20] = 7;
+
+  BmpCanvas scratch(8, 8, "", viewport, WHITE);
+  if (!throws([&] { DisplayList{bad_magic}; }) ||
+      !throws([&] { DisplayList{bad_rule}.replay(scratch); }) ||
+      !throws([&] { DisplayList{bad_join}.replay(scratch); }) ||
+      !throws([&] { DisplayList{truncated}.replay(scratch); }) ||
+      !throws([&] { DisplayList{bad_size}.replay(scratch); }) ||
+      !throws([&] { DisplayList::map("missing.cvdl"); })) {
+    std::cerr << "Broken display list was accepted\n";
+    return 1;
+  }
+
+  // Text is stored in reading order, not as a little endian value, and read
+  // back unchanged whatever the byte order of the host.
+  BmpCanvas text(8, 8, "", viewport, WHITE);
+  text.add_text(0.0, 0.0, "Text bytes", 1.0, BLACK);
+  std::vector<uint8_t> text_bytes = DisplayList::encode(text);
+  BmpCanvas text_replayed(8, 8, "", viewport, WHITE);
+  DisplayList(text_bytes).replay(text_replayed);
+  const Text& t = std::get<Text>(text_replayed.get_primitives().front());
+  if (std::string(text_bytes.begin(), text_bytes.end()).find("Text bytes") ==
+          std::string::npos ||
+      t.text != "Text bytes") {
+    std::cerr << "Text was not stored as written\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,173 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+static bool same_rect(PixelRect a, PixelRect b) {
+  return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+}
+
+// A window drawing images from their snapshots like GLFWCanvas, keeping
+// the red channel of the first pixel and the rect it would upload.
+class SnapshotWindow : public WindowCanvas {
+ public:
+  uint8_t red = 0;
+  uint64_t revision = 0;
+  PixelRect changed;
+
+  SnapshotWindow(Viewport viewport)
+      : WindowCanvas(std::make_shared<WindowHandler>(), viewport) {}
+
+  void draw() { render(); }
+  bool scene_pending() { return needs_redraw(); }
+  virtual void display() override {}
+
+ protected:
+  virtual std::optional<Event> next_event() override { return {}; }
+  virtual void draw_primitive(const Line& l) override {}
+  virtual void draw_primitive(const Circle& c) override {}
+  virtual void draw_primitive(const Triangle& p) override {}
+  virtual void draw_primitive(const Polygon& p) override {}
+  virtual void draw_primitive(const Polyline& p) override {}
+  virtual void draw_primitive(const Bezier& b) override {}
+  virtual void draw_primitive(const Text& t) override {}
+  virtual void draw_primitive(const Image& i) override {
+    const ImageSnapshot* s = image_snapshot(i.source->get_image_id());
+    if (s == nullptr) return;
+    red = s->pixels[0];
+    changed = s->damage_since(revision);
+    revision = s->revision;
+  }
+};
+
+int main() {
+  Viewport unit = {.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0};
+
+  // A 2x2 source with a distinct color in every pixel.
+  auto source = std::make_shared<BmpCanvas>(2, 2, "", unit, WHITE);
+  source->set_pixel(0, 0, RED);
+  source->set_pixel(1, 0, GREEN);
+  source->set_pixel(0, 1, BLUE);
+  source->set_pixel(1, 1, BLACK);
+  source->mark_damaged();
+
+  // One world unit per pixel, the image covers x and y in [8, 23].
+  Viewport pixels = {.top = 63.0, .bottom = 0.0, .left = 0.0, .right = 63.0};
+  BmpCanvas img(64, 64, "", pixels, WHITE);
+  img.add_image(source, Viewport{.top = 23.0, .bottom = 8.0, .left = 8.0,
+                                 .right = 23.0});
+  img.update();
+
+  struct Expected {
+    uint32_t x, y;
+    Rgba color;
+  };
+  for (auto e : {Expected{8, 8, RED}, Expected{23, 8, GREEN},
+                 Expected{8, 23, BLUE}, Expected{23, 23, BLACK},
+                 Expected{7, 8, WHITE}, Expected{24, 24, WHITE}}) {
+    if (!(img.get_pixel(e.x, e.y) == e.color)) {
+      std::cerr << "Unexpected color at " << e.x << ", " << e.y << "\n";
+      return 1;
+    }
+  }
+
+  // A mirrored location mirrors the image.
+  BmpCanvas mirrored(64, 64, "", pixels, WHITE);
+  mirrored.add_image(source, Viewport{.top = 23.0, .bottom = 8.0,
+                                      .left = 23.0, .right = 8.0});
+  mirrored.update();
+  if (!(mirrored.get_pixel(8, 8) == GREEN)) {
+    std::cerr << "Mirrored location does not mirror the image\n";
+    return 1;
+  }
+
+  // Inside a layer the image keeps its colors, also when it is the only
+  // primitive there.
+  BmpCanvas layered(64, 64, "", pixels, WHITE);
+  layered.add_primitive(PushLayer{.opacity = 1.0});
+  layered.add_image(source, Viewport{.top = 23.0, .bottom = 8.0, .left = 8.0,
+                                     .right = 23.0});
+  layered.add_primitive(PopLayer{});
+  layered.update();
+  if (!(layered.get_pixel(8, 8) == RED) ||
+      !(layered.get_pixel(23, 8) == GREEN) ||
+      !(layered.get_pixel(8, 23) == BLUE)) {
+    std::cerr << "Image inside a layer lost its colors\n";
+    return 1;
+  }
+
+  // Every update records the rect it drew, older revisions see the union of
+  // the changes since.
+  BmpCanvas canvas(64, 64, "", pixels, WHITE);
+  uint64_t start = canvas.get_revision();
+  canvas.add_triangle(Vec2(10, 10), Vec2(20, 10), Vec2(10, 20), RED);
+  canvas.update();
+  uint64_t first = canvas.get_revision();
+  PixelRect drawn = canvas.damage_since(start);
+  if (first == start || drawn.empty() || !drawn.contains(10, 10) ||
+      !drawn.contains(19, 19) || drawn.contains(30, 30)) {
+    std::cerr << "Update did not record its damage\n";
+    return 1;
+  }
+  if (!canvas.damage_since(first).empty()) {
+    std::cerr << "Damage reported without a change\n";
+    return 1;
+  }
+
+  canvas.clear_primitives();
+  canvas.mark_damaged(PixelRect{.x0 = 40, .y0 = 40, .x1 = 41, .y1 = 41});
+  if (!same_rect(canvas.damage_since(first),
+                 PixelRect{.x0 = 40, .y0 = 40, .x1 = 41, .y1 = 41}) ||
+      !same_rect(canvas.damage_since(start),
+                 drawn.unite(PixelRect{.x0 = 40, .y0 = 40, .x1 = 41,
+                                       .y1 = 41}))) {
+    std::cerr << "Unexpected damage after mark_damaged\n";
+    return 1;
+  }
+
+  // Revisions older than the history report the whole canvas.
+  for (int i = 0; i < 20; i++) {
+    canvas.mark_damaged(PixelRect{.x0 = 0, .y0 = 0, .x1 = 1, .y1 = 1});
+  }
+  if (!same_rect(canvas.damage_since(start),
+                 PixelRect{.x0 = 0, .y0 = 0, .x1 = 64, .y1 = 64})) {
+    std::cerr << "Old revision does not report the whole canvas\n";
+    return 1;
+  }
+
+  if (source->get_image_id() == img.get_image_id()) {
+    std::cerr << "Image ids are not unique\n";
+    return 1;
+  }
+
+  // Threaded windows draw images as they were when the scene was published,
+  // and publish again for a changed source even when the scene is not.
+  auto target = std::make_shared<BmpCanvas>(4, 4, "", unit, WHITE);
+  SnapshotWindow window(unit);
+  window.add_image(target, unit);
+  window.set_threaded(true);
+  target->set_pixel(0, 0, BLUE);
+  target->mark_damaged(PixelRect{.x0 = 0, .y0 = 0, .x1 = 1, .y1 = 1});
+  window.draw();
+  if (window.red != 255) {
+    std::cerr << "Window drew the image source after it was published\n";
+    return 1;
+  }
+
+  window.update();
+  for (int i = 0; i < 1000 && !window.scene_pending(); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  window.draw();
+  if (window.red != 0 ||
+      !same_rect(window.changed,
+                 PixelRect{.x0 = 0, .y0 = 0, .x1 = 1, .y1 = 1})) {
+    std::cerr << "Changed image source was not published\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+static bool close_to(const Rgba& a, const Rgba& b) {
+  return std::abs(a.r - b.r) < 0.01 && std::abs(a.g - b.g) < 0.01 &&
+         std::abs(a.b - b.b) < 0.01 && std::abs(a.a - b.a) < 0.01;
+}
+
+int main() {
+  BmpCanvas img(
+      200, 200, "layer.bmp",
+      Viewport{.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0}, WHITE);
+
+  // Overlapping opaque circles in a half transparent layer must not get
+  // darker where they overlap.
+  img.push_layer(0.5);
+  img.add_circle(-1.0, 0.0, 2.0, RED);
+  img.add_circle(1.0, 0.0, 2.0, RED);
+  img.pop_layer();
+
+  // Mixed colors go through the RGBA layer, clipped to the upper half.
+  img.push_layer(0.5, Viewport{.top = 5.0, .bottom = 3.0, .left = -5.0,
+                               .right = 5.0});
+  img.add_triangle(Vec2(-4.0, 2.0), Vec2(4.0, 2.0), Vec2(0.0, 4.5), BLUE);
+  img.add_line(-4.0, 4.0, 4.0, 4.0, GREEN, 0.2);
+  img.pop_layer();
+
+  img.update();
+  img.display();
+
+  Rgba half_red = {1.0, 0.5, 0.5, 1.0};
+  Rgba overlap = img.sample(0.0, 0.0).value();
+  Rgba single = img.sample(-2.0, 0.0).value();
+  Rgba half_blue = {0.5, 0.5, 1.0, 1.0};
+  Rgba clipped = img.sample(0.0, 2.5).value();
+  Rgba inside = img.sample(0.0, 3.5).value();
+
+  if (!close_to(overlap, half_red) || !close_to(single, half_red)) {
+    std::cerr << "Layer overlap is not uniform\n";
+    return 1;
+  }
+  if (!(clipped == WHITE) || !close_to(inside, half_blue)) {
+    std::cerr << "Layer clip was not applied\n";
+    return 1;
+  }
+  return 0;
+}
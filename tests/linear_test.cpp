@@ -0,0 +1,87 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+// Blue, green and red of the bottom left pixel of a BMP file.
+static std::array<uint8_t, 3> first_pixel(const std::string& path) {
+  std::string data = read_file(path);
+  return {uint8_t(data[54]), uint8_t(data[55]), uint8_t(data[56])};
+}
+
+int main() {
+  // Every 8 bit sRGB value survives the trip through linear light.
+  for (uint32_t i = 0; i < 256; i++) {
+    if (linear_to_srgb8(srgb_to_linear(i / 255.0f)) != i) {
+      std::cerr << "sRGB " << i << " does not round trip\n";
+      return 1;
+    }
+  }
+
+  Viewport unit = {.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0};
+  Rgba half_white = {.r = 1.0, .g = 1.0, .b = 1.0, .a = 0.5};
+
+  // Half white over black is half the light, which sRGB encodes as 188
+  // rather than the 127 of blending the encoded values.
+  for (bool linear : {false, true}) {
+    BmpCanvas img(4, 4, "linear.bmp", unit, BLACK);
+    img.set_linear_blending(linear);
+    img.add_triangle(Vec2(-1.0, -1.0), Vec2(3.0, -1.0), Vec2(-1.0, 3.0),
+                     half_white);
+    img.update();
+    img.display();
+
+    uint8_t expected = linear ? 188 : 127;
+    for (uint8_t v : first_pixel("linear.bmp")) {
+      if (v != expected) {
+        std::cerr << "Got " << int(v) << " instead of " << int(expected)
+                  << (linear ? " with linear blending\n" : "\n");
+        return 1;
+      }
+    }
+
+    // sample() answers in sRGB either way.
+    float r = img.sample(0.0, 0.0).value().r;
+    if (std::abs(r - expected / 255.0f) > 1.0f / 255.0f) {
+      std::cerr << "Sampled " << r
+                << (linear ? " with linear blending\n" : "\n");
+      return 1;
+    }
+  }
+
+  // Layers composite in linear light as well.
+  BmpCanvas layered(4, 4, "linear_layer.bmp", unit, BLACK);
+  layered.set_linear_blending(true);
+  layered.push_layer(0.5);
+  layered.add_triangle(Vec2(-1.0, -1.0), Vec2(3.0, -1.0), Vec2(-1.0, 3.0),
+                       WHITE);
+  layered.pop_layer();
+  layered.update();
+  layered.display();
+  for (uint8_t v : first_pixel("linear_layer.bmp")) {
+    if (v < 187 || v > 189) {
+      std::cerr << "Layer composited to " << int(v) << "\n";
+      return 1;
+    }
+  }
+
+  // Switching modes converts the pixels, the output only differs by the
+  // rounding of the encoders.
+  BmpCanvas switched(4, 4, "switched.bmp", unit,
+                     Rgba{.r = 0.2, .g = 0.6, .b = 0.9, .a = 1.0});
+  switched.display();
+  std::array<uint8_t, 3> before = first_pixel("switched.bmp");
+  switched.set_linear_blending(true);
+  switched.display();
+  std::array<uint8_t, 3> after = first_pixel("switched.bmp");
+  for (size_t i = 0; i < 3; i++) {
+    if (std::abs(int(before[i]) - int(after[i])) > 1) {
+      std::cerr << "Switching modes changed the pixels\n";
+      return 1;
+    }
+  }
+  return 0;
+}
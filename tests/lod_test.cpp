@@ -0,0 +1,100 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+static void add_scatter(Canvas::Canvas& img) {
+  // Sub-pixel circles, lines and triangles on and between pixel centers.
+  for (int i = 0; i < 400; i++) {
+    float x = std::fmod(i * 0.618034f, 1.0f) * 31.0f;
+    float y = std::fmod(i * 0.414214f, 1.0f) * 23.0f;
+    Rgba color = {.r = 0.0, .g = 0.2, .b = 0.6, .a = 0.8};
+    switch (i % 4) {
+      case 0:
+        img.add_circle(x, y, 0.3, color);
+        break;
+      case 1:
+        img.add_line(x, y, x + 0.4, y + 0.2, color, 0.0);
+        break;
+      case 2:
+        img.add_line(x, y, x + 0.2, y - 0.3, color, 0.1);
+        break;
+      case 3:
+        img.add_triangle(Vec2(x, y), Vec2(x + 0.5, y), Vec2(x, y + 0.5),
+                         color);
+        break;
+    }
+  }
+  img.add_circle(10.0, 10.0, 4.0, RED);
+  img.add_line(2.0, 20.0, 28.0, 3.0, GREEN, 0.5);
+}
+
+int main() {
+  // World coordinates are pixel coordinates, pixel (x, y) covers [x, x + 1).
+  Viewport pixels = {.top = 7.0, .bottom = 0.0, .left = 0.0, .right = 7.0};
+  const float area = M_PI * 0.25 * 0.25;
+
+  // A splat centered on a pixel lands on it alone, with alpha scaled by the
+  // area of the circle, one between four pixels is shared evenly.
+  BmpCanvas img(8, 8, "", pixels, WHITE);
+  img.set_lod_threshold(1.0);
+  img.add_circle(3.5, 3.5, 0.25, BLACK);
+  img.add_circle(6.0, 2.0, 0.25, BLACK);
+  img.update();
+  for (uint32_t y = 0; y < 8; y++) {
+    for (uint32_t x = 0; x < 8; x++) {
+      float expected = 1.0f;
+      if (x == 3 && y == 3) expected -= area;
+      if ((x == 5 || x == 6) && (y == 1 || y == 2)) expected -= area / 4.0f;
+      if (std::abs(img.get_pixel(x, y).r - expected) > 1e-5f) {
+        std::cerr << "Pixel " << x << ", " << y << " is "
+                  << img.get_pixel(x, y).r << " instead of " << expected
+                  << "\n";
+        return 1;
+      }
+    }
+  }
+
+  // Primitives above the threshold, and the triangles they are split into,
+  // are drawn exactly as without LOD.
+  Viewport scene = {.top = 23.0, .bottom = 0.0, .left = 0.0, .right = 31.0};
+  for (float threshold : {0.0f, 1.5f}) {
+    BmpCanvas large(32, 24, threshold > 0.0f ? "lod.bmp" : "lod_off.bmp",
+                    scene, WHITE);
+    large.set_lod_threshold(threshold);
+    large.add_circle(10.0, 10.0, 4.0, RED);
+    large.add_line(2.0, 20.0, 28.0, 3.0, GREEN, 0.5);
+    large.add_triangle(Vec2(1.0, 1.0), Vec2(30.0, 2.0), Vec2(15.0, 22.0),
+                       Rgba{.r = 0.0, .g = 0.0, .b = 1.0, .a = 0.3});
+    large.update();
+    large.display();
+  }
+  if (read_file("lod.bmp") != read_file("lod_off.bmp")) {
+    std::cerr << "LOD changed primitives above the threshold\n";
+    return 1;
+  }
+
+  // Splats straddling band edges come out the same drawn in bands.
+  for (bool linear : {false, true}) {
+    BmpCanvas whole(32, 24, "lod_whole.bmp", scene, WHITE);
+    BandedBmpCanvas banded(32, 24, 5, "lod_banded.bmp", scene, WHITE);
+    for (FrameBufferCanvas* c : {(FrameBufferCanvas*)&whole,
+                                 (FrameBufferCanvas*)&banded}) {
+      c->set_lod_threshold(1.0);
+      c->set_linear_blending(linear);
+      add_scatter(*c);
+    }
+    whole.update();
+    whole.display();
+    banded.display();
+    if (read_file("lod_whole.bmp") != read_file("lod_banded.bmp")) {
+      std::cerr << "Banded splats differ"
+                << (linear ? " with linear blending\n" : "\n");
+      return 1;
+    }
+  }
+  return 0;
+}
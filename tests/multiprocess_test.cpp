@@ -0,0 +1,63 @@
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+int main() {
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+  auto tile = make_test_tile();
+
+  for (bool linear : {false, true}) {
+    BmpCanvas reference(203, 157, "multiprocess_reference.bmp", viewport,
+                        WHITE);
+    reference.set_linear_blending(linear);
+    add_test_scene(reference, tile, "Tiled\ntext 123");
+    reference.update();
+    reference.display();
+    std::string expected = read_file("multiprocess_reference.bmp");
+
+    // Tiles that split primitives in both directions and do not divide the
+    // image, with more or fewer workers than tiles.
+    struct Split {
+      uint32_t tile_size, workers;
+    };
+    for (auto split : {Split{1000, 1}, Split{64, 4}, Split{37, 3},
+                       Split{5, 8}}) {
+      MultiProcessBmpCanvas img(203, 157, split.tile_size, split.workers,
+                                "multiprocess.bmp", viewport, WHITE);
+      img.set_linear_blending(linear);
+      add_test_scene(img, tile, "Tiled\ntext 123");
+      img.update();
+      img.display();
+
+      if (read_file("multiprocess.bmp") != expected) {
+        std::cerr << split.tile_size << " pixel tiles in " << split.workers
+                  << " workers differ from the single process image"
+                  << (linear ? " with linear blending\n" : "\n");
+        return 1;
+      }
+    }
+  }
+
+  // Pixels hold the last display(), immediate operations would be painted
+  // over by the tiles and are refused.
+  MultiProcessBmpCanvas tiled(8, 8, 4, 2, "multiprocess_small.bmp", viewport,
+                              RED);
+  tiled.add_circle(0.0, 0.0, 100.0, GREEN);
+  tiled.display();
+  tiled.set_pixel(1, 1, BLUE);
+  tiled.floodfill(0.0f, 0.0f, BLUE);
+  tiled.blit_canvas(*tile, viewport);
+  for (uint32_t y = 0; y < 8; y++) {
+    for (uint32_t x = 0; x < 8; x++) {
+      if (!(tiled.get_pixel(x, y) == GREEN)) {
+        std::cerr << "Immediate operation changed pixel " << x << ", " << y
+                  << "\n";
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+static const LineJoin JOINS[] = {LineJoin::ROUND, LineJoin::MITER,
+                                 LineJoin::BEVEL};
+
+static bool near(const Rgba& a, const Rgba& b) {
+  return std::abs(a.r - b.r) < 1e-5f && std::abs(a.g - b.g) < 1e-5f &&
+         std::abs(a.b - b.b) < 1e-5f && std::abs(a.a - b.a) < 1e-5f;
+}
+
+// A square with a square hole, the hole running counter clockwise like the
+// outside or the other way around.
+static std::vector<std::vector<Vec2>> square_with_hole(bool reversed) {
+  std::vector<Vec2> hole = {{8, 4}, {14, 4}, {14, 10}, {8, 10}};
+  if (reversed) hole = {{8, 4}, {8, 10}, {14, 10}, {14, 4}};
+  return {{{4, 1}, {18, 1}, {18, 13}, {4, 13}}, hole};
+}
+
+// Sharp, shallow and right angled turns, and a segment crossing the first.
+static const std::vector<Vec2> PATH = {
+    {2, 2}, {20, 2}, {20, 12}, {6, 5}, {12, 0}};
+
+template <typename T>
+static void add_scene(T& img) {
+  Rgba translucent = {.r = 0.9, .g = 0.3, .b = 0.5, .a = 0.6};
+  img.add_polygon(square_with_hole(false), translucent, FillRule::EVEN_ODD);
+  img.add_polygon(square_with_hole(true), BLUE, FillRule::NON_ZERO);
+  for (LineJoin join : JOINS) {
+    img.add_polyline(PATH, translucent, 1.5, join);
+  }
+}
+
+int main() {
+  // World coordinates are pixel centers.
+  Viewport pixels = {.top = 15.0, .bottom = 0.0, .left = 0.0, .right = 23.0};
+  Rgba background = {.r = 0.2, .g = 0.6, .b = 0.4, .a = 0.8};
+  Rgba color = {.r = 0.9, .g = 0.3, .b = 0.5, .a = 0.6};
+  Rgba expected = blend_colors(BlendMode::OVER, color, background);
+
+  // Holes cancel out under EVEN_ODD whatever their direction, and under
+  // NON_ZERO only when they run the other way around.
+  struct Case {
+    FillRule rule;
+    bool reversed;
+    bool hole;
+  };
+  for (Case c : {Case{FillRule::EVEN_ODD, false, true},
+                 Case{FillRule::EVEN_ODD, true, true},
+                 Case{FillRule::NON_ZERO, false, false},
+                 Case{FillRule::NON_ZERO, true, true}}) {
+    BmpCanvas img(24, 16, "", pixels, background);
+    img.add_polygon(square_with_hole(c.reversed), color, c.rule);
+    img.update();
+    if (!near(*img.sample(5.0, 7.0), expected) ||
+        !near(*img.sample(11.0, 7.0), c.hole ? background : expected) ||
+        !near(*img.sample(21.0, 7.0), background)) {
+      std::cerr << (c.rule == FillRule::EVEN_ODD ? "Even-odd" : "Non-zero")
+                << " polygon with a" << (c.reversed ? " reversed" : "")
+                << " hole is wrong\n";
+      return 1;
+    }
+  }
+
+  // Translucent polylines are filled as one shape, so joins and the
+  // crossing segments are blended once with every join.
+  for (LineJoin join : JOINS) {
+    BmpCanvas img(24, 16, "", pixels, background);
+    img.add_polyline(PATH, color, 1.5, join);
+    img.update();
+
+    bool once = true;
+    for (Vec2 p : PATH) {
+      once = once && near(*img.sample(p.x, p.y), expected);
+    }
+    for (uint32_t y = 0; y < 16; y++) {
+      for (uint32_t x = 0; x < 24; x++) {
+        Rgba px = img.get_pixel(x, y);
+        once = once && (near(px, expected) || near(px, background));
+      }
+    }
+    if (!once) {
+      std::cerr << "Polyline with join " << int(join)
+                << " blends pixels more than once\n";
+      return 1;
+    }
+  }
+
+  // Banded output matches drawing the whole image at once.
+  BmpCanvas reference(24, 16, "polygon_reference.bmp", pixels, background);
+  add_scene(reference);
+  reference.update();
+  reference.display();
+  std::string expected_file = read_file("polygon_reference.bmp");
+  for (uint32_t band_height : {1u, 5u, 16u}) {
+    BandedBmpCanvas img(24, 16, band_height, "polygon_banded.bmp", pixels,
+                        background);
+    add_scene(img);
+    img.update();
+    img.display();
+    if (read_file("polygon_banded.bmp") != expected_file) {
+      std::cerr << "Band height " << band_height
+                << " differs from the full image\n";
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+template <typename T>
+static void draw_frame(T& img, int frame) {
+  img.clear_primitives();
+  img.add_circle(-3.0 + frame, 0.0, 1.0, RED);
+  img.update();
+}
+
+int main() {
+  const uint32_t width = 64, height = 48, frames = 5;
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+
+  {
+    FrameSequenceCanvas y4m(width, height, "sequence.y4m", SequenceFormat::Y4M,
+                            viewport, WHITE);
+    FrameSequenceCanvas bmps(width, height, "sequence_%02d.bmp",
+                             SequenceFormat::BMP_FILES, viewport, WHITE);
+    for (uint32_t i = 0; i < frames; i++) {
+      draw_frame(y4m, i);
+      y4m.display();
+      draw_frame(bmps, i);
+      bmps.display();
+    }
+  }
+
+  std::string header = "YUV4MPEG2 W64 H48 F30:1 Ip A1:1 C444\n";
+  std::string y4m = read_file("sequence.y4m");
+  if (y4m.size() != header.size() + frames * (6 + 3 * width * height) ||
+      y4m.compare(0, header.size(), header) != 0) {
+    std::cerr << "Unexpected Y4M stream\n";
+    return 1;
+  }
+
+  // Every frame starts from the background, so it matches a fresh BmpCanvas
+  // even though the buffers are recycled.
+  for (uint32_t i = 0; i < frames; i++) {
+    BmpCanvas single(width, height, "sequence_single.bmp", viewport, WHITE);
+    draw_frame(single, i);
+    single.display();
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "sequence_%02d.bmp", i);
+    if (read_file(name) != read_file("sequence_single.bmp")) {
+      std::cerr << "Frame " << i << " differs from BmpCanvas\n";
+      return 1;
+    }
+  }
+  return 0;
+}
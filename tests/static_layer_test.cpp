@@ -0,0 +1,80 @@
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+int main() {
+  Viewport v = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+  std::vector<std::pair<float, float>> series;
+  for (int i = 0; i < 10000; i++) {
+    series.emplace_back(-5.0f + i * 1e-3f, (i % 7) * 0.3f - 1.0f);
+  }
+
+  BmpCanvas img(200, 200, "static_layer.bmp", v, WHITE);
+  img.set_decimation(true);
+  img.add_circle(0.0, 0.0, 2.0, BLUE);
+  img.add_connected_points(series, BLACK, 0.0);
+  img.mark_static();
+  if (img.get_static_count() != 2) {
+    std::cerr << "Static layer holds " << img.get_static_count()
+              << " primitives\n";
+    return 1;
+  }
+
+  // Replacing the dynamic layer keeps the static one, and the result is the
+  // same as drawing the whole scene at once. display_async() starts every
+  // frame from the background.
+  for (int frame = 0; frame < 3; frame++) {
+    img.clear_dynamic();
+    img.add_line(-4.0, -4.0, 4.0, frame, RED, 0.2);
+    img.add_connected_points(series, GREEN, 0.0);
+
+    BmpCanvas reference(200, 200, "static_layer_reference.bmp", v, WHITE);
+    reference.set_decimation(true);
+    reference.add_circle(0.0, 0.0, 2.0, BLUE);
+    reference.add_connected_points(series, BLACK, 0.0);
+    reference.add_line(-4.0, -4.0, 4.0, frame, RED, 0.2);
+    reference.add_connected_points(series, GREEN, 0.0);
+
+    for (BmpCanvas* c : {&img, &reference}) {
+      c->update();
+      c->display_async().wait();
+    }
+    if (img.get_primitives().size() != 4) {
+      std::cerr << "Frame " << frame << " holds "
+                << img.get_primitives().size() << " primitives\n";
+      return 1;
+    }
+    if (read_file("static_layer.bmp") !=
+        read_file("static_layer_reference.bmp")) {
+      std::cerr << "Frame " << frame << " differs from the full scene\n";
+      return 1;
+    }
+  }
+
+  // Decimated static polylines still follow the viewport.
+  Viewport zoomed = {.top = 2.0, .bottom = -2.0, .left = -1.0, .right = 1.0};
+  img.clear_dynamic();
+  img.set_viewport(zoomed);
+  BmpCanvas reference(200, 200, "static_layer_reference.bmp", zoomed, WHITE);
+  reference.add_circle(0.0, 0.0, 2.0, BLUE);
+  reference.add_connected_points(series, BLACK, 0.0);
+  for (BmpCanvas* c : {&img, &reference}) {
+    c->update();
+    c->display_async().wait();
+  }
+  if (read_file("static_layer.bmp") !=
+      read_file("static_layer_reference.bmp")) {
+    std::cerr << "Static layer differs after zooming\n";
+    return 1;
+  }
+
+  img.clear_primitives();
+  if (img.get_static_count() != 0 || !img.get_primitives().empty()) {
+    std::cerr << "clear_primitives kept the static layer\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <type_traits>
+#include <variant>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+#ifndef CANVAS_STATS
+#error "stats_test needs the library built with CANVAS_STATS"
+#endif
+
+// Position of T in Primitive, which RasterStats::primitives is indexed by.
+template <typename T, size_t I = 0>
+static constexpr size_t index_of() {
+  if constexpr (std::is_same_v<std::variant_alternative_t<I, Primitive>, T>) {
+    return I;
+  } else {
+    return index_of<T, I + 1>();
+  }
+}
+
+int main() {
+  // World coordinates are pixel coordinates.
+  Viewport pixels = {.top = 7.0, .bottom = 0.0, .left = 0.0, .right = 15.0};
+  Rgba translucent = {.r = 0.9, .g = 0.3, .b = 0.5, .a = 0.6};
+  BmpCanvas img(16, 8, "", pixels, WHITE);
+
+  // Opaque pixels [2, 10) x [2, 6) are written, translucent pixels
+  // [10, 14) x [2, 6) blended and the shapes off the canvas culled.
+  img.add_polygon({{1.5, 1.5}, {9.5, 1.5}, {9.5, 5.5}, {1.5, 5.5}}, RED);
+  img.add_polygon({{9.5, 1.5}, {13.5, 1.5}, {13.5, 5.5}, {9.5, 5.5}},
+                  translucent);
+  img.add_circle(40.0, 4.0, 2.0, RED);
+  img.add_triangle(Vec2(-9.0, -9.0), Vec2(-5.0, -9.0), Vec2(-5.0, -5.0), RED);
+  img.update();
+
+  const RasterStats& stats = img.get_stats();
+  if (stats.primitives[index_of<Polygon>()] != 2 ||
+      stats.primitives[index_of<Circle>()] != 1 ||
+      stats.primitives[index_of<Triangle>()] != 1 ||
+      stats.primitives[index_of<Line>()] != 0) {
+    std::cerr << "Wrong primitive counts\n";
+    return 1;
+  }
+  if (stats.culled != 2) {
+    std::cerr << "Culled " << stats.culled << " primitives instead of 2\n";
+    return 1;
+  }
+  if (stats.pixels_written != 32 || stats.pixels_blended != 16) {
+    std::cerr << "Wrote " << stats.pixels_written << " and blended "
+              << stats.pixels_blended << " pixels instead of 32 and 16\n";
+    return 1;
+  }
+  if (stats.splats != 0) {
+    std::cerr << "Splats without a LOD threshold\n";
+    return 1;
+  }
+
+  // Counters start over with every update().
+  img.update();
+  if (stats.primitives[index_of<Polygon>()] != 2 || stats.culled != 2 ||
+      stats.pixels_written != 32 || stats.pixels_blended != 16) {
+    std::cerr << "Counters add up across updates\n";
+    return 1;
+  }
+  return 0;
+}
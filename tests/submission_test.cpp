@@ -0,0 +1,53 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "canvas.h"
+
+using namespace Canvas;
+
+static Rgba thread_color(uint32_t t) {
+  return Rgba{.r = t / 4.0f, .g = 0.5f, .b = 1.0f - t / 4.0f, .a = 0.5f};
+}
+
+template <typename T>
+static void submit(T& target, uint32_t t) {
+  for (int i = 0; i < 200; i++) {
+    float x = -4.0f + (i % 20) * 0.4f, y = -4.0f + (i / 20) * 0.8f + t * 0.1f;
+    target.add_circle(x, y, 0.5f, thread_color(t));
+  }
+}
+
+int main() {
+  const uint32_t threads = 4;
+  Viewport viewport = {.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0};
+
+  // Contexts are merged by id, then in submission order, whichever thread
+  // finishes first.
+  BmpCanvas expected(200, 200, "submission_expected.bmp", viewport, WHITE);
+  expected.add_line(-5.0, 0.0, 5.0, 0.0, BLACK, 0.1);
+  for (uint32_t t = 0; t < threads; t++) submit(expected, t);
+  expected.update();
+
+  BmpCanvas img(200, 200, "submission.bmp", viewport, WHITE);
+  img.add_line(-5.0, 0.0, 5.0, 0.0, BLACK, 0.1);
+  std::vector<std::thread> workers;
+  for (uint32_t t = threads; t-- > 0;) {
+    workers.emplace_back([&img, t] {
+      auto context = img.submission_context(t);
+      submit(*context, t);
+    });
+  }
+  for (auto& w : workers) w.join();
+  img.update();
+
+  for (uint32_t y = 0; y < 200; y++) {
+    for (uint32_t x = 0; x < 200; x++) {
+      if (!(img.get_pixel(x, y) == expected.get_pixel(x, y))) {
+        std::cerr << "Submitted scene differs at " << x << ", " << y << "\n";
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
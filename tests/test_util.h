@@ -0,0 +1,68 @@
+#ifndef __CANVAS_TEST_UTIL_H
+#define __CANVAS_TEST_UTIL_H
+
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "canvas.h"
+
+// The whole file, empty if it cannot be read.
+static std::string read_file(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f), {});
+}
+
+// A small translucent image with a circle on it, for scenes with images.
+static std::shared_ptr<Canvas::BmpCanvas> make_test_tile() {
+  using namespace Canvas;
+  auto tile = std::make_shared<BmpCanvas>(
+      9, 5, "", Viewport{.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0},
+      Rgba{.r = 1.0, .g = 0.5, .b = 0.0, .a = 0.8});
+  tile->add_circle(0.5, 0.5, 0.3, BLUE);
+  tile->update();
+  return tile;
+}
+
+// One of every primitive within [-5, 5] x [-5, 5], with translucent
+// overlaps, `label` as text and a clipped layer, for comparing renderers.
+static void add_test_scene(Canvas::Canvas& img,
+                           std::shared_ptr<Canvas::BmpCanvas> tile,
+                           const std::string& label) {
+  using namespace Canvas;
+  for (float t = 0.0; t <= 2.0 * M_PI; t += 0.3) {
+    img.add_line(0.0, 0.0, 4.5 * std::cos(t), 4.5 * std::sin(t), RED, 0.0);
+  }
+  img.add_triangle(Vec2(-6.0, -6.0), Vec2(6.0, -4.0), Vec2(-1.0, 6.0),
+                   Rgba{.r = 0.0, .g = 0.0, .b = 1.0, .a = 0.3});
+  img.add_circle(2.0, 2.0, 1.5, GREEN);
+  img.add_line(-4.0, -3.0, 3.0, 4.0,
+               Rgba{.r = 1.0, .g = 0.0, .b = 0.0, .a = 0.5}, 0.2);
+  img.add_polygon({{{-4, -4}, {4, -4}, {4, 4}, {-4, 4}},
+                   {{-2, -2}, {2, -2}, {2, 2}, {-2, 2}}},
+                  Rgba{.r = 0.5, .g = 0.0, .b = 0.5, .a = 0.4},
+                  FillRule::EVEN_ODD);
+  img.add_polyline({{-4, 3}, {-2, 4}, {0, 3}}, BLACK, 0.1, LineJoin::MITER);
+  img.add_quadratic_bezier(Vec2(-4.0, -2.0), Vec2(0.0, -5.0),
+                           Vec2(4.0, -2.0), BLUE, 0.05);
+  img.add_cubic_bezier(Vec2(-4.0, 0.0), Vec2(-2.0, 5.0), Vec2(2.0, -5.0),
+                       Vec2(4.0, 0.0), BLACK, 0.1);
+  img.add_text(-4.5, 3.5, label, 0.9, BLACK);
+  img.add_image(tile, Viewport{.top = -1.0, .bottom = -4.5, .left = 4.5,
+                               .right = 1.0});
+  img.add_image(tile, Viewport{.top = 4.5, .bottom = 3.0, .left = 3.0,
+                               .right = 4.5});
+
+  img.add_primitive(PushLayer{.opacity = 0.5,
+                              .clip = Viewport{.top = 1.0,
+                                               .bottom = -3.0,
+                                               .left = -3.0,
+                                               .right = 3.0}});
+  img.add_circle(-1.0, -1.0, 2.0, BLUE);
+  img.add_circle(1.0, -1.0, 2.0, BLUE);
+  img.add_primitive(PopLayer{});
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include <iostream>
+
+#include "canvas.h"
+#include "test_util.h"
+
+using namespace Canvas;
+
+int main() {
+  // At the font resolution the stamps are the font bitmap itself.
+  GlyphCache cache;
+  const GlyphCache::Stamp& h = cache.get('H', TEXT_CELL_HEIGHT);
+  if (h.width != TEXT_CELL_WIDTH || h.coverage[0] != 255 ||
+      h.coverage[1] != 0 || h.coverage[4] != 255 || h.coverage[5] != 0) {
+    std::cerr << "Unexpected stamp for 'H'\n";
+    return 1;
+  }
+  if (&cache.get('H', TEXT_CELL_HEIGHT) != &h) {
+    std::cerr << "Stamp was not cached\n";
+    return 1;
+  }
+
+  // One world unit per pixel, the text covers pixels from x = 10 and y = 20
+  // upwards and leaves the rest of the canvas alone.
+  Viewport viewport = {.top = 63.0, .bottom = 0.0, .left = 0.0, .right = 63.0};
+  BmpCanvas img(64, 64, "text.bmp", viewport, WHITE);
+  img.add_text(10.0, 20.0, "Hi!", 16.0, BLACK);
+  img.update();
+
+  uint32_t covered = 0;
+  for (uint32_t y = 0; y < 64; y++) {
+    for (uint32_t x = 0; x < 64; x++) {
+      bool inside = x >= 10 && x < 10 + 3 * 12 && y >= 20 && y < 36;
+      Rgba c = img.get_pixel(x, y);
+      if (!inside && !(c == WHITE)) {
+        std::cerr << "Pixel " << x << ", " << y << " outside the text\n";
+        return 1;
+      }
+      covered += inside && c.r < 0.5f;
+    }
+  }
+  if (covered < 50) {
+    std::cerr << "Only " << covered << " pixels covered by the text\n";
+    return 1;
+  }
+  img.display();
+
+  // Text is upright whatever the direction of the viewport axes, so a flipped
+  // viewport with the origin at the mirrored position gives the same image.
+  Viewport flipped = {.top = 0.0, .bottom = 63.0, .left = 63.0, .right = 0.0};
+  BmpCanvas mirrored(64, 64, "text_flipped.bmp", flipped, WHITE);
+  mirrored.add_text(63.0 - 10.0, 63.0 - 20.0, "Hi!", 16.0, BLACK);
+  mirrored.update();
+  mirrored.display();
+  if (read_file("text.bmp") != read_file("text_flipped.bmp")) {
+    std::cerr << "Flipped viewport changes the text\n";
+    return 1;
+  }
+
+  // Cached stamps hold the same coverage glyphs too tall for the cache are
+  // sampled with.
+  const GlyphCache::Stamp& a = cache.get('A', 21);
+  for (uint32_t y = 0; y < a.height; y++) {
+    for (uint32_t x = 0; x < a.width; x++) {
+      if (a.coverage[y * a.width + x] != GlyphCache::coverage('A', 21, x, y)) {
+        std::cerr << "Stamp differs from the sampled coverage\n";
+        return 1;
+      }
+    }
+  }
+
+  // A glyph millions of pixels tall is only drawn where it meets the
+  // canvas. Font pixels are 2500 world units, so the canvas lies on the left
+  // leg of the 'A' in its second row from the bottom, or between the legs.
+  Viewport unit = {.top = 1.0, .bottom = 0.0, .left = 0.0, .right = 1.0};
+  for (bool on_leg : {true, false}) {
+    BmpCanvas huge(100, 100, "", unit, WHITE);
+    huge.add_text(on_leg ? -1000.0 : -3500.0, -3000.0, "AAAA", 20000.0,
+                  BLACK);
+    huge.update();
+    if (!(huge.get_pixel(50, 50) == (on_leg ? BLACK : WHITE))) {
+      std::cerr << "Huge glyph is drawn wrong\n";
+      return 1;
+    }
+  }
+  return 0;
+}
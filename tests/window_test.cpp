@@ -1,5 +1,9 @@
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
 
 #include "canvas.h"
 
@@ -16,10 +20,45 @@ class MyHandler : public WindowHandler {
             .count() >= 2) {
       canvas.stop();
     }
+
+    // A moving marker over the cached static layer.
+    float t = std::chrono::duration<float>(std::chrono::system_clock::now() -
+                                           start)
+                  .count();
+    canvas.clear_dynamic();
+    canvas.add_circle(3.0 * std::cos(t), 3.0 * std::sin(t), 0.3, RED);
   }
 };
 
+// In a window twice as wide as its square viewport, glyphs keep the shape
+// of the font: two 'H's 40 pixels tall span 30 + 25 pixels, as on the CPU
+// canvases.
+static bool text_keeps_its_shape() {
+  GLFWCanvas img(400, 200, "text", std::make_shared<WindowHandler>(),
+                 Viewport{.top = 5.0, .bottom = -5.0, .left = -5.0,
+                          .right = 5.0});
+  img.add_text(-4.0, 0.0, "HH", 2.0, RED);
+  glClear(GL_COLOR_BUFFER_BIT);
+  img.update();
+
+  std::vector<uint8_t> pixels(400 * 200 * 4);
+  glReadPixels(0, 0, 400, 200, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  int x0 = 400, x1 = -1;
+  for (int i = 0; i < 400 * 200; i++) {
+    if (pixels[4 * i] > 127 && pixels[4 * i + 1] < 128) {
+      x0 = std::min(x0, i % 400);
+      x1 = std::max(x1, i % 400);
+    }
+  }
+  return x1 - x0 + 1 >= 53 && x1 - x0 + 1 <= 57;
+}
+
 int main() {
+  if (!text_keeps_its_shape()) {
+    std::cerr << "Text is stretched in a non-square window\n";
+    return 1;
+  }
+
   GLFWCanvas img = GLFWCanvas(
       500, 500, "hello", std::make_shared<MyHandler>(),
       Viewport{.top = 5.0, .bottom = -5.0, .left = -5.0, .right = 5.0});
@@ -27,6 +66,7 @@ int main() {
   img.add_circle(0.0, 0.0, 1.0, BLUE);
   img.add_triangle(Vec2(-2.0, 1.0), Vec2(-1.0, 1.0), Vec2(-1.5, 2.0), RED);
   img.add_line(-1.0, 1.0, 1.0, -3.0, GREEN, 0.1);
+  img.mark_static();
 
   img.update();
   img.display();